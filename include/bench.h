@@ -0,0 +1,9 @@
+#ifndef C_BENCH_H
+#define C_BENCH_H
+
+void run_benches(int argc, char **argv);
+
+// seconds of processor time since some fixed point
+double bench_now(void);
+
+#endif /* C_BENCH_H */
@@ -0,0 +1,26 @@
+#ifndef C_COMMON_ARENA_H
+#define C_COMMON_ARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARENA_ALIGNOF(type) offsetof(struct { char c; type t; }, t)
+
+struct ArenaChunk;
+
+// chunked bump allocator; everything is released at once by `arena_fini`.
+// allocations never move, so pointers into an arena stay valid until then.
+struct Arena {
+	struct ArenaChunk *chunks;
+	uint8_t *cur, *end;
+	ptrdiff_t chunk_size;
+	ptrdiff_t allocs; // calls made to malloc
+	ptrdiff_t used;   // bytes handed out
+};
+
+int arena_init(struct Arena *arena, ptrdiff_t chunk_size);
+void arena_fini(struct Arena *arena);
+// returns NULL if the underlying allocation failed
+void *arena_alloc(struct Arena *arena, ptrdiff_t size, ptrdiff_t align);
+
+#endif /* C_COMMON_ARENA_H */
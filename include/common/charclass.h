@@ -0,0 +1,57 @@
+#ifndef C_COMMON_CHARCLASS_H
+#define C_COMMON_CHARCLASS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// classes of the bytes of the source character set, the same in every locale.
+// bytes above 0x7F belong to no class, they only appear in UTF-8 sequences.
+enum CharClass {
+	CHAR_IDENT_START = 1 << 0, // [A-Za-z_]
+	CHAR_IDENT       = 1 << 1, // [A-Za-z_0-9]
+	CHAR_DIGIT       = 1 << 2, // [0-9]
+	CHAR_OCTAL       = 1 << 3, // [0-7]
+	CHAR_HEX         = 1 << 4, // [0-9A-Fa-f]
+	CHAR_SPACE       = 1 << 5, // what isspace gives in the C locale, newline included
+	CHAR_NEWLINE     = 1 << 6, // \n
+	CHAR_PUNCT       = 1 << 7, // can start a punctuator
+};
+
+static const uint8_t char_class[256] = {
+	['\t'] = CHAR_SPACE,
+	['\n'] = CHAR_SPACE | CHAR_NEWLINE,
+	['\v'] = CHAR_SPACE,
+	['\f'] = CHAR_SPACE,
+	['\r'] = CHAR_SPACE,
+	[' ' ] = CHAR_SPACE,
+	['0' ... '7'] = CHAR_IDENT | CHAR_DIGIT | CHAR_OCTAL | CHAR_HEX,
+	['8' ... '9'] = CHAR_IDENT | CHAR_DIGIT | CHAR_HEX,
+	['A' ... 'F'] = CHAR_IDENT_START | CHAR_IDENT | CHAR_HEX,
+	['G' ... 'Z'] = CHAR_IDENT_START | CHAR_IDENT,
+	['a' ... 'f'] = CHAR_IDENT_START | CHAR_IDENT | CHAR_HEX,
+	['g' ... 'z'] = CHAR_IDENT_START | CHAR_IDENT,
+	['_' ] = CHAR_IDENT_START | CHAR_IDENT,
+	['[' ] = CHAR_PUNCT, [']' ] = CHAR_PUNCT, ['(' ] = CHAR_PUNCT, [')' ] = CHAR_PUNCT,
+	['{' ] = CHAR_PUNCT, ['}' ] = CHAR_PUNCT, ['.' ] = CHAR_PUNCT, ['-' ] = CHAR_PUNCT,
+	['+' ] = CHAR_PUNCT, ['&' ] = CHAR_PUNCT, ['*' ] = CHAR_PUNCT, ['~' ] = CHAR_PUNCT,
+	['!' ] = CHAR_PUNCT, ['/' ] = CHAR_PUNCT, ['%' ] = CHAR_PUNCT, ['<' ] = CHAR_PUNCT,
+	['>' ] = CHAR_PUNCT, ['=' ] = CHAR_PUNCT, ['^' ] = CHAR_PUNCT, ['|' ] = CHAR_PUNCT,
+	['?' ] = CHAR_PUNCT, [':' ] = CHAR_PUNCT, [';' ] = CHAR_PUNCT, [',' ] = CHAR_PUNCT,
+	['#' ] = CHAR_PUNCT,
+};
+
+static inline bool char_is(uint8_t c, enum CharClass class) {
+	return char_class[c] & class;
+}
+
+// ASCII only, anything else is returned as is
+static inline uint8_t char_lower(uint8_t c) {
+	return c >= 'A' && c <= 'Z' ? c | 0x20: c;
+}
+
+// only meaningful if `c` is CHAR_HEX
+static inline int char_hex_value(uint8_t c) {
+	return c <= '9' ? c - '0': (c | 0x20) - 'a' + 0xa;
+}
+
+#endif /* C_COMMON_CHARCLASS_H */
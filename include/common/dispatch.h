@@ -0,0 +1,16 @@
+#ifndef C_COMMON_DISPATCH_H
+#define C_COMMON_DISPATCH_H
+
+// the function `resolve()` picks for this processor, found on first use and kept in `slot`,
+// a static function pointer that starts out NULL. threads may race to resolve it, they all
+// find the same one, so nothing is needed beyond the pointer being read and written whole.
+#define DISPATCH(slot, resolve) (__extension__ ({ \
+	__typeof__ (slot) dispatch_ = __atomic_load_n(&(slot), __ATOMIC_RELAXED); \
+	if (!dispatch_) __atomic_store_n(&(slot), dispatch_ = (resolve)(), __ATOMIC_RELAXED); \
+	dispatch_; \
+}))
+
+// whether this processor has the extension `feature` names, a string literal such as "avx2"
+#define CPU_SUPPORTS(feature) (__builtin_cpu_init(), __builtin_cpu_supports(feature))
+
+#endif /* C_COMMON_DISPATCH_H */
@@ -167,6 +167,8 @@ enum TokenKind {
 	TOKEN_CIRCUMFLEX_ASSIGN,
 	TOKEN_BAR_ASSIGN,
 	TOKEN_COMMA,
+	TOKEN_HASH, // only seen by the preprocessor
+	TOKEN_HASH_HASH,
 	TOKEN_PUNCTUATOR_END,
 	TOKEN_END,
 };
@@ -4,6 +4,7 @@
 #include <stream/stream.h>
 
 #include <stdarg.h>
+#include <stdio.h>
 
 long uwuprintf(const char *fmt, ...);
 long uwufprintf(Stream stream, const char *fmt, ...);
@@ -12,5 +13,10 @@ long uwusprintf(char *buf, const char *fmt, ...);
 long uwuvsprintf(char *buf, const char *fmt, va_list args);
 long uwuvsnprintf(char *buf, long n, const char *fmt, va_list args);
 
+// a diagnostic, printed to stdout unless `log_diagnostics` gave the calling thread a file of its own
+int diagnose(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+// where the diagnostics of the calling thread go from now on, stdout if `file` is NULL
+void log_diagnostics(FILE *file);
+
 #endif /* C_UWU_COMMON_LOG_H */
 
@@ -0,0 +1,23 @@
+#ifndef C_COMMON_POOL_H
+#define C_COMMON_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define POOL_MAX_THREADS (256)
+
+// the jobs a thread has yet to run, `lo` up to `hi` packed into one word so that
+// taking one from the bottom and stealing half from the top are a single compare-and-swap
+struct PoolQueue {
+	__attribute__((aligned(64))) uint64_t range;
+};
+
+typedef void (*pool_job)(void *arg, ptrdiff_t i);
+
+// runs `job(arg, i)` for every `i` below `count`, on up to `threads` threads counting the calling one.
+// each thread starts on a run of jobs of its own, from the bottom, and once it is out takes the top
+// half of what another has left. the jobs finish in any order. -1 if no thread could be started,
+// in which case the calling thread runs them all.
+int pool_run(ptrdiff_t count, int threads, pool_job job, void *arg);
+
+#endif /* C_COMMON_POOL_H */
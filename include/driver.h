@@ -0,0 +1,11 @@
+#ifndef C_DRIVER_H
+#define C_DRIVER_H
+
+// compiles each file named after the options, `-jN` of them at a time:
+// `file.c` is preprocessed into `file.i`, which is then lexed.
+// the options are `-jN`, `-I dir`, `--cache dir` and `--include-pch file`, or
+// `--write-pch file` for a single prefix header, whose state is saved for `--include-pch`.
+// returns the exit status.
+int run_driver(int argc, char **argv);
+
+#endif /* C_DRIVER_H */
@@ -3,22 +3,47 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+
+#include <common/arena.h>
+
+// open-addressing table with linear probing.
+// the hash and length are kept in the slot so that most probes
+// never have to look at the string itself.
+struct InternSlot {
+	uint32_t hash;
+	uint32_t len;
+	const struct InternString *intern; // NULL if the slot is free
+};
 
 struct Interns {
 	ptrdiff_t len, cap;
-	struct InternString *interns;
+	struct InternString **interns; // indexed by id
+	ptrdiff_t slot_cap; // always 0 or a power of 2
+	struct InternSlot *slots;
+	// records and their bytes live here, so they never move
+	struct Arena strings;
+	ptrdiff_t allocs; // calls to malloc for the tables above
 };
 
 struct InternString {
 	ptrdiff_t len;
 	uint8_t *str;
+	uint32_t id; // order of insertion, starting at 0
+};
+
+struct InternStats {
+	ptrdiff_t strings;
+	ptrdiff_t allocs;
+	ptrdiff_t bytes;
 };
 
 int intern_init(struct Interns *interns);
 void intern_fini(struct Interns *interns);
 const struct InternString *intern_string(struct Interns *interns, const uint8_t *str, ptrdiff_t len);
 const struct InternString *intern_find(const struct Interns *interns, const uint8_t *str, ptrdiff_t len);
-bool intern_contains(const struct Interns *interns, const uint8_t *str, long ptrdiff_t);
+bool intern_contains(const struct Interns *interns, const uint8_t *str, ptrdiff_t len);
+void intern_stats(const struct Interns *interns, struct InternStats *stats);
 
 int print_interns(const struct Interns *interns);
 int print_intern(const struct InternString *intern);
@@ -26,4 +51,3 @@ int print_intern(const struct InternString *intern);
 const struct Interns *get_keyword_interns(void);
 
 #endif /* C_INTERN_INTERN_H */
-
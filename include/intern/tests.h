@@ -0,0 +1,7 @@
+#ifndef C_INTERN_TESTS_H
+#define C_INTERN_TESTS_H
+
+int intern_test(void);
+int intern_bench(void);
+
+#endif /* C_INTERN_TESTS_H */
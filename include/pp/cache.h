@@ -0,0 +1,38 @@
+#ifndef C_PP_CACHE_H
+#define C_PP_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct Preprocessor;
+struct Header;
+
+#define CACHE_MAGIC "uwupp\0\0\2"
+
+// what a file of the header cache starts with. the file is named after the hash of a header
+// as it is on disk, and holds what phases 1 to 3 and decomposing made of it. nothing in it is
+// a pointer, so it is mapped and used as it is: each part is at an offset from the start, 8-byte
+// aligned, and the identifiers of its tokens are indices into its own strings. the header itself
+// is kept at `source`, so that a file is only used for a header that is the same byte for byte.
+struct CacheFile {
+	char magic[8];
+	uint64_t hash, size; // of the header on disk
+	uint64_t source;
+	uint32_t token_size; // sizeof (struct PreprocessingToken), in case it changes
+	uint32_t len; // of the output of phases 1 to 3 at `buf`, C_STREAM_PADDING zero bytes after it
+	uint64_t buf;
+	uint64_t edits, edit_len; // the `out` of its edit map, then the `delta`
+	uint64_t tokens, token_len;
+	// string `i` is `bytes` from `starts[i]` up to `starts[i + 1]`
+	uint64_t starts, bytes, string_len;
+	uint64_t total; // the size of the file
+};
+
+// what a header is cached under
+uint64_t cache_hash(const char *p, ptrdiff_t len);
+// maps `h`, header `file - 1` whose path is set, and puts it through phases 1 to 3 with every token
+// into `h->tokens`: from the cache in `dir` if it is there, or the usual way and then into the cache.
+// -1 on error, once it is reported.
+int cache_map(struct Preprocessor *pp, const char *dir, struct Header *h, uint16_t file);
+
+#endif /* C_PP_CACHE_H */
@@ -1,7 +1,50 @@
 #ifndef C_PP_COMMON_H
 #define C_PP_COMMON_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
 #include "pp/enums.h"
+#include "stream/stream.h"
+
+// longest path the preprocessor reads or writes, directory included
+#define PP_MAX_PATH (4096)
+// `n` up to the next multiple of 8, for the parts of the files it maps
+#define PP_ALIGN(n) (((n) + 7) & ~(uint64_t) 7)
+
+enum PreprocessingTokenFlag {
+	PP_TOKEN_SPACE = 1 << 0, // whitespace before it, a newline or a comment included
+	PP_TOKEN_BOL   = 1 << 1, // the first of its line
+	PP_TOKEN_SPELLED = 1 << 2, // made by # or ##, its spelling is in `Preprocessor.spellings`
+};
+
+// a preprocessing token of a file, 16 bytes so that 4 fit in a cache line
+struct PreprocessingToken {
+	uint32_t offset, len;
+	// identifiers: their id in `Preprocessor.identifiers`. punctuators: their `enum TokenKind`.
+	// parameters: their index. 0 for the others.
+	uint32_t id;
+	uint16_t file; // 0 for `Preprocessor.buf`, header `file - 1` of `Preprocessor.headers` otherwise
+	uint8_t kind;  // enum PreprocessingTokenKind
+	uint8_t flags; // enum PreprocessingTokenFlag
+};
+
+struct PreprocessingTokens {
+	ptrdiff_t len, cap;
+	struct PreprocessingToken *items;
+};
+
+// makes room for `need` items in the vector whose items are at `items`, doubling from 64.
+// false once it is reported that `what` could not grow.
+bool pp_grow(void *items, ptrdiff_t *cap, ptrdiff_t need, size_t size, const char *what);
+#define PP_RESERVE(v, n, what) ((v)->len + (n) <= (v)->cap \
+		|| pp_grow(&(v)->items, &(v)->cap, (v)->len + (n), sizeof (*(v)->items), what))
+
+// whether `count` items of `size` bytes at `offset` are within `total` bytes of a mapped file
+bool pp_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t total);
+// writes zeros from `*at` up to `offset`, then `len` bytes of `p`
+bool pp_section(Stream stream, uint64_t *at, uint64_t offset, const void *p, size_t len);
 
 #endif /* C_PP_COMMON_H */
 
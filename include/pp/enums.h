@@ -10,6 +10,8 @@ enum PreprocessingTokenKind {
 	PREPROCESSING_TOKEN_STRING_LITERAL,
 	PREPROCESSING_TOKEN_PUNCTUATOR,
 	PREPROCESSING_TOKEN_ANYTHING,
+	PREPROCESSING_TOKEN_PARAMETER, // only in the replacement list of a macro
+	PREPROCESSING_TOKEN_DEFINED, // only in #if, what `defined X` gave: its id is 1 or 0
 	PREPROCESSING_TOKEN_NUM,
 };
 
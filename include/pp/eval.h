@@ -0,0 +1,50 @@
+#ifndef C_PP_EVAL_H
+#define C_PP_EVAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "pp/common.h"
+#include <ast/expression_enums.h>
+#include <intern/intern.h>
+
+struct Preprocessor;
+
+// the code of an #if expression is bytes, for a stack of uintmax_t.
+// an operator of `enum Operator` is the opcode that does it, with EVAL_UNSIGNED
+// set if its operands are uintmax_t rather than intmax_t. the others follow.
+enum EvalOpcode {
+	EVAL_PUSH = OPERATOR_END, // operand 16-bit index into the operands
+	EVAL_JUMP,       // operand 16-bit offset into the code
+	EVAL_JUMP_FALSE, // pops, jumps if it was 0
+	EVAL_AND,        // jumps if the top is 0, pops it otherwise
+	EVAL_OR,         // makes the top 1 and jumps if it is not 0, pops it otherwise
+	EVAL_BOOL,       // the top as 0 or 1
+	EVAL_RETURN,
+};
+
+#define EVAL_UNSIGNED (0x80)
+
+// #if expressions, compiled once for each shape they come in: their operators and
+// parentheses as they are, each operand only as signed or unsigned. the values of the
+// operands are read from the tokens every time, so `V >= 4` compiles once whatever V is.
+struct IfExpressions {
+	struct Interns shapes;
+	// by shape id: where its code starts in `code`, UINT32_MAX if it does not compile
+	struct { ptrdiff_t len, cap; uint32_t *items; } compiled;
+	struct { ptrdiff_t len, cap; uint8_t *items; } code;
+	// of the expression being evaluated
+	struct { ptrdiff_t len, cap; uint8_t *items; } shape;
+	struct { ptrdiff_t len, cap; uintmax_t *items; } operands, stack;
+	ptrdiff_t hits; // evaluations whose shape was already compiled
+};
+
+int if_expressions_init(struct IfExpressions *ifs);
+void if_expressions_fini(struct IfExpressions *ifs);
+// whether the #if expression of `tokens`, macros expanded and `defined` done, is not 0.
+// -1 on error, once it is reported about the directive named `at`.
+int if_evaluate(struct Preprocessor *pp, const struct PreprocessingToken *at,
+		const struct PreprocessingToken *tokens, ptrdiff_t len);
+
+#endif /* C_PP_EVAL_H */
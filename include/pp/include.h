@@ -0,0 +1,85 @@
+#ifndef C_PP_INCLUDE_H
+#define C_PP_INCLUDE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "stream/stream.h"
+#include "pp/common.h"
+#include "pp/pre.h"
+#include <intern/intern.h>
+#include <uwu/lines.h>
+
+struct Preprocessor;
+
+// a file that was included, loaded the first time and kept for the next ones
+struct Header {
+	char *path; // as found, where its own quoted includes are looked for first
+	const char *buf; // like `Preprocessor.buf`
+	long len;
+	Stream stream;
+	bool owned;
+	struct EditMap edits;
+	struct LineIndex lines;
+	uint64_t dev, ino; // what the file is, whatever path it is reached through
+	// what makes a later #include of it a no-op, known once it has been read through
+	uint32_t guard; // identifier id + 1 of the macro of `#ifndef X ... #endif` around it all, or 0
+	bool once; // #pragma once
+	// with a header cache, every token of `buf` up front, `whole` even if there are none
+	struct PreprocessingTokens tokens;
+	bool whole;
+	// when they came from the cache: the file, `map_len` bytes that `buf` and `tokens` are in.
+	// the ids of its identifiers are its own, string `i` of it is identifier `ids[i]`.
+	const void *map;
+	size_t map_len;
+	uint32_t *ids;
+	uint32_t id_len;
+};
+
+// a file that a precompiled header read, which is not read again if that would change nothing
+struct Precompiled {
+	uint64_t dev, ino;
+	uint32_t guard;
+	bool once;
+};
+
+// every header once, and where each path searched so far led
+struct Headers {
+	ptrdiff_t len, cap;
+	struct Header *items;
+	// open addressing on device and inode, header index + 1 or 0 for a free slot
+	ptrdiff_t slot_cap; // always 0 or a power of 2
+	uint32_t *slots;
+	// the paths tried, interned, and what they are: header index + 1, 0 if there is no such file,
+	// UINT32_MAX while it is to be looked up again
+	struct Interns paths;
+	struct { ptrdiff_t len, cap; uint32_t *items; } found;
+	// the -I directories, searched in order after the directory of the includer for "", alone for <>
+	struct { ptrdiff_t len, cap; char **items; } search;
+	uint64_t dev, ino; // of the file being translated
+	uint32_t guard; // like those of the headers, once the file has been translated
+	bool once;
+	struct { ptrdiff_t len, cap; struct Precompiled *items; } precompiled;
+	char *cache; // the directory of the header cache, NULL if there is none
+	ptrdiff_t cached; // headers that were in it
+};
+
+#define MAX_INCLUDE_DEPTH (200)
+
+// `main` is the file being translated, which a header may include too
+int headers_init(struct Headers *headers, const char *main);
+void headers_fini(struct Headers *headers);
+// appends `dir` to the directories searched. -1 on allocation failure.
+int preprocessor_search(struct Preprocessor *pp, const char *dir);
+// adds a file that a precompiled header read. -1 on allocation failure.
+int headers_precompiled(struct Headers *headers, struct Precompiled file);
+// caches the headers in `dir`, which must exist: a header is looked for there by its contents
+// and mapped from there, or put there if it is not. -1 on allocation failure.
+int preprocessor_cache(struct Preprocessor *pp, const char *dir);
+// the header that the #include at `at` of `name` leads to, found and loaded if it was not already:
+// its index + 1, 0 if including it again would change nothing. -1 on error, once it is reported.
+long preprocessor_include(struct Preprocessor *pp, const struct PreprocessingToken *at,
+		const char *name, long len, bool quoted);
+
+#endif /* C_PP_INCLUDE_H */
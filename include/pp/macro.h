@@ -0,0 +1,110 @@
+#ifndef C_PP_MACRO_H
+#define C_PP_MACRO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "pp/common.h"
+
+struct Preprocessor;
+
+#define HIDESET_UNIONS (64)
+
+// the macros a token must not be expanded by again, as sorted sets of identifier ids.
+// equal sets are the same set, so tokens share them and comparing is comparing ids.
+// set 0 is the empty one, which is what most tokens have.
+struct Hidesets {
+	ptrdiff_t len, cap;
+	uint32_t *starts; // set `i` is `members[starts[i]]` up to `members[starts[i + 1]]`
+	struct { ptrdiff_t len, cap; uint32_t *items; } members;
+	// open addressing on the members, to find a set that already exists
+	ptrdiff_t slot_cap; // always 0 or a power of 2
+	uint32_t *slots; // set id + 1, 0 if the slot is free
+	// recent unions, as every token of a frame asks for the same one
+	struct { uint32_t a, b, set; } unions[HIDESET_UNIONS];
+};
+
+int hidesets_init(struct Hidesets *sets);
+void hidesets_fini(struct Hidesets *sets);
+bool hideset_contains(const struct Hidesets *sets, uint32_t set, uint32_t name);
+// these return the id of the resulting set, -1 on allocation failure
+long hideset_add(struct Hidesets *sets, uint32_t set, uint32_t name);
+long hideset_union(struct Hidesets *sets, uint32_t a, uint32_t b);
+long hideset_intersection(struct Hidesets *sets, uint32_t a, uint32_t b);
+
+struct Macro {
+	uint32_t name; // identifier id
+	// the replacement list, `MacroTable.bodies` from `body` on.
+	// parameters are PREPROCESSING_TOKEN_PARAMETER, __VA_ARGS__ is the last one.
+	uint32_t body, len;
+	uint16_t params;
+	uint8_t kind; // CONTROL_LINE_DEFINE to CONTROL_LINE_DEFINE_ARGS_AND_VARARGS
+	bool operators; // # or ## in the replacement list, it cannot be spliced as is
+};
+
+// from identifier id to macro, with open addressing.
+// a removed macro leaves CONTROL_LINE_UNDEF in its slot, a free slot is CONTROL_LINE_NONE.
+struct MacroTable {
+	ptrdiff_t len, used, cap; // `used` counts removed macros too, `cap` is 0 or a power of 2
+	struct Macro *slots;
+	struct PreprocessingTokens bodies; // every replacement list, one after the other
+};
+
+int macro_table_init(struct MacroTable *macros);
+void macro_table_fini(struct MacroTable *macros);
+// NULL if `name` is not a macro
+const struct Macro *macro_find(const struct MacroTable *macros, uint32_t name);
+// adds or replaces `macro`, whose replacement list is `body`. -1 on allocation failure.
+int macro_define(struct MacroTable *macros, struct Macro macro, const struct PreprocessingToken *body);
+// false if `name` was not a macro
+bool macro_undef(struct MacroTable *macros, uint32_t name);
+
+// a token being expanded
+struct ExpansionToken {
+	struct PreprocessingToken token;
+	uint32_t hideset;
+};
+
+struct ExpansionTokens {
+	ptrdiff_t len, cap;
+	struct ExpansionToken *items;
+};
+
+#define EXPANSION_DEPTH (64)
+
+struct Indices {
+	ptrdiff_t len, cap;
+	uint32_t *items;
+};
+
+// the arguments of an invocation. an argument is macro-expanded on its own, one level
+// down, and only once the replacement list uses it other than with # or ##.
+struct ExpansionLevel {
+	struct ExpansionTokens args, expanded;
+	// argument `i` is `args` from `starts[i]` to `starts[i + 1]`,
+	// and `expanded` from `spans[2 * i]` to `spans[2 * i + 1]`, UINT32_MAX until it is expanded
+	struct Indices starts, spans;
+};
+
+// what expanding needs besides the macros, kept from one line to the next
+struct Expansion {
+	const struct PreprocessingToken *text; // of the file being expanded
+	struct Hidesets hidesets;
+	// replacement lists once their arguments are in, used like a stack
+	struct ExpansionTokens scratch;
+	struct ExpansionLevel levels[EXPANSION_DEPTH]; // by nesting of the invocations being read
+	ptrdiff_t depth;
+	// the token ranges being read, the last one first
+	struct Frame *frames;
+	ptrdiff_t len, cap;
+	uint8_t carry; // flags of a replacement list that was empty, for the token after it
+};
+
+int expansion_init(struct Expansion *ex);
+void expansion_fini(struct Expansion *ex);
+// macro-expands `tokens` from `start` to `end` into `pp->output`, with what
+// `pp->macros` has at that point. -1 on error, once it is reported.
+int macro_expand(struct Preprocessor *pp, const struct PreprocessingToken *tokens, ptrdiff_t start, ptrdiff_t end);
+
+#endif /* C_PP_MACRO_H */
@@ -0,0 +1,46 @@
+#ifndef C_PP_PCH_H
+#define C_PP_PCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+struct Preprocessor;
+
+#define PCH_MAGIC "uwupch\0\1"
+
+// a file that went into a precompiled header, which is stale once it changes
+struct PchDependency {
+	uint64_t size;
+	int64_t sec, nsec; // when it was last modified
+	uint64_t path, len; // its path, in the names
+	uint32_t guard; // as in `struct Header`, for an #include of it that comes after
+	uint32_t once;
+};
+
+// what a precompiled header starts with: where a translation unit was once it had read its file.
+// nothing in it is a pointer, so it is mapped and read as it is: each part is at an offset from the
+// start, 8-byte aligned. every token is PP_TOKEN_SPELLED, its spelling in `spellings`, which start
+// with the identifiers in the order of their ids: interned again in that order, they keep their ids.
+struct PchFile {
+	char magic[8];
+	uint32_t token_size, macro_size; // sizeof (struct PreprocessingToken) and sizeof (struct Macro)
+	uint64_t spellings, spelling_len; // C_STREAM_PADDING zero bytes after them
+	// identifier `i` is the spellings from `starts[i]` up to `starts[i + 1]`
+	uint64_t starts, string_len;
+	uint64_t macros, macro_len; // the bodies of their `struct Macro` are indices into `bodies`
+	uint64_t bodies, body_len;
+	uint64_t output, output_len;
+	uint64_t files, file_len; // `struct PchDependency`, the file that was translated first
+	uint64_t names, name_len;
+	uint64_t total; // the size of the file
+};
+
+// what `preprocess` left in `pp`, the macros, the identifiers and the output, into `name`,
+// with the files it read to know when it is stale. -1 on error, once it is reported.
+int preprocessor_write_pch(struct Preprocessor *pp, const char *name);
+// picks up where the translation unit that wrote `name` left off, as though its file had been
+// included before that of `pp`, which nothing has been done with since `preprocessor_init`.
+// -1 on error, once it is reported.
+int preprocessor_include_pch(struct Preprocessor *pp, const char *name);
+
+#endif /* C_PP_PCH_H */
@@ -1,15 +1,85 @@
 #ifndef C_PP_PPTOKEN_H
 #define C_PP_PPTOKEN_H
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "stream/stream.h"
+#include "pp/enums.h"
+#include "pp/common.h"
+#include "pp/pre.h"
+#include "pp/macro.h"
+#include "pp/include.h"
+#include "pp/eval.h"
+#include <intern/intern.h>
+#include <uwu/lines.h>
+
 struct Preprocessor {
-	char *buf;
-	char *cur;
+	const char *buf; // borrowed from the view of `stream` unless `owned`, padded like it
+	const char *cur;
 	long len;
-	// struct PreprocessingToken pptoken;
+	Stream stream;
+	bool owned;
+	struct EditMap edits; // from `buf` back to the view of `stream`
+	struct LineIndex lines; // of the view, built on the first call to `preprocessor_line`
+	struct Interns identifiers;
+	struct PreprocessingTokens tokens; // of `buf`, once `preprocessor_tokenize` has run
+	struct Headers headers;
+	struct MacroTable macros;
+	struct Expansion expansion;
+	struct IfExpressions ifs;
+	struct PreprocessingTokens output; // what `preprocess` made of `tokens`
+	ptrdiff_t prefix; // tokens at the start of `output` from a precompiled header, which `preprocess` keeps
+	struct PreprocessingTokens text; // being translated: the text up to a directive, then the directive
+	struct PreprocessingTokens directive; // the replacement list of the #define being read
+	struct { ptrdiff_t len, cap; struct Conditional *items; } conditionals; // the #if being read, innermost last
+	// the text of the tokens made by # and ##, with the padding of `buf` after `len`
+	struct { ptrdiff_t len, cap; char *items; } spellings;
+	bool expanded; // `output` is to be written instead of `buf`
 };
 
 int preprocessor_init(struct Preprocessor *pp, const char *name);
 int preprocessor_fini(struct Preprocessor *pp, const char *name);
+// what `preprocess` made, as text: a line per line the tokens started in and a space where
+// there was any. its length goes into `*len`, and it is NUL-terminated and padded like a stream view.
+// NULL if it could not be allocated, once it is reported.
+char *preprocessor_text(const struct Preprocessor *pp, ptrdiff_t *len);
+// the line in the file of offset `offset` of `pp->buf`, and its column into `*column`,
+// as they were before phases 1 to 3. 0 if the lines could not be indexed.
+long preprocessor_line(struct Preprocessor *pp, long offset, long *column);
+// prints `file:line:column: ` for a diagnostic about `token`, only the translated `file: ` if # or ## made it
+void preprocessor_where(struct Preprocessor *pp, const struct PreprocessingToken *token);
+// phase 3 proper: `pp->buf` into `pp->tokens`. a header name is only recognised
+// after `#include`, anything that is no other token is a token of its own.
+// -1 on allocation failure.
+int preprocessor_tokenize(struct Preprocessor *pp);
+// as `preprocessor_tokenize`, for `buf` of `len` bytes whose tokens say they are from `file`
+int preprocessor_decompose(struct Preprocessor *pp, const char *buf, long len, uint16_t file,
+		struct PreprocessingTokens *tokens);
+// as `preprocessor_decompose`, from `p` on and after what `tokens` has, up to where the first line that
+// is a directive ends. `*hash` is the index of its '#', -1 if `end` came first.
+// where it stopped, NULL on allocation failure.
+const char *preprocessor_decompose_text(struct Preprocessor *pp, const char *buf, const char *p, const char *end,
+		uint16_t file, struct PreprocessingTokens *tokens, ptrdiff_t *hash);
+// the '#' of the #elif, #else or #endif that ends the group that `p`, at the start of a line, is in,
+// `end` if there is none. what is in between is not decomposed, nested groups are skipped whole.
+const char *preprocessor_skip_group(const char *p, const char *end);
+// maps `name` and puts it through phases 1 to 3: into `*buf`, a rewritten copy if `*owned`,
+// with `edits` back to the file. -1 on error, once it is reported.
+int preprocessor_map(const char *name, Stream *stream, const char **buf, long *len, bool *owned,
+		struct EditMap *edits);
+// the same for `view`, `size` bytes of a file already mapped
+int preprocessor_phases(const char *view, ptrdiff_t size, const char **buf, long *len, bool *owned,
+		struct EditMap *edits);
+// the token at `p` up to `end` into `*token`, but for its offset and flags, which `p` must not be
+// whitespace for. returns where the token ends, NULL on allocation failure.
+const char *preprocessor_token(struct Preprocessor *pp, const char *p, const char *end,
+		bool header_name, struct PreprocessingToken *token);
+// the text of `token`, from `pp->buf` or `pp->spellings`
+static inline const char *preprocessor_spelling(const struct Preprocessor *pp, const struct PreprocessingToken *token) {
+	if (token->flags & PP_TOKEN_SPELLED) return pp->spellings.items + token->offset;
+	return (token->file ? pp->headers.items[token->file - 1].buf: pp->buf) + token->offset;
+}
 
 #endif /* C_PP_PPTOKEN_H */
-
@@ -3,7 +3,42 @@
 
 #include "stream/stream.h"
 
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// where the output of phases 1 to 3 comes from in the file. the offsets of the output
+// from `out[i]` up to `out[i + 1]` are `delta[i]` bytes short of those of the input,
+// so a run of untouched bytes takes a single entry however long it is.
+// before `out[0]` nothing has moved yet.
+struct EditMap {
+	ptrdiff_t len, cap;
+	uint32_t *out;   // sorted
+	uint32_t *delta; // never decreasing, the output only shrinks
+};
+
+int edit_map_init(struct EditMap *map);
+void edit_map_fini(struct EditMap *map);
+// the offset in the file of offset `out` of the output, a binary search over the edits.
+// a character made of several bytes, like a trigraph, maps to its first one.
+long edit_map_find(const struct EditMap *map, long out);
+
 char *preprocessor_internalize(char *buf, long *len);
+// true if `preprocessor_internalize` would leave `buf` unchanged
+bool is_internalized(const char *buf, long len);
+
+// false if phases 1 and 2 have nothing to do, `buf[len]` must be readable
+bool has_trigraphs_or_splices(const char *buf, long len);
+
+// phases 1 to 3 in a single pass, same as the 3 functions below one after the other
+char *internalize(char *buf, long *len);
+// the same, recording into `map` where the output comes from. the file must be under 4 GiB.
+char *internalize_mapped(char *buf, long *len, struct EditMap *map);
+// the same on a part of a file, in place: `buf` ends at its first '\0', and unless `last`
+// the file goes on after it. then only what cannot depend on the rest is done, up to
+// a newline outside of comments, literals and splices: `*used` is how much of `buf` it
+// takes, 0 if there is no such newline. returns the length of the output, -1 on error.
+long internalize_part(char *buf, bool last, long *used);
 
 char *expand_trigraphs(char *buf, long *len);
 char *discard_bsnl(char *buf, long *len);
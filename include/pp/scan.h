@@ -0,0 +1,21 @@
+#ifndef C_PP_SCAN_H
+#define C_PP_SCAN_H
+
+// the passes of phases 1 to 3 only care about a few bytes, everything
+// in between is copied as is. these find the next byte that matters.
+
+// first byte of [p, end) that is one of `a`, `b`, `c` or `d`, `end` if there is none.
+// to look for fewer bytes, repeat one of them.
+const char *scan_bytes(const char *p, const char *end, char a, char b, char c, char d);
+
+// `scan_bytes` picks the best of these for the running CPU on its first call.
+// they all give the same result.
+typedef const char *(*byte_scanner)(const char *p, const char *end, char a, char b, char c, char d);
+byte_scanner resolve_byte_scanner(void);
+const char *scan_bytes_scalar(const char *p, const char *end, char a, char b, char c, char d);
+#if defined(__x86_64__)
+const char *scan_bytes_sse2(const char *p, const char *end, char a, char b, char c, char d);
+const char *scan_bytes_avx2(const char *p, const char *end, char a, char b, char c, char d);
+#endif
+
+#endif /* C_PP_SCAN_H */
@@ -2,6 +2,7 @@
 #define C_PP_TESTS_H
 
 int pp_test(void);
+int pp_bench(void);
 
 #endif /* C_PP_TESTS_H */
 
@@ -13,6 +13,11 @@ Stream __uwunull(void);
 #define C_STREAM_TEXT (1<<2)
 #define C_STREAM_BINARY (1<<3)
 #define C_STREAM_UTF_8 (1<<4)
+// the whole file is mapped read-only, see `stream_view`
+#define C_STREAM_MMAP (1<<5)
+
+// number of zero bytes guaranteed to follow a view
+#define C_STREAM_PADDING (64)
 
 #define uwuin  __uwuin ()
 #define uwuout __uwuout()
@@ -20,6 +25,7 @@ Stream __uwunull(void);
 #define uwunull __uwunull()
 
 #include <stddef.h>
+#include <stdint.h>
 
 Stream stream_init(const char *title, int mode);
 void stream_fini(Stream stream);
@@ -30,6 +36,9 @@ const char *stream_extension(Stream stream, ptrdiff_t *len);
 ptrdiff_t stream_size(Stream stream);
 
 ptrdiff_t stream_read(Stream stream, void *buf, ptrdiff_t size);
+// borrowed view of the whole contents of a C_STREAM_MMAP stream, valid until `stream_fini`.
+// NULL if the contents could not be mapped or read, or are not valid UTF-8.
+const uint8_t *stream_view(Stream stream, ptrdiff_t *len);
 ptrdiff_t stream_write(Stream stream, const void *buf, ptrdiff_t size);
 ptrdiff_t stream_encode(Stream stream, void *dst, const void *src, ptrdiff_t num);
 ptrdiff_t stream_encode_len(Stream stream, const void *src, void **endptr);
@@ -2,6 +2,6 @@
 #define C_STREAM_TESTS_H
 
 int stream_test(void);
+int stream_bench(void);
 
 #endif /* C_STREAM_TESTS_H */
-
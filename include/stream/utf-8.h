@@ -8,6 +8,17 @@
 bool is_valid_character_utf_8(const uint8_t *strm, long len, uint8_t **endptr);
 bool is_valid_buffer_utf_8(const uint8_t *strm, long len);
 
+// `is_valid_buffer_utf_8` picks the best of these for the running CPU on its first call.
+// they all give the same result.
+typedef bool (*utf_8_validator)(const uint8_t *strm, long len);
+utf_8_validator resolve_utf_8_validator(void);
+bool is_valid_buffer_utf_8_scalar(const uint8_t *strm, long len);
+#if defined(__x86_64__)
+bool is_valid_buffer_utf_8_sse2(const uint8_t *strm, long len);
+bool is_valid_buffer_utf_8_avx2(const uint8_t *strm, long len);
+bool is_valid_buffer_utf_8_avx512(const uint8_t *strm, long len);
+#endif
+
 // only safe to use if strm has been checked by the functions above
 uint32_t codepoint_utf_8(const uint8_t *strm, uint8_t **endptr);
 
@@ -1,7 +1,14 @@
 #ifndef C_TESTS_H
 #define C_TESTS_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 void run_tests(int argc, char **argv);
 
-#endif /* C_TESTS_H */
+// whether this processor has the extension `cpu` names, as __builtin_cpu_supports does; true for NULL
+bool test_cpu_supports(const char *cpu);
+// the next number of the xorshift sequence in `*state`, which must not be 0
+uint32_t test_random(uint32_t *state);
 
+#endif /* C_TESTS_H */
@@ -0,0 +1,32 @@
+#ifndef C_UWU_FLOAT_H
+#define C_UWU_FLOAT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <common/enums.h>
+
+// a decimal or hexadecimal floating constant, as read from the source
+// but not yet converted, since its type is only known after its suffix.
+struct FloatDigits {
+	int base; // 10 or 16
+	// the leading significant digits and what they get scaled by:
+	// value ~= w * 10^exp in decimal, w * 2^exp in hexadecimal.
+	// decimal keeps 19 digits in `w`, hexadecimal 32 in `w` and `w_lo`.
+	uint64_t w, w_lo;
+	long exp;
+	bool truncated; // a nonzero digit did not fit, the value is a bit more
+	// the digits and the '.', for when the fast paths cannot decide
+	const uint8_t *digits, *digits_end;
+	long exp10; // the exponent as written, decimal only
+};
+
+// reads the digits, '.' and exponent of a floating constant at `f`, after the 0x for hexadecimal.
+// returns the end of the constant, or `f` if there is none.
+// digits are read 8 at a time, so up to 8 bytes past the constant must be readable.
+const uint8_t *read_floating(const uint8_t *f, int base, struct FloatDigits *digits);
+// the value correctly rounded to the type given by `suffix`: float for F, long double for L,
+// double otherwise. sets `*overflow` if the value is too large for that type.
+long double floating_value(const struct FloatDigits *digits, enum ConstantAffix suffix, bool *overflow);
+
+#endif /* C_UWU_FLOAT_H */
@@ -5,16 +5,17 @@
 #include <stdint.h>
 
 #include "uwu/enums.h"
+#include "uwu/lines.h"
 #include <common/enums.h>
 #include <intern/intern.h>
+#include <common/arena.h>
 #include <ast/common.h>
+#include <stream/stream.h>
 
 struct Token {
 	enum TokenKind kind;
-#ifndef NDEBUG
-	const uint8_t *start;
-	ptrdiff_t len;
-#endif
+	// where the token is in the file, `lexer_line` turns it into a line and column
+	uint32_t offset, len;
 	__extension__ union {
 		struct IntegerConstant integer;
 		struct FloatingConstant floating;
@@ -27,17 +28,60 @@ struct Token {
 };
 
 struct Lexer {
-	uint8_t *buf;
+	const uint8_t *buf; // borrowed from `stream`, or from the caller without one
+	Stream stream;
+	const char *name; // what its diagnostics start with: the file, or NULL over a buffer unless set
 	const uint8_t *cur;
-	long len, line;
+	long len;
+	uint32_t base; // the offset of `buf` in the file, which only moves with `lexer_feed`
+	struct LineIndex lines;
 	struct Token token;
 	struct Interns identifiers;
+	// string literal sequences, valid until `lexer_fini`
+	struct Arena literals;
+};
+
+// all the tokens of a file, as parallel arrays.
+// `payloads[i]` indexes the side table that goes with `kinds[i]`,
+// or is the id of an identifier in the lexer's `identifiers`.
+// it is 0 for keywords and punctuators.
+struct TokenBuffer {
+	ptrdiff_t len, cap;
+	uint8_t *kinds; // enum TokenKind
+	uint32_t *offsets; // as in `Token.offset`
+	uint32_t *payloads;
+	struct { ptrdiff_t len, cap; struct IntegerConstant *items; } integers;
+	struct { ptrdiff_t len, cap; struct FloatingConstant *items; } floatings;
+	struct { ptrdiff_t len, cap; struct CharacterConstant *items; } characters;
+	struct { ptrdiff_t len, cap; struct StringLiteral *items; } literals; // in the lexer's arena
 };
 
 int lexer_init(struct Lexer *lexer, const char *name);
+// a lexer over `buf` rather than a file. the caller keeps `buf` alive,
+// NUL-terminated and padded like a stream view.
+int lexer_init_buffer(struct Lexer *lexer, const uint8_t *buf, long len);
+// moves on to the next part of the same file, keeping the offsets, lines and identifiers.
+// tokens cannot straddle parts. -1 if the file gets too big for 32-bit offsets.
+int lexer_feed(struct Lexer *lexer, const uint8_t *buf, long len);
 void lexer_fini(struct Lexer *lexer);
 enum LexerStatus lexer_next(struct Lexer *lexer);
+// lexes what is left of the file into `tokens`, which must be zeroed or
+// already filled by the same lexer. -1 on allocation failure or decode error.
+int lexer_tokenize_all(struct Lexer *lexer, struct TokenBuffer *tokens);
+void token_buffer_fini(struct TokenBuffer *tokens);
+// rebuilds the `i`th token the way `lexer_next` would have given it
+void token_at(const struct TokenBuffer *tokens, const struct Lexer *lexer, ptrdiff_t i, struct Token *token);
 void lexer_dump(const struct Lexer *lexer);
+// the line of `offset` and its column into `*column`, `offset` must be in a part the lexer was given
+long lexer_line(const struct Lexer *lexer, uint32_t offset, long *column);
+// the digits at `i` in `base` (8, 10 or 16), up to the first byte that is not one.
+// 0 and `*endptr` = `i` if they overflow or are followed by a digit too large for the base.
+uintmax_t read_integer(const uint8_t *i, int base, uint8_t **endptr);
+// the value of the character constant at `ch`, which starts with its quote.
+// 0 and `*endptr` = `ch` if it is not terminated on its line or has an invalid escape.
+uint32_t read_character(const uint8_t *ch, bool is_wide, uint8_t **endptr);
+// TOKEN_NONE if `str` is not a keyword
+enum TokenKind keyword_id(const uint8_t *str, ptrdiff_t len);
 
 int print_token(const struct Token *token);
 
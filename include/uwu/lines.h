@@ -0,0 +1,23 @@
+#ifndef C_UWU_LINES_H
+#define C_UWU_LINES_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// where the lines of a file start, found a vector at a time when the file is read.
+// the lexer keeps no line count, a position is only worked out when a diagnostic needs one.
+struct LineIndex {
+	ptrdiff_t len, cap;
+	uint32_t *starts; // offsets of the first byte of each line, sorted, `starts[0]` is 0
+};
+
+int line_index_init(struct LineIndex *lines);
+void line_index_fini(struct LineIndex *lines);
+// adds the lines that start in `buf`, the `len` bytes of the file from offset `base` on.
+// `buf` is padded like a stream view.
+int line_index_add(struct LineIndex *lines, const uint8_t *buf, long len, uint32_t base);
+// the line of `offset` and its column into `*column`, both from 1 and the column in bytes.
+// a binary search, `offset` must be in a part of the file that was added.
+long line_index_find(const struct LineIndex *lines, uint32_t offset, long *column);
+
+#endif /* C_UWU_LINES_H */
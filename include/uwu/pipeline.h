@@ -0,0 +1,62 @@
+#ifndef C_UWU_PIPELINE_H
+#define C_UWU_PIPELINE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <uwu/lex.h>
+#include <stream/stream.h>
+
+// phases 1 to 3 on a second thread, lexing on the calling one. that is all it runs: directives
+// are left as they are and macros are not expanded, so it only feeds the lexer a file that needs
+// no more preprocessing than that. `preprocess` does the rest, on the whole file.
+// the file is cut into chunks at newlines no token crosses, which go from one
+// thread to the other through a ring of `PIPELINE_SLOTS`. when the ring is full
+// the preprocessor waits for the lexer, so memory stays bounded whatever the size of the file.
+
+#define PIPELINE_SLOTS (8)
+#define PIPELINE_CHUNK (64 * 1024)
+
+struct PipelineChunk {
+	uint8_t *buf; // in `slots`, NUL-terminated and padded like a stream view
+	long len;
+	bool last; // nothing follows, or an error stopped the preprocessor
+	bool error;
+};
+
+struct Pipeline {
+	struct Lexer lexer;
+	Stream source;
+	const char *view; // of `source`, read by the preprocessor only
+	long len, chunk_size;
+	struct PipelineChunk chunks[PIPELINE_SLOTS];
+	// a buffer of `slot_cap` bytes for each chunk, one after the other. it only grows
+	// for a line longer than a chunk, and only once the lexer has given every slot back.
+	uint8_t *slots;
+	long slot_cap;
+	// chunks in [head, tail) are ready for the lexer, the others belong to the preprocessor.
+	// only the lexer writes `head` and only the preprocessor writes `tail`.
+	__attribute__((aligned(64))) uint32_t head;
+	__attribute__((aligned(64))) uint32_t tail;
+	// the slow path, for when one side has to wait for the other
+	__attribute__((aligned(64))) int sleepers;
+	bool cancel; // the lexer stopped early
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	pthread_t thread;
+	bool started;
+	bool fed; // the lexer is on chunks[head]
+	enum LexerStatus end; // once the last chunk is done
+};
+
+// starts preprocessing `name` in the background, `chunk_size` bytes at a time or
+// `PIPELINE_CHUNK` if 0. a chunk only grows past that when no newline can end it.
+int pipeline_init(struct Pipeline *pl, const char *name, long chunk_size);
+// the next token into `pl->lexer.token`, as `lexer_next` does for a file.
+// LEXER_DECODE_ERROR also covers errors of the preprocessor.
+enum LexerStatus pipeline_next(struct Pipeline *pl);
+// stops the preprocessor if it is still running
+void pipeline_fini(struct Pipeline *pl);
+
+#endif /* C_UWU_PIPELINE_H */
@@ -0,0 +1,137 @@
+#ifndef C_UWU_SCAN_H
+#define C_UWU_SCAN_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <common/charclass.h>
+
+// runs of identifier characters and of whitespace, and the newlines of a whole buffer,
+// a word or a vector at a time.
+// every run ends at the latest on the NUL after the buffer, but the scanners
+// may read up to 32 bytes past where the run ends: `C_STREAM_PADDING` covers it.
+
+typedef const uint8_t *(*ident_scanner)(const uint8_t *p);
+typedef const uint8_t *(*space_scanner)(const uint8_t *p);
+// the offsets just past each '\n' in the `len` bytes at `p`, plus `base`, into `out` unless
+// it is NULL. returns how many there are. reads up to 32 bytes past `p + len`.
+typedef long (*newline_scanner)(const uint8_t *p, long len, uint32_t base, uint32_t *out);
+
+// these pick the best of the ones below for the running CPU on their first call.
+// they all give the same result.
+const uint8_t *skip_ident_run(const uint8_t *p);
+const uint8_t *skip_space_run(const uint8_t *p);
+long find_newlines(const uint8_t *p, long len, uint32_t base, uint32_t *out);
+
+ident_scanner resolve_ident_scanner(void);
+space_scanner resolve_space_scanner(void);
+newline_scanner resolve_newline_scanner(void);
+const uint8_t *skip_ident_swar(const uint8_t *p);
+const uint8_t *skip_space_swar(const uint8_t *p);
+long find_newlines_swar(const uint8_t *p, long len, uint32_t base, uint32_t *out);
+#if defined(__x86_64__)
+const uint8_t *skip_ident_sse2(const uint8_t *p);
+const uint8_t *skip_space_sse2(const uint8_t *p);
+long find_newlines_sse2(const uint8_t *p, long len, uint32_t base, uint32_t *out);
+const uint8_t *skip_ident_avx2(const uint8_t *p);
+const uint8_t *skip_space_avx2(const uint8_t *p);
+long find_newlines_avx2(const uint8_t *p, long len, uint32_t base, uint32_t *out);
+#endif
+
+#define SWAR_ONES  (UINT64_C(0x0101010101010101))
+#define SWAR_HIGHS (SWAR_ONES * 0x80)
+
+// 0x80 in every byte of `x` that is strictly between `lo` and `hi`, for lo < hi <= 0x80.
+// nothing carries from a byte to the next, so each byte gets an exact answer.
+static inline uint64_t swar_between(uint64_t x, uint8_t lo, uint8_t hi) {
+	uint64_t low7 = x & (SWAR_ONES * 0x7F);
+	return (SWAR_ONES * (127 + hi) - low7) & ~x & (low7 + SWAR_ONES * (127 - lo)) & SWAR_HIGHS;
+}
+
+static inline uint64_t swar_load(const uint8_t *p) {
+	uint64_t x;
+	memcpy(&x, p, sizeof (x));
+	return x;
+}
+
+// 0x80 in the bytes that are [A-Za-z0-9_], on a little-endian load
+static inline uint64_t swar_ident(uint64_t x) {
+	return swar_between(x, '0' - 1, '9' + 1) | swar_between(x, '_' - 1, '_' + 1)
+		| swar_between(x | (SWAR_ONES * 0x20), 'a' - 1, 'z' + 1);
+}
+
+// 0x80 in the bytes that are whitespace, newline included
+static inline uint64_t swar_space(uint64_t x) {
+	return swar_between(x, '\t' - 1, '\r' + 1) | swar_between(x, ' ' - 1, ' ' + 1);
+}
+
+// most identifiers and whitespace runs fit in a word,
+// only the longer ones pay for a call to the vector scanners
+
+static inline const uint8_t *skip_ident(const uint8_t *p) {
+	uint64_t out = ~swar_ident(swar_load(p)) & SWAR_HIGHS;
+	if (out) return p + __builtin_ctzll(out) / 8;
+	return skip_ident_run(p + 8);
+}
+
+// `*p` must be whitespace
+static inline const uint8_t *skip_space(const uint8_t *p) {
+	// a lone space between two tokens is by far the most common run
+	if (!char_is(p[1], CHAR_SPACE)) return p + 1;
+	uint64_t out = ~swar_space(swar_load(p)) & SWAR_HIGHS;
+	if (!out) return skip_space_run(p + 8);
+	return p + __builtin_ctzll(out) / 8;
+}
+
+// digits of integer and floating constants, 8 at a time.
+// the first digit is the most significant, which is the lowest byte of a little-endian load.
+
+// how many of the bytes of `x` are digits in `base` (8, 10 or 16) before one that is not
+static inline int swar_digit_count(uint64_t x, int base) {
+	uint64_t in;
+	if (base == 10) {
+		in = swar_between(x, '0' - 1, '9' + 1);
+	} else if (base == 16) {
+		in = swar_between(x, '0' - 1, '9' + 1) | swar_between(x | (SWAR_ONES * 0x20), 'a' - 1, 'f' + 1);
+	} else {
+		in = swar_between(x, '0' - 1, '7' + 1);
+	}
+	uint64_t out = ~in & SWAR_HIGHS;
+	return out ? __builtin_ctzll(out) / 8: 8;
+}
+
+// the value of the first `n` digits of `x` in `base`, for n in [1, 8] as counted above
+static inline uint32_t swar_digit_value(uint64_t x, int base, int n) {
+	if (base == 10) {
+		x &= SWAR_ONES * 0x0F;
+	} else if (base == 16) {
+		// letters have 0x40 set and 1 to 6 in the low nibble
+		x = (x & (SWAR_ONES * 0x0F)) + ((x >> 6) & SWAR_ONES) * 9;
+	} else {
+		x &= SWAR_ONES * 0x07;
+	}
+	// whatever follows the digits is pushed out, and leading zeros come in
+	x <<= 8 * (8 - n);
+	if (base == 10) {
+		// pairs, then quadruples, then the 8 digits
+		x = (x * (10 * 256 + 1)) >> 8;
+		x = ((x & UINT64_C(0x00FF00FF00FF00FF)) * (100 * 65536 + 1)) >> 16;
+		return (uint32_t) (((x & UINT64_C(0x0000FFFF0000FFFF)) * (10000 * (UINT64_C(1) << 32) + 1)) >> 32);
+	}
+	int bits = base == 16 ? 4: 3;
+	x = ((x << bits) | (x >> 8)) & UINT64_C(0x00FF00FF00FF00FF);
+	x = ((x << 2 * bits) | (x >> 16)) & UINT64_C(0x0000FFFF0000FFFF);
+	x = ((x << 4 * bits) | (x >> 32)) & UINT64_C(0xFFFFFFFF);
+	return (uint32_t) x;
+}
+
+static inline const uint8_t *skip_digits(const uint8_t *p, int base) {
+	int n;
+	do {
+		n = swar_digit_count(swar_load(p), base);
+		p += n;
+	} while (n == 8);
+	return p;
+}
+
+#endif /* C_UWU_SCAN_H */
@@ -2,6 +2,6 @@
 #define C_UWU_TESTS_H
 
 int lex_test(void);
+int lex_bench(void);
 
 #endif /* C_UWU_TESTS_H */
-
@@ -1,14 +1,20 @@
 #include <ast/memory.h>
+#include <common/arena.h>
 
 #include <stddef.h>
 #include <setjmp.h>
 #include <stdlib.h>
 
-static jmp_buf *_env = NULL;
-static ptrdiff_t amount = 0;
+#define AST_CHUNK (256 * 1024)
+#define AST_MAX_ALIGN (16)
+
+// each thread builds the trees of its own translation units
+static __thread jmp_buf *_env = NULL;
+static __thread struct Arena arena;
 
 int ast_init(jmp_buf *env) {
 	if (_env) return -1;
+	if (arena_init(&arena, AST_CHUNK)) return -1;
 	_env = env;
 	return 0;
 }
@@ -16,16 +22,19 @@ int ast_init(jmp_buf *env) {
 int ast_fini(ptrdiff_t *amt) {
 	if (!_env) return -1;
 	_env = NULL;
-	if (amt) *amt = amount;
-	amount = 0;
+	if (amt) *amt = arena.used;
+	// the whole tree goes at once
+	arena_fini(&arena);
 	return 0;
 }
 
 void *ast_alloc(ptrdiff_t size) {
 	if (size < 1) longjmp(*_env, -1);
-	void *alloc = malloc(size);
+	// the size of an object is a multiple of its alignment,
+	// so its lowest set bit is always enough
+	ptrdiff_t align = size & -size;
+	if (align > AST_MAX_ALIGN) align = AST_MAX_ALIGN;
+	void *alloc = arena_alloc(&arena, size, align);
 	if (!alloc) longjmp(*_env, -1);
-	amount += size;
 	return alloc;
 }
-
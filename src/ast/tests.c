@@ -1,9 +1,30 @@
 #include <ast/ast.h>
+#include <ast/memory.h>
 
 #include <stdio.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <assert.h>
 
 int ast_test(void) {
 	printf("ast:\n");
+	jmp_buf env;
+	if (setjmp(env)) {
+		fprintf(stderr, "allocation failed while building the tree.\n");
+		return -1;
+	}
+	if (ast_init(&env)) return -1;
+	struct Expression *sum = NULL;
+	for (int i = 0; i < 10000; i++) {
+		struct Expression *lit = i % 2
+			? expr_floating((struct FloatingConstant) { .value = i })
+			: expr_integer((struct IntegerConstant) { .value = i });
+		assert((uintptr_t) lit % __alignof__ (struct Expression) == 0);
+		sum = sum ? expr_binary(sum, lit, OPERATOR_ADD): lit;
+	}
+	assert(sum->kind == EXPRESSION_BINARY && sum->binary.rhs->kind == EXPRESSION_FLOATING);
+	ptrdiff_t amt;
+	if (ast_fini(&amt)) return -1;
+	printf("%td bytes of nodes\n", amt);
 	return 0;
 }
-
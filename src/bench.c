@@ -0,0 +1,27 @@
+#include <bench.h>
+#include <stream/tests.h>
+#include <pp/tests.h>
+#include <intern/tests.h>
+#include <uwu/tests.h>
+
+#include <stdio.h>
+#include <time.h>
+
+double bench_now(void) {
+	return (double) clock() / CLOCKS_PER_SEC;
+}
+
+void run_benches(int argc, char **argv) {
+	(void) argc, (void) argv;
+	int (*benches[]) (void) = {
+		&stream_bench,
+		&pp_bench,
+		&intern_bench,
+		&lex_bench,
+	}, (**end) (void) = benches + sizeof (benches) / sizeof (*benches);
+	for (int (**bench) (void) = benches; bench != end; bench++) {
+		int err = (*bench)();
+		printf("[exit status = %d]\n", err);
+		printf("\n\n");
+	}
+}
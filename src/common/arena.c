@@ -0,0 +1,67 @@
+#include <common/arena.h>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct ArenaChunk {
+	struct ArenaChunk *prev;
+	__extension__ union {
+		long double ld;
+		long long ll;
+		void *ptr;
+		uint8_t data[0];
+	};
+};
+
+int arena_init(struct Arena *arena, ptrdiff_t chunk_size) {
+	if (!arena || chunk_size < 1) return -1;
+	arena->chunks = NULL;
+	arena->cur = arena->end = NULL;
+	arena->chunk_size = chunk_size;
+	arena->allocs = arena->used = 0;
+	return 0;
+}
+
+void arena_fini(struct Arena *arena) {
+	if (!arena) return;
+	for (struct ArenaChunk *chunk = arena->chunks, *prev; chunk; chunk = prev) {
+		prev = chunk->prev;
+		free(chunk);
+	}
+	arena->chunks = NULL;
+	arena->cur = arena->end = NULL;
+}
+
+void *arena_alloc(struct Arena *arena, ptrdiff_t size, ptrdiff_t align) {
+	if (size < 0 || align < 1 || (align & (align - 1))) return NULL;
+	uintptr_t p = ((uintptr_t) arena->cur + align - 1) & ~(uintptr_t) (align - 1);
+	if (!arena->cur || size > (intptr_t) ((uintptr_t) arena->end - p)) {
+		if (size + align > arena->chunk_size / 4) {
+			// big requests get a chunk of their own, which leaves the current one open
+			struct ArenaChunk *chunk = malloc(offsetof(struct ArenaChunk, data) + size + align);
+			if (!chunk) return NULL;
+			arena->allocs++;
+			if (arena->chunks) {
+				chunk->prev = arena->chunks->prev;
+				arena->chunks->prev = chunk;
+			} else {
+				chunk->prev = NULL;
+				arena->chunks = chunk;
+			}
+			arena->used += size;
+			return (void *) (((uintptr_t) chunk->data + align - 1) & ~(uintptr_t) (align - 1));
+		}
+		struct ArenaChunk *chunk = malloc(offsetof(struct ArenaChunk, data) + arena->chunk_size);
+		if (!chunk) return NULL;
+		arena->allocs++;
+		chunk->prev = arena->chunks;
+		arena->chunks = chunk;
+		arena->cur = chunk->data;
+		arena->end = chunk->data + arena->chunk_size;
+		p = ((uintptr_t) arena->cur + align - 1) & ~(uintptr_t) (align - 1);
+	}
+	arena->cur = (uint8_t *) p + size;
+	arena->used += size;
+	return (void *) p;
+}
@@ -92,6 +92,8 @@ const char *token2str[TOKEN_END] = {
 	[TOKEN_CIRCUMFLEX_ASSIGN      ] = "p:^=",
 	[TOKEN_BAR_ASSIGN             ] = "p:|=",
 	[TOKEN_COMMA                  ] = "p:,",
+	[TOKEN_HASH                   ] = "p:#",
+	[TOKEN_HASH_HASH              ] = "p:##",
 };
 
 const char *affix2str[CONSTANT_AFFIX_END] = {
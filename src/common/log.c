@@ -11,6 +11,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <math.h>
+#include <stdio.h>
 
 #define MIN(a, b) ((a) < (b) ? (a): (b))
 #define MAX(a, b) ((a) > (b) ? (a): (b))
@@ -64,6 +65,21 @@ struct uwuprintfInfo {
 	} base: 5;
 };
 
+// each thread of a build has its own, so that what one unit says is not mixed with another
+static __thread FILE *diagnostics;
+
+int diagnose(const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	int prn = vfprintf(diagnostics ? diagnostics: stdout, fmt, args);
+	va_end(args);
+	return prn;
+}
+
+void log_diagnostics(FILE *file) {
+	diagnostics = file;
+}
+
 long uwuprintf(const char *fmt, ...) {
 	va_list args;
 	va_start(args, fmt);
@@ -0,0 +1,85 @@
+#include <common/pool.h>
+
+#include <stdbool.h>
+#include <pthread.h>
+
+struct Pool {
+	struct PoolQueue *queues;
+	int threads;
+	pool_job job;
+	void *arg;
+};
+
+struct PoolWorker {
+	struct Pool *pool;
+	int self;
+};
+
+#define RANGE(lo, hi) ((uint64_t) (hi) << 32 | (uint32_t) (lo))
+#define LO(range) ((uint32_t) (range))
+#define HI(range) ((uint32_t) ((range) >> 32))
+
+// the next job of `q`, -1 if it has none. a job leaves its queue once,
+// so a range that is seen again cannot be one that was taken from since
+static long take(struct PoolQueue *q) {
+	uint64_t range = __atomic_load_n(&q->range, __ATOMIC_ACQUIRE);
+	while (LO(range) < HI(range)) {
+		if (__atomic_compare_exchange_n(&q->range, &range, RANGE(LO(range) + 1, HI(range)),
+				false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			return LO(range);
+		}
+	}
+	return -1;
+}
+
+// the top half of what another queue has left into queue `self`, which is empty.
+// false once every queue is.
+static bool steal(struct Pool *pool, int self) {
+	for (int k = 1; k < pool->threads; k++) {
+		struct PoolQueue *victim = &pool->queues[(self + k) % pool->threads];
+		uint64_t range = __atomic_load_n(&victim->range, __ATOMIC_ACQUIRE);
+		while (LO(range) < HI(range)) {
+			uint32_t half = (HI(range) - LO(range) + 1) / 2, mid = HI(range) - half;
+			if (!__atomic_compare_exchange_n(&victim->range, &range, RANGE(LO(range), mid),
+					false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				continue;
+			}
+			// no other thread writes to an empty queue
+			__atomic_store_n(&pool->queues[self].range, RANGE(mid, mid + half), __ATOMIC_RELEASE);
+			return true;
+		}
+	}
+	return false;
+}
+
+static void *work(void *arg) {
+	struct PoolWorker *w = arg;
+	struct Pool *pool = w->pool;
+	do {
+		for (long i; (i = take(&pool->queues[w->self])) >= 0;) pool->job(pool->arg, i);
+	} while (steal(pool, w->self));
+	return NULL;
+}
+
+int pool_run(ptrdiff_t count, int threads, pool_job job, void *arg) {
+	if (threads > count) threads = count;
+	if (threads > POOL_MAX_THREADS) threads = POOL_MAX_THREADS;
+	if (threads < 1) threads = 1;
+	struct PoolQueue queues[POOL_MAX_THREADS];
+	struct PoolWorker workers[POOL_MAX_THREADS];
+	pthread_t ids[POOL_MAX_THREADS];
+	struct Pool pool = { .queues = queues, .threads = threads, .job = job, .arg = arg };
+	// the same share for each to start with
+	for (int t = 0; t < threads; t++) {
+		queues[t].range = RANGE(count * t / threads, count * (t + 1) / threads);
+		workers[t] = (struct PoolWorker) { .pool = &pool, .self = t };
+	}
+	int started = 1;
+	for (; started < threads; started++) {
+		if (pthread_create(&ids[started], NULL, &work, &workers[started])) break;
+	}
+	// a thread that did not start leaves its jobs to be stolen
+	work(&workers[0]);
+	for (int t = 1; t < started; t++) pthread_join(ids[t], NULL);
+	return threads > 1 && started == 1 ? -1: 0;
+}
@@ -1,11 +1,44 @@
 #include <common/tests.h>
 #include <common/log.h>
+#include <common/pool.h>
 
 #include <stdio.h>
+#include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
+#define POOL_JOBS (10000)
+
+// every job once, some far longer than the others so that there is something to steal
+static void count_job(void *arg, ptrdiff_t i) {
+	uint32_t *ran = arg;
+	volatile long sink = 0;
+	for (long k = 0; k < (i % 97 == 0 ? 100000: 10); k++) sink += k;
+	__atomic_add_fetch(&ran[i], 1, __ATOMIC_RELAXED);
+}
+
+static void pool_test(void) {
+	static uint32_t ran[POOL_JOBS];
+	const int threads[] = { 1, 3, 8, POOL_MAX_THREADS + 1 };
+	for (size_t t = 0; t < sizeof (threads) / sizeof (*threads); t++) {
+		memset(ran, 0, sizeof (ran));
+		int err = pool_run(POOL_JOBS, threads[t], &count_job, ran);
+		assert(!err);
+		(void) err;
+		for (long i = 0; i < POOL_JOBS; i++) assert(ran[i] == 1);
+	}
+	memset(ran, 0, sizeof (ran));
+	int err = pool_run(2, 8, &count_job, ran);
+	assert(!err && ran[0] == 1 && ran[1] == 1 && ran[2] == 0);
+	err = pool_run(0, 8, &count_job, ran);
+	assert(!err);
+	(void) err;
+	printf("pool: as expected\n");
+}
+
 int common_test(void) {
 	printf("common:\n");
+	pool_test();
 	long r = uwuprintf("%s%c, world!\n", "HELL", 'o');
 	assert(r == 14);
 	r = uwuprintf("He%-20.40ls!\n", L"llo, \u1234world");
@@ -0,0 +1,169 @@
+#define _DEFAULT_SOURCE // sysconf, open_memstream
+
+#include <driver.h>
+#include <pp/pp.h>
+#include <pp/pch.h>
+#include <uwu/lex.h>
+#include <stream/stream.h>
+#include <common/pool.h>
+#include <common/log.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+struct Options {
+	const char **search; // the -I directories, in order
+	ptrdiff_t search_len;
+	const char *cache, *pch;
+	const char *write_pch; // for the one file, which is a prefix header
+	int jobs;
+};
+
+// a translation unit, and what became of it
+struct Unit {
+	const char *path;
+	char *output;
+	int err;
+	ptrdiff_t pp_tokens, tokens;
+	// its diagnostics, printed with its line of the report
+	char *log;
+	size_t log_len;
+};
+
+struct Build {
+	const struct Options *options;
+	struct Unit *units;
+};
+
+// `path` with .c made .i, or .i added
+static char *output_name(const char *path) {
+	size_t len = strlen(path);
+	if (len > 2 && !strcmp(path + len - 2, ".c")) len -= 2;
+	char *name = malloc(len + 3);
+	if (!name) return NULL;
+	memcpy(name, path, len);
+	memcpy(name + len, ".i", 3);
+	return name;
+}
+
+static void translate(const struct Options *options, struct Unit *u) {
+	struct Preprocessor pp;
+	u->err = -1;
+	if (preprocessor_init(&pp, u->path)) {
+		diagnose("could not read `%s`.\n", u->path);
+		return;
+	}
+	int err = 0;
+	for (ptrdiff_t k = 0; !err && k < options->search_len; k++) err = preprocessor_search(&pp, options->search[k]);
+	if (!err && options->cache) err = preprocessor_cache(&pp, options->cache);
+	if (!err && options->pch) err = preprocessor_include_pch(&pp, options->pch);
+	if (!err) err = preprocess(&pp);
+	if (!err && options->write_pch) err = preprocessor_write_pch(&pp, options->write_pch);
+	u->pp_tokens = pp.output.len;
+	// the lexer reads the output where it is rather than back from the file
+	ptrdiff_t len;
+	char *text = err ? NULL: preprocessor_text(&pp, &len);
+	preprocessor_fini(&pp, NULL);
+	if (!text) return;
+	Stream stream = stream_init(u->output, C_STREAM_WRITE|C_STREAM_TEXT);
+	bool written = stream && stream_write(stream, text, len) == len;
+	stream_fini(stream);
+	struct Lexer lexer;
+	struct TokenBuffer tokens = { 0 };
+	if (!written) {
+		diagnose("could not write `%s`.\n", u->output);
+	} else if (lexer_init_buffer(&lexer, (const uint8_t *) text, len)) {
+		diagnose("could not lex `%s`.\n", u->output);
+	} else {
+		lexer.name = u->output;
+		u->err = lexer_tokenize_all(&lexer, &tokens);
+		u->tokens = tokens.len;
+		token_buffer_fini(&tokens);
+		lexer_fini(&lexer);
+	}
+	free(text);
+}
+
+// unit `i`, on whatever thread gets to it. nothing is shared but the options,
+// and what it says is kept for the report rather than mixed with the other units.
+static void compile(void *arg, ptrdiff_t i) {
+	const struct Build *build = arg;
+	struct Unit *u = &build->units[i];
+	// without room for it, it is printed as it goes
+	FILE *log = open_memstream(&u->log, &u->log_len);
+	log_diagnostics(log);
+	translate(build->options, u);
+	log_diagnostics(NULL);
+	if (log) fclose(log);
+}
+
+static void usage(void) {
+	printf("usage: main [-jN] [-I dir]... [--cache dir] [--include-pch file] file.c...\n"
+		"       main [-I dir]... [--cache dir] --write-pch file prefix.h\n");
+}
+
+int run_driver(int argc, char **argv) {
+	struct Options options = { .jobs = sysconf(_SC_NPROCESSORS_ONLN) };
+	struct Unit *units = calloc(argc, sizeof (*units));
+	options.search = calloc(argc, sizeof (*options.search));
+	ptrdiff_t count = 0;
+	int status = 2;
+	if (!units || !options.search) {
+		printf("could not allocate the translation units.\n");
+		goto end;
+	}
+	for (int i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		if (!strncmp(a, "-j", 2)) {
+			char *rest;
+			long jobs = strtol(a[2] ? a + 2: (++i < argc ? argv[i]: ""), &rest, 10);
+			if (*rest || jobs < 1) goto usage;
+			options.jobs = jobs < POOL_MAX_THREADS ? jobs: POOL_MAX_THREADS;
+		} else if (!strncmp(a, "-I", 2)) {
+			if (!a[2] && ++i == argc) goto usage;
+			options.search[options.search_len++] = a[2] ? a + 2: argv[i];
+		} else if (!strcmp(a, "--cache") || !strcmp(a, "--include-pch") || !strcmp(a, "--write-pch")) {
+			if (++i == argc) goto usage;
+			if (!strcmp(a, "--cache")) options.cache = argv[i];
+			else if (!strcmp(a, "--include-pch")) options.pch = argv[i];
+			else options.write_pch = argv[i];
+		} else if (a[0] == '-') {
+			goto usage;
+		} else {
+			units[count].path = a;
+			if (!(units[count++].output = output_name(a))) {
+				printf("could not allocate the translation units.\n");
+				goto end;
+			}
+		}
+	}
+	if (!count || (options.write_pch && count > 1)) goto usage;
+	struct Build build = { .options = &options, .units = units };
+	pool_run(count, options.jobs, &compile, &build);
+	// whichever thread did what, the report is in the order of the command line
+	status = 0;
+	for (ptrdiff_t i = 0; i < count; i++) {
+		const struct Unit *u = &units[i];
+		if (u->log_len) fwrite(u->log, 1, u->log_len, stdout);
+		if (u->err) {
+			printf("%s: failed\n", u->path);
+			status = 1;
+		} else {
+			printf("%s: %td pp tokens, %td tokens into %s\n", u->path, u->pp_tokens, u->tokens, u->output);
+		}
+	}
+	goto end;
+usage:
+	usage();
+end:
+	for (ptrdiff_t i = 0; i < count; i++) {
+		free(units[i].output);
+		free(units[i].log);
+	}
+	free(units);
+	free(options.search);
+	return status;
+}
@@ -3,61 +3,120 @@
 #include <string.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <pthread.h>
 
 #include "intern/intern.h"
 #include <uwu/uwu.h>
 
+#define MIN_SLOTS (64)
+#define STRINGS_CHUNK (64 * 1024)
+
+static uint32_t intern_hash(const uint8_t *str, ptrdiff_t len) {
+	// FNV-1a
+	uint32_t h = 2166136261u;
+	for (ptrdiff_t i = 0; i < len; i++) {
+		h ^= str[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static struct InternSlot *intern_probe(const struct Interns *interns, uint32_t hash,
+		const uint8_t *str, ptrdiff_t len) {
+	ptrdiff_t mask = interns->slot_cap - 1;
+	for (ptrdiff_t i = hash & mask;; i = (i + 1) & mask) {
+		struct InternSlot *slot = interns->slots + i;
+		if (!slot->intern) return slot;
+		if (slot->hash != hash || slot->len != len) continue;
+		if (memcmp(str, slot->intern->str, len) == 0) return slot;
+	}
+}
+
+static int intern_grow_slots(struct Interns *interns) {
+	ptrdiff_t cap = interns->slot_cap ? interns->slot_cap*2: MIN_SLOTS;
+	struct InternSlot *slots = calloc(cap, sizeof (*slots));
+	if (!slots) return -1;
+	interns->allocs++;
+	ptrdiff_t mask = cap - 1;
+	for (ptrdiff_t i = 0; i < interns->slot_cap; i++) {
+		const struct InternSlot *old = interns->slots + i;
+		if (!old->intern) continue;
+		ptrdiff_t j = old->hash & mask;
+		while (slots[j].intern) j = (j + 1) & mask;
+		slots[j] = *old;
+	}
+	free(interns->slots);
+	interns->slots = slots;
+	interns->slot_cap = cap;
+	return 0;
+}
+
 int intern_init(struct Interns *interns) {
 	if (!interns) return -1;
 	interns->len = interns->cap = 0;
 	interns->interns = NULL;
-	return 0;
+	interns->slot_cap = 0;
+	interns->slots = NULL;
+	interns->allocs = 0;
+	return arena_init(&interns->strings, STRINGS_CHUNK);
 }
 
 void intern_fini(struct Interns *interns) {
 	if (!interns) return;
-	for (ptrdiff_t i = 0; i < interns->len; i++) {
-		free(interns->interns[i].str);
-	}
+	arena_fini(&interns->strings);
 	free(interns->interns);
+	free(interns->slots);
 }
 
 const struct InternString *intern_string(struct Interns *interns, const uint8_t *str, ptrdiff_t len) {
-	const struct InternString *in = intern_find(interns, str, len);
-	if (in) return in;
+	if (len < 0 || len > UINT32_MAX) return NULL;
+	// keep the load factor under 1/2
+	if ((interns->len+1)*2 > interns->slot_cap && intern_grow_slots(interns)) return NULL;
+	uint32_t hash = intern_hash(str, len);
+	struct InternSlot *slot = intern_probe(interns, hash, str, len);
+	if (slot->intern) return slot->intern;
 	if (interns->len+1 > interns->cap) {
 		ptrdiff_t cap = interns->cap*2+1;
-		struct InternString *tmp = realloc(interns->interns, cap * sizeof (*tmp));
+		struct InternString **tmp = realloc(interns->interns, cap * sizeof (*tmp));
 		if (!tmp) return NULL;
+		interns->allocs++;
 		interns->interns = tmp;
 		interns->cap = cap;
 	}
-	struct InternString *intern = interns->interns + interns->len;
-	if (!(intern->str = malloc(len+1))) return NULL;
+	// the bytes are stored right after their record
+	struct InternString *intern = arena_alloc(&interns->strings, sizeof (*intern) + len+1,
+			ARENA_ALIGNOF(struct InternString));
+	if (!intern) return NULL;
+	intern->str = (uint8_t *) (intern + 1);
 	memcpy(intern->str, str, len);
 	intern->str[intern->len = len] = '\0';
-	interns->len++;
+	intern->id = interns->len;
+	interns->interns[interns->len++] = intern;
+	slot->hash = hash;
+	slot->len = len;
+	slot->intern = intern;
 	return intern;
 }
 
 const struct InternString *intern_find(const struct Interns *interns, const uint8_t *str, ptrdiff_t len) {
-	for (ptrdiff_t i=0; i<interns->len; i++) {
-		const struct InternString *intern = interns->interns+i;
-		if (len == intern->len && memcmp(str, intern->str, len) == 0) {
-			return intern;
-		}
-	}
-	return NULL;
+	if (!interns->slot_cap || len < 0 || len > UINT32_MAX) return NULL;
+	return intern_probe(interns, intern_hash(str, len), str, len)->intern;
 }
 
 bool intern_contains(const struct Interns *interns, const uint8_t *str, ptrdiff_t len) {
 	return intern_find(interns, str, len);
 }
 
+void intern_stats(const struct Interns *interns, struct InternStats *stats) {
+	stats->strings = interns->len;
+	stats->allocs = interns->allocs + interns->strings.allocs;
+	stats->bytes = interns->strings.used;
+}
+
 int print_interns(const struct Interns *interns) {
 	int total = 0, printed = 0, stop = 80;
 	if (interns) for (ptrdiff_t i = 0; i < interns->len; i++) {
-		int ret = print_intern(interns->interns+i);
+		int ret = print_intern(interns->interns[i]);
 		total += ret;
 		printed += ret;
 		if (printed >= stop) {
@@ -73,11 +132,17 @@ int print_intern(const struct InternString *intern) {
 	return printf("<%.*s> ", (int)intern->len, intern->str);
 }
 
-const struct Interns *get_keyword_interns(void) {
-	static const struct InternString kws[TOKEN_KEYWORD_END - TOKEN_KEYWORD_START] = {
+// the keywords are interned in order, so that their id is their offset from TOKEN_KEYWORD_START
+static struct Interns keyword_interns;
+
+static void intern_keywords(void) {
+	static const struct {
+		const char *str;
+		ptrdiff_t len;
+	} kws[TOKEN_KEYWORD_END - TOKEN_KEYWORD_START] = {
 #define ELEM(a, b) \
 	[a - TOKEN_KEYWORD_START] = { \
-		.str = (uint8_t *) # b, \
+		.str = # b, \
 		.len = sizeof (# b)-1, \
 	}
 // sizeof (# b)-1 is like strlen but we need a constant expression
@@ -120,11 +185,15 @@ const struct Interns *get_keyword_interns(void) {
 		ELEM(TOKEN_IMAGINARY, _Imaginary),
 #undef ELEM
 	};
-	static const struct Interns interns = {
-		.interns = (struct InternString *) kws, // hope no one tries to modify it :)
-		.len = sizeof (kws) / sizeof (*kws),
-		.cap = 0,
-	};
-	return &interns;
+	intern_init(&keyword_interns);
+	for (ptrdiff_t i = 0; i < (ptrdiff_t) (sizeof (kws) / sizeof (*kws)); i++) {
+		intern_string(&keyword_interns, (const uint8_t *) kws[i].str, kws[i].len);
+	}
 }
 
+const struct Interns *get_keyword_interns(void) {
+	// built on first use, once whatever the number of threads that ask for it
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, &intern_keywords);
+	return &keyword_interns;
+}
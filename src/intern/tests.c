@@ -0,0 +1,100 @@
+#include <intern/tests.h>
+#include <intern/intern.h>
+#include <common/enums.h>
+#include <bench.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+// writes the `i`th distinct generated identifier to `buf`
+static int make_ident(char *buf, long i) {
+	return sprintf(buf, "id_%lx", i);
+}
+
+int intern_test(void) {
+	printf("intern:\n");
+	struct Interns interns;
+	if (intern_init(&interns)) return -1;
+	const uint8_t foo[] = "foo", bar[] = "bar", foobar[] = "foobar";
+	const struct InternString *a = intern_string(&interns, foo, 3);
+	const struct InternString *b = intern_string(&interns, bar, 3);
+	const struct InternString *prefix = intern_string(&interns, foobar, 3);
+	assert(a && b && a != b && a->id == 0 && b->id == 1);
+	assert(prefix == a);
+	assert(intern_find(&interns, foobar, 6) == NULL);
+	assert(intern_contains(&interns, bar, 3));
+	assert(!intern_contains(&interns, foobar, 0));
+
+	char buf[32];
+	const long n = 5000;
+	for (long i = 0; i < n; i++) {
+		int len = make_ident(buf, i);
+		if (!intern_string(&interns, (uint8_t *) buf, len)) return -1;
+	}
+	assert(interns.len == n + 2);
+	// records must not have moved while the table grew
+	assert(intern_find(&interns, foo, 3) == a && a->str[3] == '\0');
+	assert(interns.interns[b->id] == b);
+	(void) a, (void) b, (void) prefix;
+	for (long i = 0; i < n; i++) {
+		int len = make_ident(buf, i);
+		const struct InternString *in = intern_find(&interns, (uint8_t *) buf, len);
+		const struct InternString *again = intern_string(&interns, (uint8_t *) buf, len);
+		assert(in && in->len == len && memcmp(in->str, buf, len) == 0);
+		assert(again == in);
+		(void) in, (void) again;
+	}
+	struct InternStats stats;
+	intern_stats(&interns, &stats);
+	printf("%td strings in %td slots, %td bytes, %td allocations\n",
+			stats.strings, interns.slot_cap, stats.bytes, stats.allocs);
+	assert(stats.allocs < n / 100);
+	intern_fini(&interns);
+
+	const struct Interns *kws = get_keyword_interns();
+	assert(kws->len == TOKEN_KEYWORD_END - TOKEN_KEYWORD_START);
+	const struct InternString *in = intern_find(kws, (const uint8_t *) "while", 5);
+	assert(in && in->id == TOKEN_WHILE - TOKEN_KEYWORD_START);
+	assert(!intern_find(kws, (const uint8_t *) "whilst", 6));
+	(void) in;
+	return 0;
+}
+
+int intern_bench(void) {
+	printf("intern:\n");
+	char buf[32];
+	for (long n = 1000; n <= 1000000; n *= 10) {
+		// the strings are generated up front so only interning is measured
+		char *names = malloc(n * sizeof (buf));
+		int *lens = malloc(n * sizeof (*lens));
+		if (!names || !lens) {
+			free(names);
+			free(lens);
+			return -1;
+		}
+		for (long i = 0; i < n; i++) {
+			lens[i] = make_ident(names + i * sizeof (buf), i);
+		}
+		struct Interns interns;
+		intern_init(&interns);
+		double t0 = bench_now();
+		for (long i = 0; i < n; i++) {
+			intern_string(&interns, (uint8_t *) names + i * sizeof (buf), lens[i]);
+		}
+		double t1 = bench_now();
+		for (long i = 0; i < n; i++) {
+			intern_find(&interns, (uint8_t *) names + i * sizeof (buf), lens[i]);
+		}
+		double t2 = bench_now();
+		struct InternStats stats;
+		intern_stats(&interns, &stats);
+		printf("%8ld identifiers: insert %8.2f Mop/s, find %8.2f Mop/s, %6td allocations\n", n,
+				n / (t1 - t0 + 1e-9) / 1e6, n / (t2 - t1 + 1e-9) / 1e6, stats.allocs);
+		intern_fini(&interns);
+		free(names);
+		free(lens);
+	}
+	return 0;
+}
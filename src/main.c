@@ -1,9 +1,17 @@
 #include "tests.h"
+#include "bench.h"
+#include "driver.h"
 #include <locale.h>
+#include <string.h>
 
 int main(int argc, char **argv) {
 	setlocale(LC_ALL, "C.UTF-8");
-	run_tests(argc, argv);
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+		run_benches(argc - 1, argv + 1);
+	} else if (argc > 1) {
+		return run_driver(argc, argv);
+	} else {
+		run_tests(argc, argv);
+	}
 	return 0;
 }
-
@@ -0,0 +1,202 @@
+#define _DEFAULT_SOURCE // mmap, getpid
+
+#include "pp/cache.h"
+#include "pp/pptoken.h"
+#include "pp/include.h"
+#include <common/log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+uint64_t cache_hash(const char *p, ptrdiff_t len) {
+	uint64_t h = 0x243F6A8885A308D3u ^ (uint64_t) len, w;
+	ptrdiff_t i = 0;
+	for (; i + 8 <= len; i += 8) {
+		memcpy(&w, p + i, 8);
+		h = (h ^ w) * 0x9E3779B97F4A7C15u;
+		h ^= h >> 29;
+	}
+	w = 0;
+	memcpy(&w, p + i, len - i);
+	h = (h ^ w) * 0x9E3779B97F4A7C15u;
+	h ^= h >> 32;
+	h *= 0xD6E8FEB86659FD93u;
+	return h ^ h >> 32;
+}
+
+// the cache file `name` into `h`, if it is the one for the `size` bytes of `view` whose hash is
+// `hash`: 1 if it is, 0 if it is not there or cannot be used as it is. -1 on allocation failure.
+static int load(struct Preprocessor *pp, const char *name, const char *view, uint64_t hash, ptrdiff_t size,
+		struct Header *h) {
+	int fd = open(name, O_RDONLY);
+	if (fd < 0) return 0;
+	struct stat st;
+	const uint8_t *map = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= (off_t) sizeof (struct CacheFile)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) return 0;
+	const uint64_t total = st.st_size;
+	const struct CacheFile *f = (const void *) map;
+	int ret = 0;
+	uint32_t *ids = NULL;
+	if (memcmp(f->magic, CACHE_MAGIC, 8) || f->hash != hash || f->size != (uint64_t) size
+			|| f->token_size != sizeof (struct PreprocessingToken) || f->total != total
+			|| !pp_fits(f->source, size, 1, total) || memcmp(map + f->source, view, size)
+			|| !pp_fits(f->buf, (uint64_t) f->len + C_STREAM_PADDING, 1, total)
+			|| !pp_fits(f->edits, f->edit_len, 2 * sizeof (uint32_t), total)
+			|| !pp_fits(f->tokens, f->token_len, sizeof (struct PreprocessingToken), total)
+			|| !pp_fits(f->starts, f->string_len + 1, sizeof (uint32_t), total) || f->bytes > total) {
+		goto stale;
+	}
+	// its strings are identifiers of this translation unit from now on
+	const uint32_t *starts = (const void *) (map + f->starts);
+	if (!(ids = malloc((f->string_len + 1) * sizeof (*ids)))) goto oom;
+	for (uint64_t i = 0; i < f->string_len; i++) {
+		if (starts[i] > starts[i + 1] || starts[i + 1] > total - f->bytes) goto stale;
+		const struct InternString *intern = intern_string(&pp->identifiers,
+				map + f->bytes + starts[i], starts[i + 1] - starts[i]);
+		if (!intern) goto oom;
+		ids[i] = intern->id;
+	}
+	struct EditMap *edits = &h->edits;
+	edit_map_init(edits);
+	if (f->edit_len) {
+		edits->out = malloc(f->edit_len * sizeof (*edits->out));
+		edits->delta = malloc(f->edit_len * sizeof (*edits->delta));
+		if (!edits->out || !edits->delta) {
+			edit_map_fini(edits);
+			goto oom;
+		}
+		memcpy(edits->out, map + f->edits, f->edit_len * sizeof (*edits->out));
+		memcpy(edits->delta, map + f->edits + f->edit_len * sizeof (*edits->out), f->edit_len * sizeof (*edits->delta));
+		edits->len = edits->cap = f->edit_len;
+	}
+	h->buf = (const char *) map + f->buf;
+	h->len = f->len;
+	h->owned = false;
+	h->map = map;
+	h->map_len = total;
+	h->whole = true;
+	// the tokens are used as they are, their ids are translated as they are read
+	h->tokens.items = (struct PreprocessingToken *) (map + f->tokens);
+	h->tokens.len = f->token_len;
+	h->ids = ids;
+	h->id_len = f->string_len;
+	return 1;
+oom:
+	ret = -1;
+stale:
+	if (ret) diagnose("could not allocate the cached header `%s`.\n", name);
+	free(ids);
+	munmap((void *) map, total);
+	return ret;
+}
+
+// `h` into the cache file `name`. it is written to a file of its own first and then renamed,
+// so that no compile maps one that is half written. -1 if it could not be.
+static int store(struct Preprocessor *pp, const char *name, const char *view, uint64_t hash, ptrdiff_t size,
+		const struct Header *h) {
+	const struct PreprocessingTokens *tokens = &h->tokens;
+	int ret = -1;
+	// the identifiers of the header, numbered by first use: `local` is their index + 1 by id
+	uint32_t *local = calloc(pp->identifiers.len + 1, sizeof (*local));
+	uint32_t *starts = NULL, *ids = NULL;
+	struct PreprocessingToken *copy = malloc((tokens->len + 1) * sizeof (*copy));
+	char tmp[PP_MAX_PATH];
+	Stream stream = NULL;
+	if (!local || !copy || !(ids = malloc((tokens->len + 1) * sizeof (*ids)))) goto fail;
+	uint32_t n = 0;
+	for (ptrdiff_t i = 0; i < tokens->len; i++) {
+		struct PreprocessingToken t = tokens->items[i];
+		if (t.kind == PREPROCESSING_TOKEN_IDENTIFIER) {
+			if (!local[t.id]) {
+				ids[n] = t.id;
+				local[t.id] = ++n;
+			}
+			t.id = local[t.id] - 1;
+		}
+		t.file = 0;
+		copy[i] = t;
+	}
+	if (!(starts = malloc((n + 1) * sizeof (*starts)))) goto fail;
+	starts[0] = 0;
+	for (uint32_t i = 0; i < n; i++) starts[i + 1] = starts[i] + pp->identifiers.interns[ids[i]]->len;
+	struct CacheFile f = {
+		.hash = hash, .size = size, .token_size = sizeof (struct PreprocessingToken), .len = h->len,
+		.edit_len = h->edits.len, .token_len = tokens->len, .string_len = n,
+	};
+	memcpy(f.magic, CACHE_MAGIC, 8);
+	f.source = PP_ALIGN(sizeof (f));
+	f.buf = PP_ALIGN(f.source + size);
+	f.edits = PP_ALIGN(f.buf + h->len + C_STREAM_PADDING);
+	f.tokens = PP_ALIGN(f.edits + h->edits.len * 2 * sizeof (uint32_t));
+	f.starts = PP_ALIGN(f.tokens + tokens->len * sizeof (*copy));
+	f.bytes = PP_ALIGN(f.starts + (n + 1) * sizeof (*starts));
+	f.total = f.bytes + starts[n];
+	if (snprintf(tmp, sizeof (tmp), "%s.%ld.%lx", name, (long) getpid(), (unsigned long) (uintptr_t) pp)
+			>= (int) sizeof (tmp)) goto fail;
+	if (!(stream = stream_init(tmp, C_STREAM_WRITE|C_STREAM_BINARY))) goto fail;
+	uint64_t at = 0;
+	bool ok = pp_section(stream, &at, 0, &f, sizeof (f)) && pp_section(stream, &at, f.source, view, size)
+		&& pp_section(stream, &at, f.buf, h->buf, h->len)
+		&& pp_section(stream, &at, f.edits, h->edits.out, h->edits.len * sizeof (uint32_t))
+		&& pp_section(stream, &at, at, h->edits.delta, h->edits.len * sizeof (uint32_t))
+		&& pp_section(stream, &at, f.tokens, copy, tokens->len * sizeof (*copy))
+		&& pp_section(stream, &at, f.starts, starts, (n + 1) * sizeof (*starts));
+	for (uint32_t i = 0; ok && i < n; i++) {
+		const struct InternString *s = pp->identifiers.interns[ids[i]];
+		ok = pp_section(stream, &at, i ? at: f.bytes, s->str, s->len);
+	}
+	ok = ok && pp_section(stream, &at, f.total, NULL, 0);
+	stream_fini(stream);
+	if (ok && !rename(tmp, name)) ret = 0;
+	else remove(tmp);
+fail:
+	if (ret) diagnose("could not write the cached header `%s`.\n", name);
+	free(local);
+	free(ids);
+	free(starts);
+	free(copy);
+	return ret;
+}
+
+int cache_map(struct Preprocessor *pp, const char *dir, struct Header *h, uint16_t file) {
+	if (!(h->stream = stream_init(h->path, C_STREAM_MMAP|C_STREAM_TEXT))) return -1;
+	ptrdiff_t size;
+	const char *view = (const char *) stream_view(h->stream, &size);
+	if (!view) goto io;
+	const uint64_t hash = cache_hash(view, size);
+	char name[PP_MAX_PATH];
+	if (snprintf(name, sizeof (name), "%s/%016" PRIx64 ".ppc", dir, hash) >= (int) sizeof (name)) {
+		diagnose("header cache path too long.\n");
+		goto io;
+	}
+	int hit = load(pp, name, view, hash, size, h);
+	if (hit < 0) goto io;
+	if (hit) {
+		pp->headers.cached++;
+		return 0;
+	}
+	if (preprocessor_phases(view, size, &h->buf, &h->len, &h->owned, &h->edits)) goto io;
+	if (preprocessor_decompose(pp, h->buf, h->len, file, &h->tokens)) goto phases;
+	h->whole = true;
+	// the header is fine without it, the next compile tries again
+	store(pp, name, view, hash, size, h);
+	return 0;
+phases:
+	if (h->owned) free((char *) h->buf);
+	edit_map_fini(&h->edits);
+	free(h->tokens.items);
+	memset(&h->tokens, 0, sizeof (h->tokens));
+io:
+	stream_fini(h->stream);
+	return -1;
+}
@@ -0,0 +1,34 @@
+#include "pp/common.h"
+#include <common/log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+bool pp_grow(void *items, ptrdiff_t *cap, ptrdiff_t need, size_t size, const char *what) {
+	ptrdiff_t c = *cap ? *cap: 64;
+	while (c < need) c *= 2;
+	void *old, *new;
+	memcpy(&old, items, sizeof (old));
+	if (!(new = realloc(old, c * size))) {
+		diagnose("could not grow %s to %td items.\n", what, need);
+		return false;
+	}
+	memcpy(items, &new, sizeof (new));
+	*cap = c;
+	return true;
+}
+
+bool pp_fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t total) {
+	return offset % 8 == 0 && offset <= total && count <= (total - offset) / size;
+}
+
+bool pp_section(Stream stream, uint64_t *at, uint64_t offset, const void *p, size_t len) {
+	static const char zeros[C_STREAM_PADDING];
+	for (uint64_t n; *at < offset; *at += n) {
+		n = offset - *at < sizeof (zeros) ? offset - *at: sizeof (zeros);
+		if (stream_write(stream, zeros, n) != (ptrdiff_t) n) return false;
+	}
+	*at += len;
+	return !len || stream_write(stream, p, len) == (ptrdiff_t) len;
+}
@@ -0,0 +1,389 @@
+#include "pp/eval.h"
+#include "pp/pptoken.h"
+#include <common/enums.h>
+#include <common/log.h>
+#include <uwu/lex.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// in a shape, an operand is this with EVAL_UNSIGNED set if it is unsigned,
+// anything else is the TokenKind of a punctuator
+#define SHAPE_OPERAND TOKEN_INTEGER_CONSTANT
+#define WIDTH (sizeof (uintmax_t) * 8)
+
+#define RESERVE(v, n) PP_RESERVE(v, n, "an #if expression")
+
+int if_expressions_init(struct IfExpressions *ifs) {
+	memset(ifs, 0, sizeof (*ifs));
+	return intern_init(&ifs->shapes);
+}
+
+void if_expressions_fini(struct IfExpressions *ifs) {
+	intern_fini(&ifs->shapes);
+	free(ifs->compiled.items);
+	free(ifs->code.items);
+	free(ifs->shape.items);
+	free(ifs->operands.items);
+	free(ifs->stack.items);
+	memset(ifs, 0, sizeof (*ifs));
+}
+
+struct Compiler {
+	struct IfExpressions *ifs;
+	const char *error; // what is wrong with the expression, NULL if it is an allocation that failed
+	const uint8_t *shape;
+	ptrdiff_t len, i;
+	uint32_t start; // of the code, which jumps are relative to
+	uint16_t operand; // the next one
+};
+
+static bool emit(struct Compiler *c, uint8_t op) {
+	if (!RESERVE(&c->ifs->code, 1)) return false;
+	c->ifs->code.items[c->ifs->code.len++] = op;
+	return true;
+}
+
+// `op` and a 16-bit operand, whose offset is into `*at` for a jump to patch
+static bool emit16(struct Compiler *c, uint8_t op, uint16_t operand, ptrdiff_t *at) {
+	if (!RESERVE(&c->ifs->code, 3)) return false;
+	uint8_t *p = c->ifs->code.items + c->ifs->code.len;
+	if (at) *at = c->ifs->code.len + 1;
+	p[0] = op;
+	p[1] = operand & 0xFF;
+	p[2] = operand >> 8;
+	c->ifs->code.len += 3;
+	return true;
+}
+
+// the jump whose operand is at `at` to where the code is now
+static bool patch(struct Compiler *c, ptrdiff_t at) {
+	ptrdiff_t to = c->ifs->code.len - c->start;
+	if (to > UINT16_MAX) {
+		c->error = "#if expression too long.";
+		return false;
+	}
+	c->ifs->code.items[at] = to & 0xFF;
+	c->ifs->code.items[at + 1] = to >> 8;
+	return true;
+}
+
+static bool next_is(const struct Compiler *c, enum TokenKind kind) {
+	return c->i < c->len && c->shape[c->i] == kind;
+}
+
+// the binary operator of `kind` and its precedence, 0 if it is none
+static int binary(uint8_t kind, enum Operator *op) {
+	static const struct { uint8_t kind, op, precedence; } operators[] = {
+		{ TOKEN_ASTERISK, OPERATOR_MUL, 10 }, { TOKEN_FSLASH, OPERATOR_DIV, 10 }, { TOKEN_PERCENT, OPERATOR_MOD, 10 },
+		{ TOKEN_PLUS, OPERATOR_ADD, 9 }, { TOKEN_MINUS, OPERATOR_SUB, 9 },
+		{ TOKEN_LSHIFT, OPERATOR_LSHIFT, 8 }, { TOKEN_RSHIFT, OPERATOR_RSHIFT, 8 },
+		{ TOKEN_LOWER, OPERATOR_LOWER, 7 }, { TOKEN_GREATER, OPERATOR_GREATER, 7 },
+		{ TOKEN_LOWER_EQUAL, OPERATOR_LEQUAL, 7 }, { TOKEN_GREATER_EQUAL, OPERATOR_GEQUAL, 7 },
+		{ TOKEN_EQUAL, OPERATOR_EQUAL, 6 }, { TOKEN_NOT_EQUAL, OPERATOR_NEQUAL, 6 },
+		{ TOKEN_AMPERSAND, OPERATOR_BIT_AND, 5 }, { TOKEN_CIRCUMFLEX, OPERATOR_BIT_XOR, 4 },
+		{ TOKEN_BAR, OPERATOR_BIT_OR, 3 }, { TOKEN_AND, OPERATOR_LOGICAL_AND, 2 }, { TOKEN_OR, OPERATOR_LOGICAL_OR, 1 },
+	};
+	for (size_t i = 0; i < sizeof (operators) / sizeof (*operators); i++) {
+		if (operators[i].kind != kind) continue;
+		*op = operators[i].op;
+		return operators[i].precedence;
+	}
+	return 0;
+}
+
+// these return 1 if what they compiled is unsigned, 0 if it is signed, -1 on error
+static int compile_comma(struct Compiler *c);
+
+static int compile_unary(struct Compiler *c) {
+	if (c->i == c->len) {
+		c->error = "#if expression ends where an operand should be.";
+		return -1;
+	}
+	uint8_t kind = c->shape[c->i++];
+	if ((kind & ~EVAL_UNSIGNED) == SHAPE_OPERAND) {
+		if (!emit16(c, EVAL_PUSH, c->operand++, NULL)) return -1;
+		return !!(kind & EVAL_UNSIGNED);
+	}
+	if (kind == TOKEN_LBRACKET) {
+		int u = compile_comma(c);
+		if (u < 0) return -1;
+		if (!next_is(c, TOKEN_RBRACKET)) {
+			c->error = "#if expression misses a ')'.";
+			return -1;
+		}
+		c->i++;
+		return u;
+	}
+	enum Operator op = kind == TOKEN_PLUS ? OPERATOR_UN_PLUS: kind == TOKEN_MINUS ? OPERATOR_UN_MINUS
+		: kind == TOKEN_TILDE ? OPERATOR_BIT_NOT: kind == TOKEN_BANG ? OPERATOR_LOGICAL_NOT: OPERATOR_NONE;
+	if (op == OPERATOR_NONE) {
+		c->error = "#if expression has an operator where an operand should be.";
+		return -1;
+	}
+	int u = compile_unary(c);
+	if (u < 0) return -1;
+	if (op == OPERATOR_LOGICAL_NOT) return emit(c, op) ? 0: -1;
+	return emit(c, op | (u ? EVAL_UNSIGNED: 0)) ? u: -1;
+}
+
+// the operators of `precedence` and up, left to right
+static int compile_binary(struct Compiler *c, int precedence) {
+	int u = compile_unary(c);
+	enum Operator op;
+	int p;
+	while (u >= 0 && c->i < c->len && (p = binary(c->shape[c->i], &op)) >= precedence) {
+		c->i++;
+		if (op == OPERATOR_LOGICAL_AND || op == OPERATOR_LOGICAL_OR) {
+			ptrdiff_t jump;
+			if (!emit16(c, op == OPERATOR_LOGICAL_AND ? EVAL_AND: EVAL_OR, 0, &jump)) return -1;
+			if (compile_binary(c, p + 1) < 0 || !emit(c, EVAL_BOOL) || !patch(c, jump)) return -1;
+			u = 0;
+			continue;
+		}
+		int v = compile_binary(c, p + 1);
+		if (v < 0) return -1;
+		// 6.5.7p3: a shift has the type of its left operand, the others convert both
+		bool shift = op == OPERATOR_LSHIFT || op == OPERATOR_RSHIFT, compare = p == 7 || p == 6;
+		bool is_unsigned = shift ? u: u || v;
+		if (!emit(c, op | (is_unsigned ? EVAL_UNSIGNED: 0))) return -1;
+		u = compare ? 0: is_unsigned;
+	}
+	return u;
+}
+
+static int compile_conditional(struct Compiler *c) {
+	int u = compile_binary(c, 1);
+	if (u < 0 || !next_is(c, TOKEN_QUESTION)) return u;
+	c->i++;
+	ptrdiff_t otherwise, end;
+	if (!emit16(c, EVAL_JUMP_FALSE, 0, &otherwise)) return -1;
+	int a = compile_comma(c);
+	if (a < 0) return -1;
+	if (!next_is(c, TOKEN_COLON)) {
+		c->error = "#if expression has a '?' without its ':'.";
+		return -1;
+	}
+	c->i++;
+	if (!emit16(c, EVAL_JUMP, 0, &end) || !patch(c, otherwise)) return -1;
+	int b = compile_conditional(c);
+	if (b < 0 || !patch(c, end)) return -1;
+	return a || b;
+}
+
+static int compile_comma(struct Compiler *c) {
+	int u = compile_conditional(c);
+	while (u >= 0 && next_is(c, TOKEN_COMMA)) {
+		c->i++;
+		u = compile_conditional(c);
+		if (u >= 0 && !emit(c, OPERATOR_COMMA)) return -1;
+	}
+	return u;
+}
+
+// the shape being evaluated into code, from `ifs->code.len` on.
+// NULL, or what is wrong with it, "" if an allocation failed.
+static const char *compile(struct IfExpressions *ifs) {
+	struct Compiler c = { .ifs = ifs, .shape = ifs->shape.items, .len = ifs->shape.len, .start = ifs->code.len };
+	bool ok = compile_comma(&c) >= 0;
+	if (ok && c.i != c.len) c.error = "#if expression goes on after its end.";
+	else if (ok && (ok = emit(&c, EVAL_RETURN)) && ifs->code.len - c.start > UINT16_MAX) c.error = "#if expression too long.";
+	else if (ok) return NULL;
+	return c.error ? c.error: "";
+}
+
+static bool operand(struct IfExpressions *ifs, uintmax_t value, bool is_unsigned) {
+	if (!RESERVE(&ifs->operands, 1) || !RESERVE(&ifs->shape, 1)) return false;
+	ifs->operands.items[ifs->operands.len++] = value;
+	ifs->shape.items[ifs->shape.len++] = SHAPE_OPERAND | (is_unsigned ? EVAL_UNSIGNED: 0);
+	return true;
+}
+
+// the value of the integer constant `s` of `len` bytes, and if it is unsigned. -1 if it is none.
+static int integer(const char *s, long len, uintmax_t *value, bool *is_unsigned) {
+	const char *end = s + len, *digits = s;
+	int base = 10;
+	if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+		base = 16;
+		digits += 2;
+	} else if (s[0] == '0') {
+		base = 8;
+	}
+	uint8_t *out;
+	*value = read_integer((const uint8_t *) digits, base, &out);
+	const char *p = (const char *) out;
+	if (p == digits) return -1;
+	int u = 0, l = 0;
+	while (p < end) {
+		if ((*p == 'u' || *p == 'U') && !u++) {
+			p++;
+		} else if ((*p == 'l' || *p == 'L') && !l++) {
+			p += p + 1 < end && p[1] == *p ? 2: 1;
+		} else {
+			return -1;
+		}
+	}
+	// a decimal constant too large for intmax_t has no type, it is taken as unsigned
+	*is_unsigned = u || *value > INTMAX_MAX;
+	return 0;
+}
+
+// the tokens into the shape and the operands. -1 on error, once it is reported.
+static int scan(struct Preprocessor *pp, const struct PreprocessingToken *at,
+		const struct PreprocessingToken *tokens, ptrdiff_t len) {
+	struct IfExpressions *ifs = &pp->ifs;
+	ifs->shape.len = ifs->operands.len = 0;
+	for (ptrdiff_t i = 0; i < len; i++) {
+		const struct PreprocessingToken *t = &tokens[i];
+		const char *s = preprocessor_spelling(pp, t);
+		uintmax_t value = 0;
+		bool is_unsigned = false;
+		if (t->kind == PREPROCESSING_TOKEN_PUNCTUATOR && t->id != TOKEN_HASH && t->id != TOKEN_HASH_HASH) {
+			if (!RESERVE(&ifs->shape, 1)) return -1;
+			ifs->shape.items[ifs->shape.len++] = t->id;
+			continue;
+		}
+		if (t->kind == PREPROCESSING_TOKEN_DEFINED) {
+			value = t->id;
+		} else if (t->kind == PREPROCESSING_TOKEN_PP_NUMBER) {
+			if (integer(s, t->len, &value, &is_unsigned)) {
+				preprocessor_where(pp, at);
+				diagnose("`%.*s` is no integer constant.\n", (int) t->len, s);
+				return -1;
+			}
+		} else if (t->kind == PREPROCESSING_TOKEN_CHARACTER_CONSTANT) {
+			bool wide = *s == 'L';
+			uint8_t *out;
+			uint32_t c = read_character((const uint8_t *) s + wide, wide, &out);
+			if (out == (const uint8_t *) s + wide) {
+				preprocessor_where(pp, at);
+				diagnose("invalid character constant `%.*s` in #if.\n", (int) t->len, s);
+				return -1;
+			}
+			// a plain char is signed, a wchar_t is an int
+			value = wide ? (uintmax_t) (intmax_t) (int32_t) c: (uintmax_t) (intmax_t) (signed char) c;
+		} else if (t->kind != PREPROCESSING_TOKEN_IDENTIFIER) {
+			// 6.10.1p4: the identifiers left are 0, anything else has no place there
+			preprocessor_where(pp, at);
+			diagnose("`%.*s` cannot be in an #if expression.\n", (int) t->len, s);
+			return -1;
+		}
+		if (!operand(ifs, value, is_unsigned)) return -1;
+	}
+	if (ifs->operands.len > UINT16_MAX) {
+		preprocessor_where(pp, at);
+		diagnose("#if expression with more than %d operands.\n", UINT16_MAX);
+		return -1;
+	}
+	return 0;
+}
+
+static uint16_t read16(const uint8_t *p) {
+	return p[0] | p[1] << 8;
+}
+
+// runs `code`, which always leaves one value. NULL, or what went wrong.
+static const char *run(const uint8_t *code, const uintmax_t *operands, uintmax_t *stack, uintmax_t *value) {
+	ptrdiff_t sp = 0;
+	for (const uint8_t *pc = code;;) {
+		const int op = *pc & ~EVAL_UNSIGNED;
+		const bool u = *pc++ & EVAL_UNSIGNED;
+		uintmax_t b = sp ? stack[sp - 1]: 0, a = sp > 1 ? stack[sp - 2]: 0, r;
+		const intmax_t sa = (intmax_t) a, sb = (intmax_t) b;
+		switch (op) {
+		case EVAL_PUSH: stack[sp++] = operands[read16(pc)]; pc += 2; continue;
+		case EVAL_JUMP: pc = code + read16(pc); continue;
+		case EVAL_JUMP_FALSE: pc = stack[--sp] ? pc + 2: code + read16(pc); continue;
+		case EVAL_AND:
+		case EVAL_OR:
+			// the left operand decides, it is the value
+			if (op == EVAL_AND ? !b: !!b) {
+				stack[sp - 1] = op == EVAL_OR;
+				pc = code + read16(pc);
+			} else {
+				sp--;
+				pc += 2;
+			}
+			continue;
+		case EVAL_BOOL: stack[sp - 1] = !!b; continue;
+		case EVAL_RETURN: *value = stack[0]; return NULL;
+		case OPERATOR_UN_PLUS: continue;
+		case OPERATOR_UN_MINUS: stack[sp - 1] = -b; continue;
+		case OPERATOR_BIT_NOT: stack[sp - 1] = ~b; continue;
+		case OPERATOR_LOGICAL_NOT: stack[sp - 1] = !b; continue;
+		case OPERATOR_DIV:
+		case OPERATOR_MOD:
+			if (!b) return "division by zero in #if.";
+			if (u) r = op == OPERATOR_DIV ? a / b: a % b;
+			// the one signed division that overflows
+			else if (sa == INTMAX_MIN && sb == -1) r = op == OPERATOR_DIV ? a: 0;
+			else r = (uintmax_t) (op == OPERATOR_DIV ? sa / sb: sa % sb);
+			break;
+		// in two's complement, these are the same bits whether they are signed or not
+		case OPERATOR_MUL: r = a * b; break;
+		case OPERATOR_ADD: r = a + b; break;
+		case OPERATOR_SUB: r = a - b; break;
+		// a shift by the width or more, or by a negative count, shifts everything out
+		case OPERATOR_LSHIFT: r = b >= WIDTH ? 0: a << b; break;
+		case OPERATOR_RSHIFT: r = u ? (b >= WIDTH ? 0: a >> b): (uintmax_t) (b >= WIDTH ? (sa < 0 ? -1: 0): sa >> b); break;
+		case OPERATOR_LOWER: r = u ? a < b: sa < sb; break;
+		case OPERATOR_GREATER: r = u ? a > b: sa > sb; break;
+		case OPERATOR_LEQUAL: r = u ? a <= b: sa <= sb; break;
+		case OPERATOR_GEQUAL: r = u ? a >= b: sa >= sb; break;
+		case OPERATOR_EQUAL: r = a == b; break;
+		case OPERATOR_NEQUAL: r = a != b; break;
+		case OPERATOR_BIT_AND: r = a & b; break;
+		case OPERATOR_BIT_XOR: r = a ^ b; break;
+		case OPERATOR_BIT_OR: r = a | b; break;
+		case OPERATOR_COMMA: r = b; break;
+		default:
+			return "invalid #if code.";
+		}
+		stack[--sp - 1] = r;
+	}
+}
+
+int if_evaluate(struct Preprocessor *pp, const struct PreprocessingToken *at,
+		const struct PreprocessingToken *tokens, ptrdiff_t len) {
+	struct IfExpressions *ifs = &pp->ifs;
+	if (scan(pp, at, tokens, len)) return -1;
+	if (!ifs->shape.len) {
+		preprocessor_where(pp, at);
+		diagnose("#%.*s without an expression.\n", (int) at->len, preprocessor_spelling(pp, at));
+		return -1;
+	}
+	const struct InternString *shape = intern_string(&ifs->shapes, ifs->shape.items, ifs->shape.len);
+	if (!shape) return -1;
+	if (shape->id == ifs->compiled.len) {
+		if (!RESERVE(&ifs->compiled, 1)) return -1;
+		ifs->compiled.items[ifs->compiled.len++] = UINT32_MAX;
+	}
+	uint32_t *start = &ifs->compiled.items[shape->id];
+	if (*start != UINT32_MAX) {
+		ifs->hits++;
+	} else {
+		// a shape that did not compile is compiled again, to report why
+		ptrdiff_t at_code = ifs->code.len;
+		const char *error = compile(ifs);
+		if (error) {
+			ifs->code.len = at_code;
+			if (!*error) return -1;
+			preprocessor_where(pp, at);
+			diagnose("%s\n", error);
+			return -1;
+		}
+		*start = at_code;
+	}
+	// every value on the stack was an operand first
+	ifs->stack.len = 0;
+	if (!RESERVE(&ifs->stack, ifs->operands.len + 1)) return -1;
+	uintmax_t value;
+	const char *error = run(ifs->code.items + *start, ifs->operands.items, ifs->stack.items, &value);
+	if (error) {
+		preprocessor_where(pp, at);
+		diagnose("%s\n", error);
+		return -1;
+	}
+	return value != 0;
+}
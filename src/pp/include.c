@@ -0,0 +1,239 @@
+#define _DEFAULT_SOURCE // stat
+
+#include "pp/include.h"
+#include "pp/pptoken.h"
+#include "pp/macro.h"
+#include "pp/cache.h"
+#include <common/log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// what a path is in `Headers.found` until it is looked up for good
+#define PATH_UNKNOWN (UINT32_MAX)
+
+int headers_init(struct Headers *headers, const char *main) {
+	memset(headers, 0, sizeof (*headers));
+	if (intern_init(&headers->paths)) return -1;
+	struct stat st;
+	if (!stat(main, &st)) {
+		headers->dev = st.st_dev;
+		headers->ino = st.st_ino;
+	}
+	return 0;
+}
+
+void headers_fini(struct Headers *headers) {
+	for (ptrdiff_t i = 0; i < headers->len; i++) {
+		struct Header *h = &headers->items[i];
+		if (h->owned) free((char *) h->buf);
+		edit_map_fini(&h->edits);
+		line_index_fini(&h->lines);
+		stream_fini(h->stream);
+		if (h->map) munmap((void *) h->map, h->map_len);
+		else free(h->tokens.items);
+		free(h->ids);
+		free(h->path);
+	}
+	for (ptrdiff_t i = 0; i < headers->search.len; i++) free(headers->search.items[i]);
+	free(headers->items);
+	free(headers->slots);
+	free(headers->found.items);
+	free(headers->search.items);
+	free(headers->cache);
+	free(headers->precompiled.items);
+	intern_fini(&headers->paths);
+	memset(headers, 0, sizeof (*headers));
+}
+
+static char *copy_string(const char *s, size_t len) {
+	char *copy = malloc(len + 1);
+	if (!copy) return NULL;
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	return copy;
+}
+
+int preprocessor_search(struct Preprocessor *pp, const char *dir) {
+	struct Headers *headers = &pp->headers;
+	if (headers->search.len == headers->search.cap) {
+		ptrdiff_t cap = headers->search.cap ? headers->search.cap * 2: 8;
+		char **items = realloc(headers->search.items, cap * sizeof (*items));
+		if (!items) return -1;
+		headers->search.items = items;
+		headers->search.cap = cap;
+	}
+	char *copy = copy_string(dir, strlen(dir));
+	if (!copy) return -1;
+	headers->search.items[headers->search.len++] = copy;
+	return 0;
+}
+
+int headers_precompiled(struct Headers *headers, struct Precompiled file) {
+	if (headers->precompiled.len == headers->precompiled.cap) {
+		ptrdiff_t cap = headers->precompiled.cap ? headers->precompiled.cap * 2: 64;
+		struct Precompiled *items = realloc(headers->precompiled.items, cap * sizeof (*items));
+		if (!items) return -1;
+		headers->precompiled.items = items;
+		headers->precompiled.cap = cap;
+	}
+	headers->precompiled.items[headers->precompiled.len++] = file;
+	return 0;
+}
+
+int preprocessor_cache(struct Preprocessor *pp, const char *dir) {
+	char *copy = copy_string(dir, strlen(dir));
+	if (!copy) return -1;
+	free(pp->headers.cache);
+	pp->headers.cache = copy;
+	return 0;
+}
+
+static ptrdiff_t identity_slot(const struct Headers *headers, uint64_t dev, uint64_t ino) {
+	uint64_t h = (ino ^ dev << 48) * 0x9E3779B97F4A7C15u;
+	return (h >> 32) & (headers->slot_cap - 1);
+}
+
+// the index of the header that is this file, -1 if there is none yet
+static long find_identity(const struct Headers *headers, uint64_t dev, uint64_t ino) {
+	if (!headers->slot_cap) return -1;
+	for (ptrdiff_t i = identity_slot(headers, dev, ino);; i = (i + 1) & (headers->slot_cap - 1)) {
+		uint32_t s = headers->slots[i];
+		if (!s) return -1;
+		const struct Header *h = &headers->items[s - 1];
+		if (h->dev == dev && h->ino == ino) return s - 1;
+	}
+}
+
+// header `index` into the slots, which have room for it
+static void add_identity(struct Headers *headers, ptrdiff_t index) {
+	const struct Header *h = &headers->items[index];
+	ptrdiff_t i = identity_slot(headers, h->dev, h->ino);
+	while (headers->slots[i]) i = (i + 1) & (headers->slot_cap - 1);
+	headers->slots[i] = index + 1;
+}
+
+static int grow_headers(struct Headers *headers) {
+	if (headers->len == headers->cap) {
+		ptrdiff_t cap = headers->cap ? headers->cap * 2: 64;
+		struct Header *items = realloc(headers->items, cap * sizeof (*items));
+		if (!items) return -1;
+		headers->items = items;
+		headers->cap = cap;
+	}
+	if ((headers->len + 1) * 2 > headers->slot_cap) {
+		ptrdiff_t cap = headers->slot_cap ? headers->slot_cap * 2: 128;
+		uint32_t *slots = calloc(cap, sizeof (*slots));
+		if (!slots) return -1;
+		free(headers->slots);
+		headers->slots = slots;
+		headers->slot_cap = cap;
+		for (ptrdiff_t i = 0; i < headers->len; i++) add_identity(headers, i);
+	}
+	return 0;
+}
+
+// `path` into a new header. its index, -1 on error.
+static long load(struct Preprocessor *pp, const char *path, ptrdiff_t len, const struct stat *st) {
+	struct Headers *headers = &pp->headers;
+	if (headers->len == UINT16_MAX) {
+		diagnose("`%s`: more than %d headers.\n", path, UINT16_MAX - 1);
+		return -1;
+	}
+	if (grow_headers(headers)) {
+		diagnose("could not grow the headers past %td.\n", headers->len);
+		return -1;
+	}
+	struct Header *h = &headers->items[headers->len];
+	memset(h, 0, sizeof (*h));
+	h->dev = st->st_dev;
+	h->ino = st->st_ino;
+	if (!(h->path = copy_string(path, len))) return -1;
+	if (headers->cache ? cache_map(pp, headers->cache, h, headers->len + 1)
+			: preprocessor_map(path, &h->stream, &h->buf, &h->len, &h->owned, &h->edits)) {
+		diagnose("could not read `%s`.\n", path);
+		free(h->path);
+		return -1;
+	}
+	add_identity(headers, headers->len);
+	return headers->len++;
+}
+
+// whether the file of `st` was read by a precompiled header, and including it again would change nothing
+static bool precompiled(const struct Preprocessor *pp, const struct stat *st) {
+	const struct Headers *headers = &pp->headers;
+	for (ptrdiff_t i = 0; i < headers->precompiled.len; i++) {
+		const struct Precompiled *p = &headers->precompiled.items[i];
+		if (p->dev != (uint64_t) st->st_dev || p->ino != (uint64_t) st->st_ino) continue;
+		return p->once || (p->guard && macro_find(&pp->macros, p->guard - 1));
+	}
+	return false;
+}
+
+// the header at `dir` followed by `name`, loaded if need be. -1 if there is no such file, -2 on error,
+// -3 if it is a file that a precompiled header read and there is nothing to read again.
+// each path costs a system call the first time only.
+static long lookup(struct Preprocessor *pp, const char *dir, ptrdiff_t dir_len, const char *name, long len) {
+	struct Headers *headers = &pp->headers;
+	char path[PP_MAX_PATH];
+	ptrdiff_t n = dir_len + (dir_len > 0) + len;
+	if (n >= PP_MAX_PATH) return -1;
+	memcpy(path, dir, dir_len);
+	if (dir_len > 0) path[dir_len] = '/';
+	memcpy(path + n - len, name, len);
+	path[n] = '\0';
+	// room for the path first, so that each interned path has its entry
+	if (headers->found.len == headers->found.cap) {
+		ptrdiff_t cap = headers->found.cap ? headers->found.cap * 2: 64;
+		uint32_t *items = realloc(headers->found.items, cap * sizeof (*items));
+		if (!items) return -2;
+		headers->found.items = items;
+		headers->found.cap = cap;
+	}
+	const struct InternString *intern = intern_string(&headers->paths, (const uint8_t *) path, n);
+	if (!intern) return -2;
+	if (intern->id == headers->found.len) headers->found.items[headers->found.len++] = PATH_UNKNOWN;
+	if (headers->found.items[intern->id] != PATH_UNKNOWN) return (long) headers->found.items[intern->id] - 1;
+	long index = -1;
+	struct stat st;
+	if (!stat(path, &st) && S_ISREG(st.st_mode)) {
+		index = find_identity(headers, st.st_dev, st.st_ino);
+		// not kept with the others, as whether it is worth reading again may change
+		if (index < 0 && precompiled(pp, &st)) return -3;
+		if (index < 0 && (index = load(pp, path, n, &st)) < 0) return -2;
+	}
+	headers->found.items[intern->id] = index + 1;
+	return index;
+}
+
+long preprocessor_include(struct Preprocessor *pp, const struct PreprocessingToken *at,
+		const char *name, long len, bool quoted) {
+	struct Headers *headers = &pp->headers;
+	long index = -1;
+	const bool absolute = len > 0 && name[0] == '/';
+	if (absolute) {
+		index = lookup(pp, "", 0, name, len);
+	} else if (quoted) {
+		// next to the file with the #include
+		const char *from = at->file ? headers->items[at->file - 1].path: stream_name(pp->stream, NULL);
+		const char *slash = strrchr(from, '/');
+		index = lookup(pp, from, slash ? slash - from: 0, name, len);
+	}
+	for (ptrdiff_t i = 0; !absolute && index == -1 && i < headers->search.len; i++) {
+		index = lookup(pp, headers->search.items[i], strlen(headers->search.items[i]), name, len);
+	}
+	if (index == -2) return -1;
+	if (index == -3) return 0;
+	if (index == -1) {
+		preprocessor_where(pp, at);
+		diagnose("`%.*s` not found.\n", (int) len, name);
+		return -1;
+	}
+	const struct Header *h = &headers->items[index];
+	if (h->once || (h->guard && macro_find(&pp->macros, h->guard - 1))) return 0;
+	if (h->dev == headers->dev && h->ino == headers->ino && headers->once) return 0;
+	return index + 1;
+}
@@ -0,0 +1,622 @@
+#include "pp/macro.h"
+#include "pp/pptoken.h"
+#include <common/enums.h>
+#include <common/log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+// where the tokens of a frame are
+enum FrameSource {
+	FRAME_FILE,     // `Expansion.text`, the tokens of a file
+	FRAME_BODY,     // `MacroTable.bodies`, a replacement list spliced as is
+	FRAME_SCRATCH,  // `Expansion.scratch`, given back when the frame is popped
+	FRAME_ARGUMENT, // `ExpansionLevel.args` of `levels[level]`, an argument being expanded
+};
+
+struct Frame {
+	uint32_t begin, cur, end;
+	uint32_t hideset; // added to the hideset of each of its tokens
+	uint8_t source;   // enum FrameSource
+	uint8_t level;
+	uint8_t flags;    // for its first token, the spacing of the macro name it replaces
+	bool started;
+};
+
+#define SPACING (PP_TOKEN_SPACE | PP_TOKEN_BOL)
+
+#define RESERVE(v, n) PP_RESERVE(v, n, "the macro expansion")
+
+static bool is_punctuator(const struct PreprocessingToken *token, enum TokenKind kind) {
+	return token->kind == PREPROCESSING_TOKEN_PUNCTUATOR && token->id == kind;
+}
+
+int hidesets_init(struct Hidesets *sets) {
+	memset(sets, 0, sizeof (*sets));
+	if (!pp_grow(&sets->starts, &sets->cap, 2, sizeof (*sets->starts), "the macro expansion")) return -1;
+	// set 0, the empty one, never goes into the slots
+	sets->starts[0] = sets->starts[1] = 0;
+	sets->len = 1;
+	return 0;
+}
+
+void hidesets_fini(struct Hidesets *sets) {
+	free(sets->starts);
+	free(sets->members.items);
+	free(sets->slots);
+	memset(sets, 0, sizeof (*sets));
+}
+
+bool hideset_contains(const struct Hidesets *sets, uint32_t set, uint32_t name) {
+	const uint32_t *m = sets->members.items;
+	for (uint32_t i = sets->starts[set]; i < sets->starts[set + 1]; i++) {
+		if (m[i] >= name) return m[i] == name;
+	}
+	return false;
+}
+
+static uint32_t hash_members(const uint32_t *m, ptrdiff_t n) {
+	uint64_t h = n;
+	for (ptrdiff_t i = 0; i < n; i++) h = (h ^ m[i]) * 0x9E3779B97F4A7C15u;
+	return h >> 32;
+}
+
+static bool rehash_sets(struct Hidesets *sets) {
+	ptrdiff_t cap = sets->slot_cap ? sets->slot_cap * 2: 64;
+	uint32_t *slots = calloc(cap, sizeof (*slots));
+	if (!slots) {
+		diagnose("could not grow the hidesets past %td.\n", sets->len);
+		return false;
+	}
+	for (uint32_t s = 1; s < sets->len; s++) {
+		const uint32_t *m = sets->members.items + sets->starts[s];
+		ptrdiff_t i = hash_members(m, sets->starts[s + 1] - sets->starts[s]) & (cap - 1);
+		while (slots[i]) i = (i + 1) & (cap - 1);
+		slots[i] = s + 1;
+	}
+	free(sets->slots);
+	sets->slots = slots;
+	sets->slot_cap = cap;
+	return true;
+}
+
+// the id of the set of the `n` members just past `members.len`, which only stay there if they are new
+static long intern_members(struct Hidesets *sets, ptrdiff_t n) {
+	if (!n) return 0;
+	if (sets->len + 2 > sets->cap
+			&& !pp_grow(&sets->starts, &sets->cap, sets->len + 2, sizeof (*sets->starts), "the macro expansion")) {
+		return -1;
+	}
+	if ((sets->len + 1) * 2 > sets->slot_cap && !rehash_sets(sets)) return -1;
+	const uint32_t *m = sets->members.items + sets->members.len;
+	ptrdiff_t mask = sets->slot_cap - 1;
+	for (ptrdiff_t i = hash_members(m, n) & mask;; i = (i + 1) & mask) {
+		uint32_t s = sets->slots[i];
+		if (!s) {
+			sets->slots[i] = sets->len + 1;
+			sets->members.len += n;
+			sets->starts[sets->len + 1] = sets->members.len;
+			return sets->len++;
+		}
+		s--;
+		uint32_t start = sets->starts[s];
+		if (sets->starts[s + 1] - start == n && !memcmp(sets->members.items + start, m, n * sizeof (*m))) return s;
+	}
+}
+
+long hideset_union(struct Hidesets *sets, uint32_t a, uint32_t b) {
+	if (a == b || !b) return a;
+	if (!a) return b;
+	// set 0 is never a union of two others, so a zeroed entry matches nothing
+	uint32_t slot = (a * 31 + b) % HIDESET_UNIONS;
+	if (sets->unions[slot].a == a && sets->unions[slot].b == b) return sets->unions[slot].set;
+	uint32_t na = sets->starts[a + 1] - sets->starts[a], nb = sets->starts[b + 1] - sets->starts[b];
+	if (!RESERVE(&sets->members, na + nb)) return -1;
+	const uint32_t *x = sets->members.items + sets->starts[a], *y = sets->members.items + sets->starts[b];
+	uint32_t *out = sets->members.items + sets->members.len, i = 0, k = 0;
+	ptrdiff_t n = 0;
+	while (i < na && k < nb) {
+		if (x[i] < y[k]) out[n++] = x[i++];
+		else if (y[k] < x[i]) out[n++] = y[k++];
+		else out[n++] = x[i++], k++;
+	}
+	while (i < na) out[n++] = x[i++];
+	while (k < nb) out[n++] = y[k++];
+	long set = intern_members(sets, n);
+	if (set > 0) {
+		sets->unions[slot].a = a;
+		sets->unions[slot].b = b;
+		sets->unions[slot].set = set;
+	}
+	return set;
+}
+
+long hideset_intersection(struct Hidesets *sets, uint32_t a, uint32_t b) {
+	if (a == b || !a) return a;
+	if (!b) return b;
+	uint32_t na = sets->starts[a + 1] - sets->starts[a], nb = sets->starts[b + 1] - sets->starts[b];
+	if (!RESERVE(&sets->members, na < nb ? na: nb)) return -1;
+	const uint32_t *x = sets->members.items + sets->starts[a], *y = sets->members.items + sets->starts[b];
+	uint32_t *out = sets->members.items + sets->members.len, i = 0, k = 0;
+	ptrdiff_t n = 0;
+	while (i < na && k < nb) {
+		if (x[i] < y[k]) i++;
+		else if (y[k] < x[i]) k++;
+		else out[n++] = x[i++], k++;
+	}
+	return intern_members(sets, n);
+}
+
+long hideset_add(struct Hidesets *sets, uint32_t set, uint32_t name) {
+	if (hideset_contains(sets, set, name)) return set;
+	uint32_t n = sets->starts[set + 1] - sets->starts[set];
+	if (!RESERVE(&sets->members, n + 1)) return -1;
+	const uint32_t *x = sets->members.items + sets->starts[set];
+	uint32_t *out = sets->members.items + sets->members.len, i = 0;
+	for (; i < n && x[i] < name; i++) out[i] = x[i];
+	out[i] = name;
+	for (; i < n; i++) out[i + 1] = x[i];
+	return intern_members(sets, n + 1);
+}
+
+int macro_table_init(struct MacroTable *macros) {
+	memset(macros, 0, sizeof (*macros));
+	return 0;
+}
+
+void macro_table_fini(struct MacroTable *macros) {
+	free(macros->slots);
+	free(macros->bodies.items);
+	memset(macros, 0, sizeof (*macros));
+}
+
+// Fibonacci hashing: the top bits of the id times 2^64 / phi, so that ids in a row spread out
+static ptrdiff_t macro_hash(const struct MacroTable *macros, uint32_t name) {
+	return (name * 0x9E3779B97F4A7C15u) >> (64 - __builtin_ctzll(macros->cap));
+}
+
+const struct Macro *macro_find(const struct MacroTable *macros, uint32_t name) {
+	if (!macros->len) return NULL;
+	ptrdiff_t mask = macros->cap - 1;
+	for (ptrdiff_t i = macro_hash(macros, name);; i = (i + 1) & mask) {
+		const struct Macro *m = &macros->slots[i];
+		if (m->kind == CONTROL_LINE_NONE) return NULL;
+		if (m->name == name && m->kind != CONTROL_LINE_UNDEF) return m;
+	}
+}
+
+// to a table with no removed macro left, and room for as many again
+static int rehash_macros(struct MacroTable *macros) {
+	ptrdiff_t cap = 64;
+	while ((macros->len + 1) * 4 > cap) cap *= 2;
+	struct Macro *slots = calloc(cap, sizeof (*slots)), *old = macros->slots;
+	if (!slots) {
+		diagnose("could not grow the macro table past %td macros.\n", macros->len);
+		return -1;
+	}
+	ptrdiff_t old_cap = macros->cap;
+	macros->slots = slots;
+	macros->cap = cap;
+	for (ptrdiff_t k = 0; k < old_cap; k++) {
+		if (old[k].kind == CONTROL_LINE_NONE || old[k].kind == CONTROL_LINE_UNDEF) continue;
+		ptrdiff_t i = macro_hash(macros, old[k].name);
+		while (slots[i].kind != CONTROL_LINE_NONE) i = (i + 1) & (cap - 1);
+		slots[i] = old[k];
+	}
+	macros->used = macros->len;
+	free(old);
+	return 0;
+}
+
+int macro_define(struct MacroTable *macros, struct Macro macro, const struct PreprocessingToken *body) {
+	if (!RESERVE(&macros->bodies, macro.len)) return -1;
+	if ((macros->used + 1) * 2 > macros->cap && rehash_macros(macros)) return -1;
+	if (macro.len) memcpy(macros->bodies.items + macros->bodies.len, body, macro.len * sizeof (*body));
+	// a replaced body stays behind, redefinitions are too rare to bother
+	macro.body = macros->bodies.len;
+	macros->bodies.len += macro.len;
+	ptrdiff_t mask = macros->cap - 1, removed = -1;
+	for (ptrdiff_t i = macro_hash(macros, macro.name);; i = (i + 1) & mask) {
+		struct Macro *m = &macros->slots[i];
+		if (m->kind == CONTROL_LINE_NONE) {
+			if (removed < 0) macros->used++;
+			macros->slots[removed < 0 ? i: removed] = macro;
+			macros->len++;
+			return 0;
+		}
+		if (m->kind == CONTROL_LINE_UNDEF) {
+			if (removed < 0) removed = i;
+		} else if (m->name == macro.name) {
+			*m = macro;
+			return 0;
+		}
+	}
+}
+
+bool macro_undef(struct MacroTable *macros, uint32_t name) {
+	struct Macro *m = (struct Macro *) macro_find(macros, name);
+	if (!m) return false;
+	m->kind = CONTROL_LINE_UNDEF;
+	macros->len--;
+	return true;
+}
+
+int expansion_init(struct Expansion *ex) {
+	memset(ex, 0, sizeof (*ex));
+	return hidesets_init(&ex->hidesets);
+}
+
+void expansion_fini(struct Expansion *ex) {
+	hidesets_fini(&ex->hidesets);
+	free(ex->scratch.items);
+	for (int i = 0; i < EXPANSION_DEPTH; i++) {
+		free(ex->levels[i].args.items);
+		free(ex->levels[i].expanded.items);
+		free(ex->levels[i].starts.items);
+		free(ex->levels[i].spans.items);
+	}
+	free(ex->frames);
+	memset(ex, 0, sizeof (*ex));
+}
+
+static int push_frame(struct Expansion *ex, const struct Frame *frame) {
+	if (ex->len == ex->cap && !pp_grow(&ex->frames, &ex->cap, ex->len + 1, sizeof (*ex->frames), "the macro expansion")) return -1;
+	ex->frames[ex->len++] = *frame;
+	return 0;
+}
+
+static void pop_frame(struct Expansion *ex) {
+	const struct Frame *f = &ex->frames[--ex->len];
+	if (f->source == FRAME_SCRATCH) ex->scratch.len = f->begin;
+	// nothing came out of it, what came before its macro name goes to the next token
+	if (!f->started) ex->carry |= f->flags;
+}
+
+static void read_token(const struct Preprocessor *pp, const struct Frame *f, uint32_t i, struct ExpansionToken *t) {
+	t->hideset = 0;
+	if (f->source == FRAME_FILE) t->token = pp->expansion.text[i];
+	else if (f->source == FRAME_BODY) t->token = pp->macros.bodies.items[i];
+	else if (f->source == FRAME_SCRATCH) *t = pp->expansion.scratch.items[i];
+	else *t = pp->expansion.levels[f->level].args.items[i];
+}
+
+// the next token of frame `base` and the ones above it, with all of its hideset.
+// 0 once they are all read, -1 on allocation failure.
+static int next_token(struct Preprocessor *pp, ptrdiff_t base, struct ExpansionToken *t) {
+	struct Expansion *ex = &pp->expansion;
+	for (;;) {
+		struct Frame *f = &ex->frames[ex->len - 1];
+		if (f->cur == f->end) {
+			if (ex->len - 1 == base) return 0;
+			pop_frame(ex);
+			continue;
+		}
+		read_token(pp, f, f->cur++, t);
+		if (!f->started) {
+			f->started = true;
+			t->token.flags = (t->token.flags & ~SPACING) | f->flags;
+		}
+		t->token.flags |= ex->carry;
+		ex->carry = 0;
+		// most tokens are either from the file or from a replacement list, with no union to make
+		long hideset = hideset_union(&ex->hidesets, t->hideset, f->hideset);
+		if (hideset < 0) return -1;
+		t->hideset = hideset;
+		return 1;
+	}
+}
+
+// whether a '(' comes next, without reading it or going below frame `base`
+static bool next_is_lparen(const struct Preprocessor *pp, ptrdiff_t base) {
+	const struct Expansion *ex = &pp->expansion;
+	for (ptrdiff_t i = ex->len - 1; i >= base; i--) {
+		const struct Frame *f = &ex->frames[i];
+		if (f->cur == f->end) continue;
+		struct ExpansionToken t;
+		read_token(pp, f, f->cur, &t);
+		return is_punctuator(&t.token, TOKEN_LBRACKET);
+	}
+	return false;
+}
+
+static int append(struct ExpansionTokens *tokens, const struct ExpansionToken *t) {
+	if (!RESERVE(tokens, 1)) return -1;
+	tokens->items[tokens->len++] = *t;
+	return 0;
+}
+
+// into `out`, or `pp->output` if NULL
+static int emit(struct Preprocessor *pp, struct ExpansionTokens *out, const struct ExpansionToken *t) {
+	if (out) return append(out, t);
+	if (!RESERVE(&pp->output, 1)) return -1;
+	pp->output.items[pp->output.len++] = t->token;
+	return 0;
+}
+
+// room for `n` more bytes of spelling, which stay zero until written
+static int reserve_spellings(struct Preprocessor *pp, ptrdiff_t n) {
+	ptrdiff_t old = pp->spellings.cap;
+	if (!RESERVE(&pp->spellings, n + C_STREAM_PADDING)) return -1;
+	memset(pp->spellings.items + old, 0, pp->spellings.cap - old);
+	return 0;
+}
+
+// argument `i` of `levels[level]` as a string literal, its tokens one space apart where there was any
+static int stringize(struct Preprocessor *pp, ptrdiff_t level, uint32_t i, uint8_t flags) {
+	struct Expansion *ex = &pp->expansion;
+	const struct ExpansionLevel *l = &ex->levels[level];
+	uint32_t from = l->starts.items[i], to = l->starts.items[i + 1];
+	ptrdiff_t n = 2;
+	for (uint32_t k = from; k < to; k++) n += 2 * l->args.items[k].token.len + 1;
+	if (reserve_spellings(pp, n)) return -1;
+	char *s = pp->spellings.items + pp->spellings.len, *p = s;
+	*p++ = '"';
+	for (uint32_t k = from; k < to; k++) {
+		const struct PreprocessingToken *t = &l->args.items[k].token;
+		const char *text = preprocessor_spelling(pp, t);
+		bool escape = t->kind == PREPROCESSING_TOKEN_STRING_LITERAL || t->kind == PREPROCESSING_TOKEN_CHARACTER_CONSTANT;
+		if (k > from && (t->flags & SPACING)) *p++ = ' ';
+		for (uint32_t c = 0; c < t->len; c++) {
+			if (escape && (text[c] == '"' || text[c] == '\\')) *p++ = '\\';
+			*p++ = text[c];
+		}
+	}
+	*p++ = '"';
+	struct ExpansionToken string = { .token = {
+		.offset = pp->spellings.len, .len = p - s,
+		.kind = PREPROCESSING_TOKEN_STRING_LITERAL, .flags = PP_TOKEN_SPELLED | (flags & SPACING),
+	} };
+	pp->spellings.len += p - s;
+	return append(&ex->scratch, &string);
+}
+
+// the token at `at` of the scratch pasted with the one after it, which goes
+static int glue(struct Preprocessor *pp, ptrdiff_t at) {
+	struct Expansion *ex = &pp->expansion;
+	struct ExpansionToken *l = &ex->scratch.items[at], *r = l + 1;
+	if (l->token.kind == PREPROCESSING_TOKEN_NONE) {
+		// a placemarker on the left gives the right operand, where the placemarker was
+		uint8_t flags = l->token.flags;
+		*l = *r;
+		l->token.flags = (l->token.flags & ~SPACING) | (flags & SPACING);
+	} else if (r->token.kind != PREPROCESSING_TOKEN_NONE) {
+		ptrdiff_t n = l->token.len + r->token.len;
+		if (reserve_spellings(pp, n)) return -1;
+		char *p = pp->spellings.items + pp->spellings.len;
+		memcpy(p, preprocessor_spelling(pp, &l->token), l->token.len);
+		memcpy(p + l->token.len, preprocessor_spelling(pp, &r->token), r->token.len);
+		struct PreprocessingToken token = {
+			.offset = pp->spellings.len, .flags = PP_TOKEN_SPELLED | (l->token.flags & SPACING),
+		};
+		const char *end = preprocessor_token(pp, p, p + n, false, &token);
+		if (!end) return -1;
+		if (end != p + n) {
+			preprocessor_where(pp, &l->token);
+			diagnose("pasting `%.*s` and `%.*s` does not give a valid preprocessing token.\n",
+					(int) l->token.len, p, (int) r->token.len, p + l->token.len);
+			memset(p, 0, n);
+			return -1;
+		}
+		long hideset = hideset_intersection(&ex->hidesets, l->hideset, r->hideset);
+		if (hideset < 0) return -1;
+		pp->spellings.len += n;
+		l->token = token;
+		l->hideset = hideset;
+	}
+	memmove(r, r + 1, (ex->scratch.len - at - 2) * sizeof (*r));
+	ex->scratch.len--;
+	return 0;
+}
+
+static int expand_all(struct Preprocessor *pp, ptrdiff_t base, struct ExpansionTokens *out);
+
+// argument `i` of `levels[level]`, macro-expanded into its `expanded`
+static int expand_argument(struct Preprocessor *pp, ptrdiff_t level, uint32_t i) {
+	struct Expansion *ex = &pp->expansion;
+	struct ExpansionLevel *l = &ex->levels[level];
+	uint32_t start = l->expanded.len;
+	struct Frame frame = {
+		.begin = l->starts.items[i], .cur = l->starts.items[i], .end = l->starts.items[i + 1],
+		.source = FRAME_ARGUMENT, .level = level, .started = true,
+	};
+	if (push_frame(ex, &frame)) return -1;
+	ex->depth = level + 1;
+	int ret = expand_all(pp, ex->len - 1, &l->expanded);
+	ex->depth = level;
+	pop_frame(ex);
+	ex->carry = 0;
+	l->spans.items[2 * i] = start;
+	l->spans.items[2 * i + 1] = l->expanded.len;
+	return ret;
+}
+
+// argument `i` of `levels[level]` at the end of the scratch, as written if it is an operand of ##.
+// the first token is spaced like the parameter was.
+static int insert_argument(struct Preprocessor *pp, ptrdiff_t level, uint32_t i, uint8_t flags, bool raw) {
+	struct Expansion *ex = &pp->expansion;
+	struct ExpansionLevel *l = &ex->levels[level];
+	const struct ExpansionTokens *from = &l->args;
+	uint32_t start = l->starts.items[i], end = l->starts.items[i + 1];
+	if (!raw) {
+		if (l->spans.items[2 * i] == UINT32_MAX && expand_argument(pp, level, i)) return -1;
+		from = &l->expanded;
+		start = l->spans.items[2 * i];
+		end = l->spans.items[2 * i + 1];
+	}
+	if (start == end) {
+		if (!raw) return 0;
+		struct ExpansionToken placemarker = { .token = { .kind = PREPROCESSING_TOKEN_NONE, .flags = flags } };
+		return append(&ex->scratch, &placemarker);
+	}
+	if (!RESERVE(&ex->scratch, end - start)) return -1;
+	struct ExpansionToken *to = ex->scratch.items + ex->scratch.len;
+	memcpy(to, from->items + start, (end - start) * sizeof (*to));
+	to->token.flags = (to->token.flags & ~SPACING) | (flags & SPACING);
+	ex->scratch.len += end - start;
+	return 0;
+}
+
+// the replacement list of `m` onto the scratch with the arguments of `levels[level]` in,
+// # and ## applied and placemarkers gone. `level` is -1 for an object-like macro.
+static int substitute(struct Preprocessor *pp, const struct Macro *m, ptrdiff_t level) {
+	struct Expansion *ex = &pp->expansion;
+	const struct PreprocessingToken *body = pp->macros.bodies.items + m->body;
+	ptrdiff_t begin = ex->scratch.len, paste = -1;
+	for (uint32_t j = 0; j < m->len; j++) {
+		const struct PreprocessingToken *b = &body[j];
+		if (is_punctuator(b, TOKEN_HASH_HASH)) {
+			paste = ex->scratch.len - 1;
+			continue;
+		}
+		int ret;
+		if (level >= 0 && is_punctuator(b, TOKEN_HASH)) {
+			ret = stringize(pp, level, b[1].id, b->flags);
+			j++;
+		} else if (b->kind == PREPROCESSING_TOKEN_PARAMETER) {
+			bool operand = paste >= 0 || (j + 1 < m->len && is_punctuator(&b[1], TOKEN_HASH_HASH));
+			ret = insert_argument(pp, level, b->id, b->flags, operand);
+		} else {
+			struct ExpansionToken t = { .token = *b };
+			ret = append(&ex->scratch, &t);
+		}
+		if (ret) return -1;
+		if (paste >= 0) {
+			if (glue(pp, paste)) return -1;
+			paste = -1;
+		}
+	}
+	ptrdiff_t n = begin;
+	for (ptrdiff_t i = begin; i < ex->scratch.len; i++) {
+		if (ex->scratch.items[i].token.kind != PREPROCESSING_TOKEN_NONE) ex->scratch.items[n++] = ex->scratch.items[i];
+	}
+	ex->scratch.len = n;
+	return 0;
+}
+
+static int expand_object(struct Preprocessor *pp, const struct Macro *m, const struct ExpansionToken *name) {
+	struct Expansion *ex = &pp->expansion;
+	long hideset = hideset_add(&ex->hidesets, name->hideset, m->name);
+	if (hideset < 0) return -1;
+	struct Frame frame = { .hideset = hideset, .flags = name->token.flags & SPACING };
+	if (!m->operators) {
+		// read in place, the hideset of the frame is all it needs
+		frame.source = FRAME_BODY;
+		frame.begin = frame.cur = m->body;
+		frame.end = m->body + m->len;
+	} else {
+		frame.source = FRAME_SCRATCH;
+		frame.begin = frame.cur = ex->scratch.len;
+		if (substitute(pp, m, -1)) return -1;
+		frame.end = ex->scratch.len;
+	}
+	return push_frame(ex, &frame);
+}
+
+static int push_index(struct Indices *indices, uint32_t i) {
+	if (!RESERVE(indices, 1)) return -1;
+	indices->items[indices->len++] = i;
+	return 0;
+}
+
+// `name` is followed by a '(', which is read with the arguments up to the ')'
+static int expand_function(struct Preprocessor *pp, ptrdiff_t base, const struct Macro *m, const struct ExpansionToken *name) {
+	struct Expansion *ex = &pp->expansion;
+	const ptrdiff_t level = ex->depth;
+	if (level == EXPANSION_DEPTH) {
+		preprocessor_where(pp, &name->token);
+		diagnose("invocations nested more than %d deep.\n", EXPANSION_DEPTH);
+		return -1;
+	}
+	struct ExpansionLevel *l = &ex->levels[level];
+	l->args.len = l->expanded.len = l->starts.len = l->spans.len = 0;
+	struct ExpansionToken t;
+	if (next_token(pp, base, &t) < 0 || push_index(&l->starts, 0)) return -1;
+	// past the named parameters, commas belong to __VA_ARGS__
+	const ptrdiff_t split = m->kind == CONTROL_LINE_DEFINE_ARGS ? UINT16_MAX + 1: m->params;
+	for (long nesting = 0;;) {
+		int ret = next_token(pp, base, &t);
+		if (ret < 0) return -1;
+		if (!ret) {
+			preprocessor_where(pp, &name->token);
+			diagnose("unterminated invocation of macro `%.*s`.\n", (int) name->token.len, preprocessor_spelling(pp, &name->token));
+			return -1;
+		}
+		if (t.token.kind == PREPROCESSING_TOKEN_PUNCTUATOR) {
+			if (t.token.id == TOKEN_LBRACKET) {
+				nesting++;
+			} else if (t.token.id == TOKEN_RBRACKET) {
+				if (!nesting--) break;
+			} else if (t.token.id == TOKEN_COMMA && !nesting && l->starts.len < split) {
+				if (push_index(&l->starts, l->args.len)) return -1;
+				continue;
+			}
+		}
+		// the invocation is a line of its own once expanded
+		if (t.token.flags & PP_TOKEN_BOL) t.token.flags = (t.token.flags & ~PP_TOKEN_BOL) | PP_TOKEN_SPACE;
+		if (append(&l->args, &t)) return -1;
+	}
+	if (push_index(&l->starts, l->args.len)) return -1;
+	ptrdiff_t n = l->starts.len - 1;
+	if (!m->params && n == 1 && !l->args.len) n = 0;
+	// an empty __VA_ARGS__ may go without its comma
+	if (m->kind != CONTROL_LINE_DEFINE_ARGS && n == m->params - 1) {
+		if (push_index(&l->starts, l->args.len)) return -1;
+		n++;
+	}
+	if (n != m->params) {
+		preprocessor_where(pp, &name->token);
+		diagnose("macro `%.*s` takes %u arguments, not %td.\n", (int) name->token.len,
+				preprocessor_spelling(pp, &name->token), (unsigned) m->params, n);
+		return -1;
+	}
+	// a macro without parameters has no spans, nor anything to put them in yet
+	if (n) {
+		if (!RESERVE(&l->spans, 2 * n)) return -1;
+		memset(l->spans.items, 0xff, 2 * n * sizeof (*l->spans.items));
+	}
+	l->spans.len = 2 * n;
+	long hideset = hideset_intersection(&ex->hidesets, name->hideset, t.hideset);
+	if (hideset < 0 || (hideset = hideset_add(&ex->hidesets, hideset, m->name)) < 0) return -1;
+	struct Frame frame = {
+		.begin = ex->scratch.len, .cur = ex->scratch.len, .hideset = hideset,
+		.source = FRAME_SCRATCH, .flags = name->token.flags & SPACING,
+	};
+	if (substitute(pp, m, level)) return -1;
+	frame.end = ex->scratch.len;
+	return push_frame(ex, &frame);
+}
+
+// what frame `base` and the ones it leads to give, into `out` or `pp->output` if NULL
+static int expand_all(struct Preprocessor *pp, ptrdiff_t base, struct ExpansionTokens *out) {
+	struct Expansion *ex = &pp->expansion;
+	for (;;) {
+		struct ExpansionToken t;
+		int ret = next_token(pp, base, &t);
+		if (ret <= 0) return ret;
+		const struct Macro *m;
+		if (t.token.kind != PREPROCESSING_TOKEN_IDENTIFIER || !(m = macro_find(&pp->macros, t.token.id))
+				|| hideset_contains(&ex->hidesets, t.hideset, t.token.id)) {
+			ret = emit(pp, out, &t);
+		} else if (m->kind == CONTROL_LINE_DEFINE) {
+			ret = expand_object(pp, m, &t);
+		} else if (next_is_lparen(pp, base)) {
+			ret = expand_function(pp, base, m, &t);
+		} else {
+			ret = emit(pp, out, &t);
+		}
+		if (ret) return -1;
+	}
+}
+
+int macro_expand(struct Preprocessor *pp, const struct PreprocessingToken *tokens, ptrdiff_t start, ptrdiff_t end) {
+	struct Expansion *ex = &pp->expansion;
+	ex->text = tokens;
+	struct Frame frame = { .begin = start, .cur = start, .end = end, .source = FRAME_FILE, .started = true };
+	ex->len = ex->depth = ex->scratch.len = 0;
+	ex->carry = 0;
+	if (push_frame(ex, &frame)) return -1;
+	int ret = expand_all(pp, 0, NULL);
+	ex->len = ex->scratch.len = 0;
+	return ret;
+}
@@ -0,0 +1,270 @@
+#define _DEFAULT_SOURCE // mmap, stat
+
+#include "pp/pch.h"
+#include "pp/pptoken.h"
+#include "pp/include.h"
+#include "pp/macro.h"
+#include <common/log.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct Bytes {
+	ptrdiff_t len, cap;
+	char *items;
+};
+
+static int append(struct Bytes *b, const void *p, ptrdiff_t n) {
+	if (b->len + n > b->cap) {
+		ptrdiff_t cap = b->cap ? b->cap: 4096;
+		while (cap < b->len + n) cap *= 2;
+		char *items = realloc(b->items, cap);
+		if (!items) return -1;
+		b->items = items;
+		b->cap = cap;
+	}
+	memcpy(b->items + b->len, p, n);
+	b->len += n;
+	return 0;
+}
+
+// `t` spelled out in `spellings`, where identifier `i` already is at `starts[i]`
+static int spell(const struct Preprocessor *pp, struct Bytes *spellings, const uint32_t *starts,
+		struct PreprocessingToken *t) {
+	uint32_t offset = spellings->len;
+	if (t->kind == PREPROCESSING_TOKEN_IDENTIFIER) offset = starts[t->id];
+	else if (append(spellings, preprocessor_spelling(pp, t), t->len)) return -1;
+	t->offset = offset;
+	t->file = 0;
+	t->flags |= PP_TOKEN_SPELLED;
+	return 0;
+}
+
+// `path` as a file that went into the precompiled header
+static int depend(struct Bytes *files, struct Bytes *names, const char *path, uint32_t guard, bool once) {
+	struct stat st;
+	if (stat(path, &st)) {
+		diagnose("could not stat `%s`.\n", path);
+		return -1;
+	}
+	struct PchDependency d = {
+		.size = st.st_size, .sec = st.st_mtim.tv_sec, .nsec = st.st_mtim.tv_nsec,
+		.path = names->len, .len = strlen(path), .guard = guard, .once = once,
+	};
+	return append(names, path, d.len) || append(files, &d, sizeof (d)) ? -1: 0;
+}
+
+int preprocessor_write_pch(struct Preprocessor *pp, const char *name) {
+	if (!pp->expanded) {
+		diagnose("`%s`: nothing was preprocessed to write.\n", name);
+		return -1;
+	}
+	const struct Interns *identifiers = &pp->identifiers;
+	const struct MacroTable *table = &pp->macros;
+	int ret = -1;
+	struct Bytes spellings = { 0 }, files = { 0 }, names = { 0 };
+	uint32_t *starts = malloc((identifiers->len + 1) * sizeof (*starts));
+	struct Macro *macros = malloc((table->len + 1) * sizeof (*macros));
+	struct PreprocessingToken *bodies = malloc((table->bodies.len + 1) * sizeof (*bodies));
+	struct PreprocessingToken *output = malloc((pp->output.len + 1) * sizeof (*output));
+	Stream stream = NULL;
+	if (!starts || !macros || !bodies || !output) goto oom;
+	for (ptrdiff_t i = 0; i < identifiers->len; i++) {
+		starts[i] = spellings.len;
+		if (append(&spellings, identifiers->interns[i]->str, identifiers->interns[i]->len)) goto oom;
+	}
+	starts[identifiers->len] = spellings.len;
+	// the macros there are, whose bodies are all that is left of those that were replaced
+	ptrdiff_t macro_len = 0, body_len = 0;
+	for (ptrdiff_t i = 0; i < table->cap; i++) {
+		struct Macro m = table->slots[i];
+		if (m.kind == CONTROL_LINE_NONE || m.kind == CONTROL_LINE_UNDEF) continue;
+		if (m.len) memcpy(bodies + body_len, table->bodies.items + m.body, m.len * sizeof (*bodies));
+		m.body = body_len;
+		for (; body_len < m.body + m.len; body_len++) {
+			if (spell(pp, &spellings, starts, &bodies[body_len])) goto oom;
+		}
+		macros[macro_len++] = m;
+	}
+	for (ptrdiff_t i = 0; i < pp->output.len; i++) {
+		output[i] = pp->output.items[i];
+		if (spell(pp, &spellings, starts, &output[i])) goto oom;
+	}
+	if (spellings.len > UINT32_MAX) {
+		diagnose("`%s`: too much to spell out for 32-bit offsets.\n", name);
+		goto fail;
+	}
+	const struct Headers *headers = &pp->headers;
+	if (depend(&files, &names, stream_name(pp->stream, NULL), headers->guard, headers->once)) goto fail;
+	for (ptrdiff_t i = 0; i < headers->len; i++) {
+		const struct Header *h = &headers->items[i];
+		if (depend(&files, &names, h->path, h->guard, h->once)) goto fail;
+	}
+	struct PchFile f = {
+		.token_size = sizeof (struct PreprocessingToken), .macro_size = sizeof (struct Macro),
+		.spelling_len = spellings.len, .string_len = identifiers->len, .macro_len = macro_len,
+		.body_len = body_len, .output_len = pp->output.len,
+		.file_len = files.len / sizeof (struct PchDependency), .name_len = names.len,
+	};
+	memcpy(f.magic, PCH_MAGIC, 8);
+	f.spellings = PP_ALIGN(sizeof (f));
+	f.starts = PP_ALIGN(f.spellings + spellings.len + C_STREAM_PADDING);
+	f.macros = PP_ALIGN(f.starts + (f.string_len + 1) * sizeof (*starts));
+	f.bodies = PP_ALIGN(f.macros + macro_len * sizeof (*macros));
+	f.output = PP_ALIGN(f.bodies + body_len * sizeof (*bodies));
+	f.files = PP_ALIGN(f.output + f.output_len * sizeof (*output));
+	f.names = PP_ALIGN(f.files + files.len);
+	f.total = f.names + names.len;
+	if (!(stream = stream_init(name, C_STREAM_WRITE|C_STREAM_BINARY))) {
+		diagnose("could not open `%s`.\n", name);
+		goto fail;
+	}
+	uint64_t at = 0;
+	bool ok = pp_section(stream, &at, 0, &f, sizeof (f))
+		&& pp_section(stream, &at, f.spellings, spellings.items, spellings.len)
+		&& pp_section(stream, &at, f.starts, starts, (f.string_len + 1) * sizeof (*starts))
+		&& pp_section(stream, &at, f.macros, macros, macro_len * sizeof (*macros))
+		&& pp_section(stream, &at, f.bodies, bodies, body_len * sizeof (*bodies))
+		&& pp_section(stream, &at, f.output, output, f.output_len * sizeof (*output))
+		&& pp_section(stream, &at, f.files, files.items, files.len)
+		&& pp_section(stream, &at, f.names, names.items, names.len);
+	stream_fini(stream);
+	if (!ok) {
+		diagnose("could not write `%s`.\n", name);
+		remove(name);
+		goto fail;
+	}
+	ret = 0;
+	goto fail;
+oom:
+	diagnose("could not allocate the precompiled header `%s`.\n", name);
+fail:
+	free(spellings.items);
+	free(files.items);
+	free(names.items);
+	free(starts);
+	free(macros);
+	free(bodies);
+	free(output);
+	return ret;
+}
+
+// whether `t`, as written by `preprocessor_write_pch`, is within what `f` has
+static bool valid(const struct PchFile *f, const struct PreprocessingToken *t) {
+	return (t->flags & PP_TOKEN_SPELLED) && t->offset <= f->spelling_len && t->len <= f->spelling_len - t->offset
+		&& (t->kind != PREPROCESSING_TOKEN_IDENTIFIER || t->id < f->string_len);
+}
+
+// the files that went into `f`: a stale one is an error, the others are to skip
+static int dependencies(struct Preprocessor *pp, const char *name, const uint8_t *map, const struct PchFile *f) {
+	const struct PchDependency *files = (const void *) (map + f->files);
+	for (uint64_t i = 0; i < f->file_len; i++) {
+		const struct PchDependency *d = &files[i];
+		char path[PP_MAX_PATH];
+		if (d->path > f->name_len || d->len > f->name_len - d->path || d->len >= PP_MAX_PATH) {
+			diagnose("`%s` is not a precompiled header.\n", name);
+			return -1;
+		}
+		memcpy(path, map + f->names + d->path, d->len);
+		path[d->len] = '\0';
+		struct stat st;
+		if (stat(path, &st) || (uint64_t) st.st_size != d->size
+				|| st.st_mtim.tv_sec != d->sec || st.st_mtim.tv_nsec != d->nsec) {
+			diagnose("`%s` is out of date, `%s` changed since.\n", name, path);
+			return -1;
+		}
+		struct Precompiled p = { .dev = st.st_dev, .ino = st.st_ino, .guard = d->guard, .once = d->once };
+		if (headers_precompiled(&pp->headers, p)) {
+			diagnose("could not allocate the files of `%s`.\n", name);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int preprocessor_include_pch(struct Preprocessor *pp, const char *name) {
+	if (pp->identifiers.len || pp->macros.len || pp->expanded) {
+		diagnose("`%s`: a precompiled header comes before anything else.\n", name);
+		return -1;
+	}
+	int fd = open(name, O_RDONLY);
+	if (fd < 0) {
+		diagnose("could not open `%s`.\n", name);
+		return -1;
+	}
+	struct stat st;
+	const uint8_t *map = MAP_FAILED;
+	if (!fstat(fd, &st) && st.st_size >= (off_t) sizeof (struct PchFile)) {
+		map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	close(fd);
+	if (map == MAP_FAILED) {
+		diagnose("`%s` is not a precompiled header.\n", name);
+		return -1;
+	}
+	const uint64_t total = st.st_size;
+	const struct PchFile *f = (const void *) map;
+	int ret = -1;
+	if (memcmp(f->magic, PCH_MAGIC, 8) || f->token_size != sizeof (struct PreprocessingToken)
+			|| f->macro_size != sizeof (struct Macro) || f->total != total || f->spelling_len > UINT32_MAX
+			|| !pp_fits(f->spellings, f->spelling_len + C_STREAM_PADDING, 1, total)
+			|| !pp_fits(f->starts, f->string_len + 1, sizeof (uint32_t), total)
+			|| !pp_fits(f->macros, f->macro_len, sizeof (struct Macro), total)
+			|| !pp_fits(f->bodies, f->body_len, sizeof (struct PreprocessingToken), total)
+			|| !pp_fits(f->output, f->output_len, sizeof (struct PreprocessingToken), total)
+			|| !pp_fits(f->files, f->file_len, sizeof (struct PchDependency), total)
+			|| !pp_fits(f->names, f->name_len, 1, total)) {
+		goto invalid;
+	}
+	if (dependencies(pp, name, map, f)) goto unmap;
+	// the spellings first, as they are, then the identifiers from them
+	if (!(pp->spellings.items = malloc(f->spelling_len + C_STREAM_PADDING))) goto oom;
+	memcpy(pp->spellings.items, map + f->spellings, f->spelling_len + C_STREAM_PADDING);
+	pp->spellings.len = f->spelling_len;
+	pp->spellings.cap = f->spelling_len + C_STREAM_PADDING;
+	const uint32_t *starts = (const void *) (map + f->starts);
+	for (uint64_t i = 0; i < f->string_len; i++) {
+		if (starts[i] > starts[i + 1] || starts[i + 1] > f->spelling_len) goto invalid;
+		const struct InternString *intern = intern_string(&pp->identifiers,
+				(const uint8_t *) pp->spellings.items + starts[i], starts[i + 1] - starts[i]);
+		if (!intern) goto oom;
+		if (intern->id != i) goto invalid;
+	}
+	const struct Macro *macros = (const void *) (map + f->macros);
+	const struct PreprocessingToken *bodies = (const void *) (map + f->bodies);
+	for (uint64_t i = 0; i < f->macro_len; i++) {
+		const struct Macro *m = &macros[i];
+		if (m->name >= f->string_len || m->body > f->body_len || m->len > f->body_len - m->body
+				|| m->kind < CONTROL_LINE_DEFINE || m->kind > CONTROL_LINE_DEFINE_ARGS_AND_VARARGS) {
+			goto invalid;
+		}
+		for (uint32_t k = 0; k < m->len; k++) {
+			if (!valid(f, &bodies[m->body + k])) goto invalid;
+		}
+		if (macro_define(&pp->macros, *m, bodies + m->body)) goto oom;
+	}
+	const struct PreprocessingToken *output = (const void *) (map + f->output);
+	for (uint64_t i = 0; i < f->output_len; i++) {
+		if (!valid(f, &output[i])) goto invalid;
+	}
+	if (f->output_len) {
+		if (!(pp->output.items = malloc(f->output_len * sizeof (*output)))) goto oom;
+		memcpy(pp->output.items, output, f->output_len * sizeof (*output));
+		pp->output.len = pp->output.cap = pp->prefix = f->output_len;
+	}
+	ret = 0;
+	goto unmap;
+invalid:
+	diagnose("`%s` is not a precompiled header.\n", name);
+	goto unmap;
+oom:
+	diagnose("could not allocate the precompiled header `%s`.\n", name);
+unmap:
+	munmap((void *) map, total);
+	return ret;
+}
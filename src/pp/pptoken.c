@@ -1,27 +1,113 @@
 #include "pp/pptoken.h"
 #include "pp/common.h"
 #include "pp/pre.h"
+#include "pp/scan.h"
 #include "stream/stream.h"
+#include <common/enums.h>
+#include <common/charclass.h>
+#include <uwu/scan.h>
+#include <common/log.h>
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+int preprocessor_phases(const char *view, ptrdiff_t size, const char **buf, long *len, bool *owned,
+		struct EditMap *edits) {
+	if (size > UINT32_MAX) {
+		diagnose("file too big for 32-bit offsets.\n");
+		return -1;
+	}
+	*len = size;
+	edit_map_init(edits);
+	if (is_internalized(view, size)) {
+		// nothing to rewrite, use the mapping as is
+		*buf = view;
+		*owned = false;
+		return 0;
+	}
+	// the tokenizer reads a word at a time, so the copy gets the padding of the view
+	char *copy = malloc(size + C_STREAM_PADDING);
+	if (!copy) goto edits;
+	memcpy(copy, view, size + C_STREAM_PADDING);
+	if (!(copy = internalize_mapped(copy, len, edits))) goto edits;
+	*buf = copy;
+	*owned = true;
+	return 0;
+edits:
+	edit_map_fini(edits);
+	return -1;
+}
+
+int preprocessor_map(const char *name, Stream *stream, const char **buf, long *len, bool *owned,
+		struct EditMap *edits) {
+	if (!(*stream = stream_init(name, C_STREAM_MMAP|C_STREAM_TEXT))) return -1;
+	ptrdiff_t size;
+	const char *view = (const char *) stream_view(*stream, &size);
+	if (view && !preprocessor_phases(view, size, buf, len, owned, edits)) return 0;
+	stream_fini(*stream);
+	return -1;
+}
 
 int preprocessor_init(struct Preprocessor *pp, const char *name) {
-	int ret = -1;
-	Stream stream = stream_init(name, C_STREAM_READ|C_STREAM_TEXT);
-	if (!stream) goto early;
-	long size = stream_size(stream);
-	pp->buf = malloc(size+1);
-	if (!pp->buf) goto io;
-	if (stream_read(stream, pp->buf, size) != size) goto io;
-	pp->buf[size] = '\0';
-	pp->len = size;
-	ret = (pp->buf = preprocessor_internalize(pp->buf, &pp->len)) ? 0: -1;
+	memset(&pp->lines, 0, sizeof (pp->lines));
+	memset(&pp->tokens, 0, sizeof (pp->tokens));
+	memset(&pp->output, 0, sizeof (pp->output));
+	pp->prefix = 0;
+	memset(&pp->text, 0, sizeof (pp->text));
+	memset(&pp->directive, 0, sizeof (pp->directive));
+	memset(&pp->conditionals, 0, sizeof (pp->conditionals));
+	memset(&pp->spellings, 0, sizeof (pp->spellings));
+	pp->expanded = false;
+	if (preprocessor_map(name, &pp->stream, &pp->buf, &pp->len, &pp->owned, &pp->edits)) return -1;
 	pp->cur = pp->buf;
-	// pp->pptoken.kind = PREPROCESSING_TOKEN_NONE;
-io:
-	stream_fini(stream);
-	if (ret != 0) free(pp->buf);
-early:
+	if (intern_init(&pp->identifiers)) goto map;
+	macro_table_init(&pp->macros);
+	if (expansion_init(&pp->expansion)) goto interns;
+	if (headers_init(&pp->headers, name)) goto expansion;
+	if (if_expressions_init(&pp->ifs)) goto headers;
+	return 0;
+headers:
+	headers_fini(&pp->headers);
+expansion:
+	expansion_fini(&pp->expansion);
+interns:
+	macro_table_fini(&pp->macros);
+	intern_fini(&pp->identifiers);
+map:
+	if (pp->owned) free((char *) pp->buf);
+	edit_map_fini(&pp->edits);
+	stream_fini(pp->stream);
+	return -1;
+}
+
+char *preprocessor_text(const struct Preprocessor *pp, ptrdiff_t *len) {
+	ptrdiff_t size = 1;
+	for (ptrdiff_t i = 0; i < pp->output.len; i++) size += pp->output.items[i].len + 1;
+	char *text = malloc(size + C_STREAM_PADDING), *p = text;
+	if (!text) {
+		diagnose("could not allocate %td bytes of output.\n", size);
+		return NULL;
+	}
+	for (ptrdiff_t i = 0; i < pp->output.len; i++) {
+		const struct PreprocessingToken *t = &pp->output.items[i];
+		if (i && (t->flags & PP_TOKEN_BOL)) *p++ = '\n';
+		else if (i && (t->flags & PP_TOKEN_SPACE)) *p++ = ' ';
+		memcpy(p, preprocessor_spelling(pp, t), t->len);
+		p += t->len;
+	}
+	if (pp->output.len) *p++ = '\n';
+	*len = p - text;
+	memset(p, 0, text + size + C_STREAM_PADDING - p);
+	return text;
+}
+
+static int write_output(const struct Preprocessor *pp, Stream stream) {
+	ptrdiff_t len;
+	char *text = preprocessor_text(pp, &len);
+	if (!text) return -1;
+	int ret = stream_write(stream, text, len) == len ? 0: -1;
+	free(text);
 	return ret;
 }
 
@@ -30,12 +116,332 @@ int preprocessor_fini(struct Preprocessor *pp, const char *name) {
 	if (!name) goto early;
 	Stream stream = stream_init(name, C_STREAM_WRITE|C_STREAM_TEXT);
 	if (!stream) goto early;
-	if (stream_write(stream, pp->buf, pp->len) != pp->len) goto w;
-	ret = 0;
-w:
+	if (pp->expanded) ret = write_output(pp, stream);
+	else ret = stream_write(stream, pp->buf, pp->len) == pp->len ? 0: -1;
 	stream_fini(stream);
 early:
-	free(pp->buf);
+	if (pp->owned) free((char *) pp->buf);
+	edit_map_fini(&pp->edits);
+	line_index_fini(&pp->lines);
+	headers_fini(&pp->headers);
+	if_expressions_fini(&pp->ifs);
+	expansion_fini(&pp->expansion);
+	macro_table_fini(&pp->macros);
+	intern_fini(&pp->identifiers);
+	free(pp->tokens.items);
+	free(pp->output.items);
+	free(pp->text.items);
+	free(pp->directive.items);
+	free(pp->conditionals.items);
+	free(pp->spellings.items);
+	stream_fini(pp->stream);
 	return ret;
 }
 
+// the lines of the view of `stream` are indexed on the first call
+static long source_line(Stream stream, struct LineIndex *lines, const struct EditMap *edits, long offset, long *column) {
+	if (!lines->starts) {
+		ptrdiff_t size;
+		const uint8_t *view = stream_view(stream, &size);
+		if (!view || line_index_init(lines)) return 0;
+		if (line_index_add(lines, view, size, 0)) {
+			line_index_fini(lines);
+			return 0;
+		}
+	}
+	return line_index_find(lines, edit_map_find(edits, offset), column);
+}
+
+long preprocessor_line(struct Preprocessor *pp, long offset, long *column) {
+	return source_line(pp->stream, &pp->lines, &pp->edits, offset, column);
+}
+
+void preprocessor_where(struct Preprocessor *pp, const struct PreprocessingToken *token) {
+	long column, line;
+	if (token->flags & PP_TOKEN_SPELLED) {
+		diagnose("%s: ", stream_name(pp->stream, NULL));
+		return;
+	}
+	if (!token->file) {
+		line = preprocessor_line(pp, token->offset, &column);
+		diagnose("%s:%ld:%ld: ", stream_name(pp->stream, NULL), line, column);
+		return;
+	}
+	struct Header *h = &pp->headers.items[token->file - 1];
+	line = source_line(h->stream, &h->lines, &h->edits, token->offset, &column);
+	diagnose("%s:%ld:%ld: ", h->path, line, column);
+}
+
+// the punctuator at `p` and its length, the longest that matches. TOKEN_NONE if there is none.
+static enum TokenKind punctuator(const uint8_t *p, int *len) {
+	*len = 1;
+	switch (*p) {
+	case '[': return TOKEN_LSQUARE_BRACKET;
+	case ']': return TOKEN_RSQUARE_BRACKET;
+	case '(': return TOKEN_LBRACKET;
+	case ')': return TOKEN_RBRACKET;
+	case '{': return TOKEN_LCURLY_BRACE;
+	case '}': return TOKEN_RCURLY_BRACE;
+	case '~': return TOKEN_TILDE;
+	case '?': return TOKEN_QUESTION;
+	case ';': return TOKEN_SEMICOLON;
+	case ',': return TOKEN_COMMA;
+	case '.':
+		if (p[1] == '.' && p[2] == '.') return *len = 3, TOKEN_ELLIPSIS;
+		return TOKEN_DOT;
+	case '-':
+		if (p[1] == '>') return *len = 2, TOKEN_ARROW;
+		if (p[1] == '-') return *len = 2, TOKEN_DECREMENT;
+		if (p[1] == '=') return *len = 2, TOKEN_MINUS_ASSIGN;
+		return TOKEN_MINUS;
+	case '+':
+		if (p[1] == '+') return *len = 2, TOKEN_INCREMENT;
+		if (p[1] == '=') return *len = 2, TOKEN_PLUS_ASSIGN;
+		return TOKEN_PLUS;
+	case '&':
+		if (p[1] == '&') return *len = 2, TOKEN_AND;
+		if (p[1] == '=') return *len = 2, TOKEN_AMPERSAND_ASSIGN;
+		return TOKEN_AMPERSAND;
+	case '|':
+		if (p[1] == '|') return *len = 2, TOKEN_OR;
+		if (p[1] == '=') return *len = 2, TOKEN_BAR_ASSIGN;
+		return TOKEN_BAR;
+	case '*':
+		if (p[1] == '=') return *len = 2, TOKEN_ASTERISK_ASSIGN;
+		return TOKEN_ASTERISK;
+	case '/':
+		if (p[1] == '=') return *len = 2, TOKEN_FSLASH_ASSIGN;
+		return TOKEN_FSLASH;
+	case '!':
+		if (p[1] == '=') return *len = 2, TOKEN_NOT_EQUAL;
+		return TOKEN_BANG;
+	case '=':
+		if (p[1] == '=') return *len = 2, TOKEN_EQUAL;
+		return TOKEN_ASSIGN;
+	case '^':
+		if (p[1] == '=') return *len = 2, TOKEN_CIRCUMFLEX_ASSIGN;
+		return TOKEN_CIRCUMFLEX;
+	case ':':
+		if (p[1] == '>') return *len = 2, TOKEN_RSQUARE_BRACKET; // digraph
+		return TOKEN_COLON;
+	case '#':
+		if (p[1] == '#') return *len = 2, TOKEN_HASH_HASH;
+		return TOKEN_HASH;
+	case '%':
+		if (p[1] == '=') return *len = 2, TOKEN_PERCENT_ASSIGN;
+		if (p[1] == '>') return *len = 2, TOKEN_RCURLY_BRACE; // digraph
+		if (p[1] == ':') {
+			if (p[2] == '%' && p[3] == ':') return *len = 4, TOKEN_HASH_HASH;
+			return *len = 2, TOKEN_HASH;
+		}
+		return TOKEN_PERCENT;
+	case '<':
+		if (p[1] == '<') {
+			if (p[2] == '=') return *len = 3, TOKEN_LSHIFT_ASSIGN;
+			return *len = 2, TOKEN_LSHIFT;
+		}
+		if (p[1] == '=') return *len = 2, TOKEN_LOWER_EQUAL;
+		if (p[1] == ':') return *len = 2, TOKEN_LSQUARE_BRACKET; // digraph
+		if (p[1] == '%') return *len = 2, TOKEN_LCURLY_BRACE; // digraph
+		return TOKEN_LOWER;
+	case '>':
+		if (p[1] == '>') {
+			if (p[2] == '=') return *len = 3, TOKEN_RSHIFT_ASSIGN;
+			return *len = 2, TOKEN_RSHIFT;
+		}
+		if (p[1] == '=') return *len = 2, TOKEN_GREATER_EQUAL;
+		return TOKEN_GREATER;
+	default:
+		return TOKEN_NONE;
+	}
+}
+
+// identifier characters, universal character names and UTF-8 sequences
+static const uint8_t *skip_identifier(const uint8_t *p) {
+	for (;;) {
+		p = skip_ident(p);
+		if (*p >= 0x80) p++;
+		else if (*p == '\\' && (p[1] == 'u' || p[1] == 'U')) p += 2;
+		else return p;
+	}
+}
+
+// a pp-number goes on with anything an identifier could, '.' and signed exponents
+static const uint8_t *skip_pp_number(const uint8_t *p) {
+	for (;;) {
+		p = skip_identifier(p);
+		if (*p == '.') p++;
+		else if ((*p == '+' || *p == '-') && (char_lower(p[-1]) == 'e' || char_lower(p[-1]) == 'p')) p++;
+		else return p;
+	}
+}
+
+// the end of the literal that `quote` opens at `p`, or NULL if the line ends first
+static const uint8_t *skip_literal(const uint8_t *p, const uint8_t *end, char quote, bool escapes) {
+	const char *e = (const char *) end;
+	for (const char *c = (const char *) p + 1;; c++) {
+		c = scan_bytes(c, e, quote, escapes ? '\\': quote, '\n', quote);
+		if (c == e || *c == '\n') return NULL;
+		if (*c == quote) return (const uint8_t *) c + 1;
+		// an escaped newline cannot be here after phase 2
+		if (++c == e) return NULL;
+	}
+}
+
+static bool push(struct PreprocessingTokens *tokens, struct PreprocessingToken token) {
+	if (tokens->len == tokens->cap) {
+		ptrdiff_t cap = tokens->cap ? tokens->cap * 2: 256;
+		struct PreprocessingToken *items = realloc(tokens->items, cap * sizeof (*items));
+		if (!items) return false;
+		tokens->items = items;
+		tokens->cap = cap;
+	}
+	tokens->items[tokens->len++] = token;
+	return true;
+}
+
+const char *preprocessor_token(struct Preprocessor *pp, const char *at, const char *stop,
+		bool header_name, struct PreprocessingToken *token) {
+	const uint8_t *p = (const uint8_t *) at, *end = (const uint8_t *) stop, *next = NULL;
+	int len;
+	token->id = 0;
+	if (header_name && (*p == '<' || *p == '"') && (next = skip_literal(p, end, *p == '<' ? '>': '"', false))) {
+		token->kind = PREPROCESSING_TOKEN_HEADER_NAME;
+	} else if (*p == '"' || *p == '\'' || (*p == 'L' && (p[1] == '"' || p[1] == '\''))) {
+		const uint8_t *quote = p + (*p == 'L');
+		next = skip_literal(quote, end, *quote, true);
+		token->kind = *quote == '"' ? PREPROCESSING_TOKEN_STRING_LITERAL: PREPROCESSING_TOKEN_CHARACTER_CONSTANT;
+		if (!next && quote != p) {
+			// just an L then, the quote comes next on its own
+			next = skip_identifier(p);
+			token->kind = PREPROCESSING_TOKEN_IDENTIFIER;
+		} else if (!next) {
+			// undefined, but it happens in groups that are skipped
+			next = p + 1;
+			token->kind = PREPROCESSING_TOKEN_ANYTHING;
+		}
+	} else if (char_is(*p, CHAR_DIGIT) || (*p == '.' && char_is(p[1], CHAR_DIGIT))) {
+		next = skip_pp_number(p + 1);
+		token->kind = PREPROCESSING_TOKEN_PP_NUMBER;
+	} else if (char_is(*p, CHAR_IDENT_START) || *p >= 0x80 || (*p == '\\' && (p[1] == 'u' || p[1] == 'U'))) {
+		next = skip_identifier(p);
+		token->kind = PREPROCESSING_TOKEN_IDENTIFIER;
+	} else if ((token->id = punctuator(p, &len)) != TOKEN_NONE) {
+		next = p + len;
+		token->kind = PREPROCESSING_TOKEN_PUNCTUATOR;
+	} else {
+		next = p + 1;
+		token->kind = PREPROCESSING_TOKEN_ANYTHING;
+	}
+	token->len = next - p;
+	if (token->kind == PREPROCESSING_TOKEN_IDENTIFIER) {
+		const struct InternString *intern = intern_string(&pp->identifiers, p, token->len);
+		if (!intern) return NULL;
+		token->id = intern->id;
+	}
+	return (const char *) next;
+}
+
+int preprocessor_tokenize(struct Preprocessor *pp) {
+	return preprocessor_decompose(pp, pp->buf, pp->len, 0, &pp->tokens);
+}
+
+// the tokens of [p, end) of `buf` after those `tokens` has. with `directive`, it stops where the
+// first line that is a directive ends, and `*directive` is the index of its '#', -1 if there was none.
+// where it stopped, NULL on allocation failure.
+static const char *decompose(struct Preprocessor *pp, const char *buf, const char *p, const char *end,
+		uint16_t file, struct PreprocessingTokens *tokens, ptrdiff_t *directive) {
+	uint8_t flags = PP_TOKEN_BOL;
+	// how far into `# include` the line is: 1 after the '#', 2 after `include`
+	int include = 0;
+	ptrdiff_t hash = -1;
+	while (p != end) {
+		if (char_is(*p, CHAR_SPACE)) {
+			const char *run = (const char *) skip_space((const uint8_t *) p);
+			if (memchr(p, '\n', run - p)) {
+				if (hash >= 0) break;
+				flags = PP_TOKEN_BOL;
+				include = 0;
+			}
+			flags |= PP_TOKEN_SPACE;
+			p = run;
+			continue;
+		}
+		struct PreprocessingToken token = { .offset = p - buf, .file = file, .flags = flags };
+		const char *next = preprocessor_token(pp, p, end, include == 2, &token);
+		if (!next) goto oom;
+		if (include == 1 && token.kind == PREPROCESSING_TOKEN_IDENTIFIER
+				&& token.len == 7 && !memcmp(p, "include", 7)) {
+			include = 2;
+		} else {
+			include = (flags & PP_TOKEN_BOL) && token.kind == PREPROCESSING_TOKEN_PUNCTUATOR && token.id == TOKEN_HASH;
+			if (include && directive) hash = tokens->len;
+		}
+		if (!push(tokens, token)) goto oom;
+		flags = 0;
+		p = next;
+	}
+	if (directive) *directive = hash;
+	return p;
+oom:
+	diagnose("could not grow the preprocessing tokens past %td.\n", tokens->len);
+	return NULL;
+}
+
+int preprocessor_decompose(struct Preprocessor *pp, const char *buf, long len, uint16_t file,
+		struct PreprocessingTokens *tokens) {
+	tokens->len = 0;
+	// about a token every 4 bytes, as for the lexer
+	if (!tokens->cap) {
+		tokens->items = malloc((len / 4 + 256) * sizeof (*tokens->items));
+		if (!tokens->items) {
+			diagnose("could not allocate the preprocessing tokens.\n");
+			return -1;
+		}
+		tokens->cap = len / 4 + 256;
+	}
+	return decompose(pp, buf, buf, buf + len, file, tokens, NULL) ? 0: -1;
+}
+
+const char *preprocessor_decompose_text(struct Preprocessor *pp, const char *buf, const char *p, const char *end,
+		uint16_t file, struct PreprocessingTokens *tokens, ptrdiff_t *hash) {
+	return decompose(pp, buf, p, end, file, tokens, hash);
+}
+
+// the directive name after the '#' or '%:' at `p`, into `*len`. NULL if it is no directive.
+static const char *directive_name(const char *p, long *len) {
+	if (*p == '%' && p[1] != ':') return NULL;
+	p += *p == '#' ? 1: 2;
+	// ## or %:%: is a punctuator of its own
+	if (*p == '#' || (*p == '%' && p[1] == ':')) return NULL;
+	while (*p != '\n' && char_is(*p, CHAR_SPACE)) p++;
+	const char *name = p;
+	while (char_is(*p, CHAR_IDENT)) p++;
+	*len = p - name;
+	return name;
+}
+
+const char *preprocessor_skip_group(const char *p, const char *end) {
+	const char *start = p;
+	long depth = 0;
+	// phases 1 to 3 left no comment and no literal spans lines, so a '#' with only
+	// whitespace before it on its line is a directive, and nothing else is
+	for (; (p = scan_bytes(p, end, '#', '%', '#', '%')) != end; p++) {
+		const char *line = p;
+		while (line != start && line[-1] != '\n' && char_is(line[-1], CHAR_SPACE)) line--;
+		if (line != start && line[-1] != '\n') continue;
+		long len;
+		const char *name = directive_name(p, &len);
+		if (!name) continue;
+		if ((len == 2 && !memcmp(name, "if", 2)) || (len == 5 && !memcmp(name, "ifdef", 5))
+				|| (len == 6 && !memcmp(name, "ifndef", 6))) {
+			depth++;
+		} else if (len == 5 && !memcmp(name, "endif", 5)) {
+			if (!depth--) return p;
+		} else if (!depth && len == 4 && (!memcmp(name, "else", 4) || !memcmp(name, "elif", 4))) {
+			return p;
+		}
+		p = name + len - 1;
+	}
+	return end;
+}
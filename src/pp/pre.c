@@ -1,41 +1,283 @@
 #include "pp/pre.h"
+#include "pp/scan.h"
+#include <common/log.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 #define WHITESPACE ' '
 
+static inline char trigraph(char c) {
+	switch (c) {
+	case '=' : return '#';
+	case '(' : return '[';
+	case '/' : return '\\';
+	case ')' : return ']';
+	case '\'': return '^';
+	case '<' : return '{';
+	case '!' : return '|';
+	case '>' : return '}';
+	case '-' : return '~';
+	default  : return '\0';
+	}
+}
+
+// next character of the output of phases 1 and 2, '\0' at the end.
+// `*at` is set to where it starts, after any splice before it.
+static inline char next_logical(const char **read, const char **at) {
+	const char *r = *read;
+	for (;;) {
+		char c = r[0];
+		int adv = 1;
+		if (c == '?' && r[1] == '?' && trigraph(r[2])) {
+			c = trigraph(r[2]);
+			adv = 3;
+		}
+		if (c == '\\' && r[adv] == '\n') {
+			r += adv + 1;
+			continue;
+		}
+		if (at) *at = r;
+		if (c) r += adv;
+		*read = r;
+		return c;
+	}
+}
+
+// moves [read, run) down to `*insert`, these bytes need no rewriting
+static inline const char *copy_run(char **insert, const char *read, const char *run) {
+	if (*insert != read) memmove(*insert, read, run - read);
+	*insert += run - read;
+	return run;
+}
+
+int edit_map_init(struct EditMap *map) {
+	if (!map) return -1;
+	memset(map, 0, sizeof (*map));
+	return 0;
+}
+
+void edit_map_fini(struct EditMap *map) {
+	if (!map) return;
+	free(map->out);
+	free(map->delta);
+	memset(map, 0, sizeof (*map));
+}
+
+// output from `out` on comes from `delta` bytes further in the input.
+// the deltas never go down, so most calls have nothing to add.
+static inline bool edit(struct EditMap *map, const char *buf, const char *out, const char *in) {
+	uint32_t delta = in - out;
+	if (!map || delta == (map->len ? map->delta[map->len - 1]: 0)) return true;
+	if (map->len && map->out[map->len - 1] == (uint32_t) (out - buf)) {
+		// nothing was output with the previous delta
+		map->delta[map->len - 1] = delta;
+		return true;
+	}
+	if (map->len == map->cap) {
+		ptrdiff_t cap = map->cap ? map->cap * 2: 64;
+		uint32_t *o = realloc(map->out, cap * sizeof (*o));
+		if (o) map->out = o;
+		uint32_t *d = realloc(map->delta, cap * sizeof (*d));
+		if (d) map->delta = d;
+		if (!o || !d) {
+			diagnose("could not grow the edit map past %td edits.\n", map->len);
+			return false;
+		}
+		map->cap = cap;
+	}
+	map->out[map->len] = out - buf;
+	map->delta[map->len] = delta;
+	map->len++;
+	return true;
+}
+
+long edit_map_find(const struct EditMap *map, long out) {
+	// the last edit at or before `out`
+	ptrdiff_t lo = 0, hi = map->len;
+	while (lo < hi) {
+		ptrdiff_t mid = lo + (hi - lo) / 2;
+		if (map->out[mid] <= out) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo ? out + map->delta[lo - 1]: out;
+}
+
 char *preprocessor_internalize(char *buf, long *len) {
-	buf = expand_trigraphs(buf, len);
-	buf = discard_bsnl(buf, len);
-	buf = discard_comments(buf, len);
+	return internalize(buf, len);
+}
+
+bool has_trigraphs_or_splices(const char *buf, long len) {
+	const char *end = buf + len;
+	for (const char *c = buf; (c = scan_bytes(c, end, '?', '\\', '?', '\\')) != end; c++) {
+		if (*c == '?' ? c[1] == '?': c[1] == '\n') return true;
+	}
+	return false;
+}
+
+// phases 1 to 3 in place on `buf`, which ends at its first '\0'.
+// unless `last`, the file goes on after `buf`, so whatever a comment, a literal or
+// a splice could join to what follows is left out: `*used` is set to the end of
+// the last newline outside of them, 0 if there is none, and the output stops there.
+// with a `map`, every change of offset between the input and the output is added to it.
+// returns the length of the output, or -1 on error.
+static long phases_1_to_3(char *buf, bool last, long *used, struct EditMap *map) {
+	// the output never outgrows the input, so it can be written in place
+	const char *read = buf, *end = buf + strlen(buf), *save, *at;
+	char *insert = buf, c;
+	// where the output can be cut, see above
+	const char *cut_read = buf;
+	char *cut_insert = buf;
+	// '?' and '\\' only need a closer look if they can start a trigraph or a splice.
+	// '\0' never occurs before `end`, so scanning for it instead costs nothing.
+	const bool plain = !has_trigraphs_or_splices(buf, end - buf);
+	const char qm = plain ? '\0': '?', bs = plain ? '\0': '\\';
+	for (;;) {
+		const char *run = scan_bytes(read, end, '"', '/', qm, bs);
+		if (!last) {
+			// a run has no backslash unless there is no splice at all,
+			// so its newlines are never spliced
+			const char *nl = run;
+			while (nl != read && nl[-1] != '\n') nl--;
+			if (nl != read) {
+				cut_read = nl;
+				cut_insert = insert + (nl - read);
+			}
+		}
+		if (!edit(map, buf, insert, read)) return -1;
+		read = copy_run(&insert, read, run);
+		if (!(c = next_logical(&read, &at))) break;
+		if (!edit(map, buf, insert, at)) return -1;
+		*insert++ = c;
+		switch (c) {
+		case '"': // we need to find the end, a non-escaped double quote
+			for (;;) {
+				if (!edit(map, buf, insert, read)) return -1;
+				read = copy_run(&insert, read, scan_bytes(read, end, '"', '\\', '\n', qm));
+				if (!(c = next_logical(&read, &at)) || c == '\n') break;
+				if (!edit(map, buf, insert, at)) return -1;
+				*insert++ = c;
+				if (c == '"') break;
+				if (c != '\\') continue;
+				if (!(c = next_logical(&read, &at))) break;
+				if (!edit(map, buf, insert, at)) return -1;
+				*insert++ = c;
+			}
+			if (c != '"') {
+				if (!c && !last) goto part;
+				diagnose("unterminated string literal.\n");
+				return -1;
+			}
+			break;
+		case '/': // could be a comment
+			save = read;
+			c = next_logical(&read, NULL);
+			if (c == '/') {
+				insert[-1] = WHITESPACE;
+				// the newline stays
+				do {
+					save = read = scan_bytes(read, end, '\n', bs, qm, '\n');
+				} while ((c = next_logical(&read, NULL)) && c != '\n');
+				read = save;
+			} else if (c == '*') {
+				insert[-1] = WHITESPACE;
+				// no trigraph or splice has a '*' in it, so every '*' is a real one
+				for (;;) {
+					read = scan_bytes(read, end, '*', '*', '*', '*');
+					if (read == end) {
+						if (!last) goto part;
+						diagnose("file ends mid-comment.\n");
+						return -1;
+					}
+					save = ++read;
+					if (next_logical(&read, NULL) == '/') break;
+					read = save;
+				}
+			} else {
+				read = save;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	if (!last) goto part;
+	// a splice removes at least 2 characters, so if there is one at the end,
+	// its bytes are still there and have not been overwritten
+	if (read - buf >= 2 && read[-1] == '\n' && (read[-2] == '\\' ||
+			(read - buf >= 4 && read[-2] == '/' && read[-3] == '?' && read[-4] == '?'))) {
+		diagnose("file ends in a backslash-newline.\n");
+	}
+	if (used) *used = read - buf;
+	return insert - buf;
+part:
+	*used = cut_read - buf;
+	return cut_insert - buf;
+}
+
+char *internalize(char *buf, long *len) {
+	return internalize_mapped(buf, len, NULL);
+}
+
+char *internalize_mapped(char *buf, long *len, struct EditMap *map) {
+	long l = phases_1_to_3(buf, true, NULL, map);
+	if (l < 0) {
+		if (len) *len = 0;
+		free(buf);
+		return NULL;
+	}
+	if (len) *len = l;
+	buf[l] = '\0';
 	return buf;
 }
 
-char *expand_trigraphs(char *buf, long *len) {
-	char *insert, *read;
-	for (insert = read = buf; *read; insert++) {
-		*insert = *read;
-		if (*read++ != '?') continue;
-		if (*read++ != '?') continue;
-		switch (*read++) {
-#define CASE(a, b) case a: *insert = b; break;
-		CASE('=', '#')
-		CASE('(', '[')
-		CASE('/', '\\')
-		CASE(')', ']')
-		CASE('\'', '^')
-		CASE('<', '{')
-		CASE('!', '|')
-		CASE('>', '}')
-		CASE('-', '~')
-#undef CASE
+long internalize_part(char *buf, bool last, long *used) {
+	long l = phases_1_to_3(buf, last, used, NULL);
+	if (l >= 0) buf[l] = '\0';
+	return l;
+}
+
+bool is_internalized(const char *buf, long len) {
+	const char *end = buf + len;
+	for (const char *c = buf; (c = scan_bytes(c, end, '?', '\\', '/', '"')) != end; c++) {
+		switch (*c) {
+		case '?':
+			if (c[1] == '?') return false;
+			break;
+		case '\\':
+			if (c[1] == '\n') return false;
+			break;
+		case '/':
+			if (c[1] == '/' || c[1] == '*') return false;
+			break;
+		case '"':
+			for (c++; (c = scan_bytes(c, end, '\n', '"', '?', '\\')) != end && *c != '\n' && *c != '"'; c++) {
+				if (*c == '?' && c[1] == '?') return false;
+				if (*c != '\\') continue;
+				if (c[1] == '\n') return false;
+				if (c[1] == '"' || c[1] == '\\') c++;
+			}
+			// unterminated, let `discard_comments` complain
+			if (c == end || *c != '"') return false;
+			break;
 		default:
-			memmove(insert, read-3, 3);
-			insert += 2;
 			break;
 		}
 	}
+	return true;
+}
+
+char *expand_trigraphs(char *buf, long *len) {
+	const char *read = buf, *end = buf + strlen(buf);
+	char *insert = buf;
+	while ((read = copy_run(&insert, read, scan_bytes(read, end, '?', '?', '?', '?'))) != end) {
+		*insert = *read++;
+		if (read[0] == '?' && trigraph(read[1])) {
+			*insert = trigraph(read[1]);
+			read += 2;
+		}
+		insert++;
+	}
 	long l=insert-buf;
 	if (len) *len = l;
 	buf[l] = '\0';
@@ -43,15 +285,16 @@ char *expand_trigraphs(char *buf, long *len) {
 }
 
 char *discard_bsnl(char *buf, long *len) {
-	char *insert, *read;
-	for (insert = read = buf; *read; insert++) {
-		*insert = *read;
-		if (*read++ != '\\') continue;
-		if (*read   != '\n') continue;
-		insert--;
-		read++;
+	const char *read = buf, *end = buf + strlen(buf);
+	char *insert = buf;
+	while ((read = copy_run(&insert, read, scan_bytes(read, end, '\\', '\\', '\\', '\\'))) != end) {
+		if (read[1] != '\n') {
+			*insert++ = *read++;
+			continue;
+		}
+		read += 2;
 		if (*read == '\0') {
-			printf("file ends in a backslash-newline.\n");
+			diagnose("file ends in a backslash-newline.\n");
 		}
 	}
 	long l=insert-buf;
@@ -61,20 +304,20 @@ char *discard_bsnl(char *buf, long *len) {
 }
 
 char *discard_comments(char *buf, long *len) {
-	// return buf;
-	char *insert, *read;
-	for (insert = read = buf; *read;) {
+	const char *read = buf, *end = buf + strlen(buf);
+	char *insert = buf;
+	while ((read = copy_run(&insert, read, scan_bytes(read, end, '"', '/', '"', '/'))) != end) {
 		*insert++ = *read;
 		switch (*read++) {
 		case '"': // we need to find the end, a non-escaped double quote
 			for (; *read && *read != '\n' && *read != '"';) {
 				*insert++ = *read;
 				if (*read++ != '\\') continue;
-				*insert++ = *read;
-				if (*read++ != '"' ) continue;
+				if (!*read) break;
+				*insert++ = *read++;
 			}
 			if (*read != '"') {
-				printf("unterminated string literal.\n");
+				diagnose("unterminated string literal.\n");
 				goto error;
 			}
 			*insert++ = *read++;
@@ -82,23 +325,23 @@ char *discard_comments(char *buf, long *len) {
 		case '/': // could be a comment
 			if (*read == '/') {
 				insert[-1] = WHITESPACE;
-				while (*read && *read != '\n') read++;
+				read = scan_bytes(read, end, '\n', '\n', '\n', '\n');
 			} else if (*read == '*') {
 				insert[-1] = WHITESPACE;
 				read++;
 			loop:
-				while (*read && *read != '*') read++;
+				read = scan_bytes(read, end, '*', '*', '*', '*');
 				if (*read == '\0') {
-					printf("file ends mid-comment.\n");
+					diagnose("file ends mid-comment.\n");
 					goto error;
 				}
 				read++;
 				if (*read != '/') goto loop;
 				read++;
-			} else continue;
+			}
 			break;
 		default:
-			continue;
+			break;
 		}
 	}
 	long l = insert-buf;
@@ -110,4 +353,3 @@ error:
 	free(buf);
 	return NULL;
 }
-
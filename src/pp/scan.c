@@ -0,0 +1,61 @@
+#include "pp/scan.h"
+#include <common/dispatch.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+const char *scan_bytes(const char *p, const char *end, char a, char b, char c, char d) {
+	static byte_scanner scanner = NULL;
+	return DISPATCH(scanner, resolve_byte_scanner)(p, end, a, b, c, d);
+}
+
+const char *scan_bytes_scalar(const char *p, const char *end, char a, char b, char c, char d) {
+	for (; p != end; p++) {
+		if (*p == a || *p == b || *p == c || *p == d) break;
+	}
+	return p;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// nothing is read outside of [p, end), the last few bytes are left to the scalar version
+
+const char *scan_bytes_sse2(const char *p, const char *end, char a, char b, char c, char d) {
+	const __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b);
+	const __m128i vc = _mm_set1_epi8(c), vd = _mm_set1_epi8(d);
+	for (; end - p >= 16; p += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) p);
+		__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, vb)),
+				_mm_or_si128(_mm_cmpeq_epi8(x, vc), _mm_cmpeq_epi8(x, vd)));
+		int mask = _mm_movemask_epi8(m);
+		if (mask) return p + __builtin_ctz(mask);
+	}
+	return scan_bytes_scalar(p, end, a, b, c, d);
+}
+
+__attribute__((target("avx2")))
+const char *scan_bytes_avx2(const char *p, const char *end, char a, char b, char c, char d) {
+	const __m256i va = _mm256_set1_epi8(a), vb = _mm256_set1_epi8(b);
+	const __m256i vc = _mm256_set1_epi8(c), vd = _mm256_set1_epi8(d);
+	for (; end - p >= 32; p += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) p);
+		__m256i m = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, vb)),
+				_mm256_or_si256(_mm256_cmpeq_epi8(x, vc), _mm256_cmpeq_epi8(x, vd)));
+		uint32_t mask = _mm256_movemask_epi8(m);
+		if (mask) return p + __builtin_ctz(mask);
+	}
+	return scan_bytes_sse2(p, end, a, b, c, d);
+}
+
+byte_scanner resolve_byte_scanner(void) {
+	return CPU_SUPPORTS("avx2") ? &scan_bytes_avx2: &scan_bytes_sse2;
+}
+
+#else
+
+byte_scanner resolve_byte_scanner(void) {
+	return &scan_bytes_scalar;
+}
+
+#endif
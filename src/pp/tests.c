@@ -1,11 +1,702 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <assert.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "pp/tests.h"
 #include "pp/pp.h"
+#include "pp/pre.h"
+#include "pp/pptoken.h"
+#include "pp/scan.h"
+#include "pp/cache.h"
+#include "pp/pch.h"
+#include <common/enums.h>
+#include <uwu/lex.h>
+#include <bench.h>
+#include <tests.h>
+
+static uint32_t rng = 2463534242;
+
+static const struct {
+	const char *name;
+	byte_scanner fun;
+	const char *cpu;
+} scanners[] = {
+	{ "scalar", &scan_bytes_scalar, NULL },
+#if defined(__x86_64__)
+	{ "sse2"  , &scan_bytes_sse2  , NULL },
+	{ "avx2"  , &scan_bytes_avx2  , "avx2" },
+#endif
+};
+#define NUM_SCANNERS ((int) (sizeof (scanners) / sizeof (*scanners)))
+
+static void scan_test(void) {
+	char buf[256];
+	for (int i = 0; i < 20000; i++) {
+		// sparse hits at random offsets and lengths
+		long len = test_random(&rng) % sizeof (buf), start = test_random(&rng) % 8;
+		if (start > len) start = len;
+		for (long k = 0; k < len; k++) {
+			buf[k] = test_random(&rng) % 64 ? (char) ('a' + test_random(&rng) % 26): "?\\/\""[test_random(&rng) % 4];
+		}
+		const char *expect = scan_bytes_scalar(buf + start, buf + len, '?', '\\', '/', '"');
+		for (int v = 1; v < NUM_SCANNERS; v++) {
+			if (!test_cpu_supports(scanners[v].cpu)) continue;
+			assert(scanners[v].fun(buf + start, buf + len, '?', '\\', '/', '"') == expect);
+		}
+		(void) expect;
+	}
+	printf("scan: %d scanners agree\n", NUM_SCANNERS);
+}
+
+static char *three_passes(char *buf, long *len) {
+	buf = expand_trigraphs(buf, len);
+	buf = discard_bsnl(buf, len);
+	return discard_comments(buf, len);
+}
+
+// every byte of the output must map to where it comes from: the same byte,
+// the start of a trigraph, or the start of a comment it replaces
+static void check_edits(const char *src) {
+	static const char trigraphs[] = "=#([/\\)]'^<{!|>}-~";
+	long n = strlen(src), l;
+	struct EditMap map;
+	if (edit_map_init(&map)) return;
+	char *b = malloc(n + 1);
+	if (!b) goto end;
+	memcpy(b, src, n + 1);
+	if (!(b = internalize_mapped(b, &l, &map))) goto end;
+	for (long i = 0, prev = -1; i < l; prev = edit_map_find(&map, i++)) {
+		long m = edit_map_find(&map, i);
+		assert(m > prev && m < n);
+		if (b[i] == src[m]) continue;
+		const char *t = src[m] == '?' && src[m + 1] == '?' ? strchr(trigraphs, src[m + 2]): NULL;
+		assert((t && (t - trigraphs) % 2 == 0 && t[1] == b[i]) || (b[i] == ' ' && src[m] == '/'));
+		(void) prev, (void) t;
+	}
+end:
+	edit_map_fini(&map);
+	free(b);
+}
+
+// `internalize` must give the same output as the 3 phases one after the other
+static void check_internalize(const char *src) {
+	long n = strlen(src), l1, l2;
+	char *a = malloc(n + 1), *b = malloc(n + 1);
+	assert(a && b);
+	memcpy(a, src, n + 1);
+	memcpy(b, src, n + 1);
+	a = three_passes(a, &l1);
+	b = internalize(b, &l2);
+	assert(!a == !b && l1 == l2);
+	assert(!a || memcmp(a, b, l1 + 1) == 0);
+	free(a);
+	free(b);
+	check_edits(src);
+}
+
+static void internalize_test(void) {
+	static const char *const cases[] = {
+		"int a; // comment\\\n still comment\nint b;\n",
+		"a /* b *\\\n/ c\n",
+		"\?\?=define X \?\?( \?\?) \?\?< \?\?> \?\?! \?\?' \?\?-\n",
+		"\?\?\?=\?\? \? \?\?\? \?\n",
+		"a \?\?/\nb\n",
+		"\"a\\\"/* not a comment */\" /**/ /***/ /*/ */\n",
+		"\"\?\?/\"\"\n",
+		"x = a / b /\\\n/ c;\n",
+		"/\\\n* spliced *\\\n/\n",
+	};
+	for (size_t i = 0; i < sizeof (cases) / sizeof (*cases); i++) {
+		check_internalize(cases[i]);
+	}
+	// no double quotes, and a tail that closes any comment left open,
+	// so that no diagnostic gets printed. every other input has no trigraph
+	// nor splice in it, and long plain runs make it past the vector loops.
+	static const char *const alphabets[] = { "?=/*\\\n(!a ", "=/*\n(!abcdefghijklmnop " };
+	char src[160];
+	for (int i = 0; i < 20000; i++) {
+		const char *alphabet = alphabets[i % 2];
+		int n = test_random(&rng) % 120, size = strlen(alphabet);
+		for (int k = 0; k < n; k++) {
+			src[k] = alphabet[test_random(&rng) % size];
+		}
+		strcpy(src + n, " \n*/\n");
+		check_internalize(src);
+	}
+	printf("internalize matches the 3 passes\n");
+}
+
+// positions in the output point back to the lines they were on
+static int line_test(void) {
+	const char *f = "line_test.c";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	fputs("int a; /* one\ntwo */ int\\\nb;\n\?\?=x // three\\\nfour\n  y;\n", out);
+	fclose(out);
+	struct Preprocessor pp;
+	int err = -1;
+	if (preprocessor_init(&pp, f)) goto end;
+	static const struct { char c; long line, column; } at[] = {
+		{ 'b', 3, 1 }, { '#', 4, 1 }, { 'x', 4, 4 }, { 'y', 6, 3 },
+	};
+	for (size_t i = 0; i < sizeof (at) / sizeof (*at); i++) {
+		const char *c = strchr(pp.buf, at[i].c);
+		long column, line = preprocessor_line(&pp, c - pp.buf, &column);
+		assert(line == at[i].line && column == at[i].column);
+		(void) line;
+	}
+	preprocessor_fini(&pp, NULL);
+	err = 0;
+end:
+	remove(f);
+	return err;
+}
+
+static void check_tokens(const char *src, const char *const *texts, const uint8_t *kinds, const uint8_t *flags, int n) {
+	const char *f = "pptoken_test.c";
+	FILE *out = fopen(f, "w");
+	assert(out);
+	fputs(src, out);
+	fclose(out);
+	struct Preprocessor pp;
+	bool read = !preprocessor_init(&pp, f);
+	int err = read ? preprocessor_tokenize(&pp): -1;
+	assert(!err && pp.tokens.len == n);
+	for (int i = 0; !err && i < n && i < pp.tokens.len; i++) {
+		const struct PreprocessingToken *t = &pp.tokens.items[i];
+		bool same = t->kind == kinds[i] && t->flags == flags[i]
+			&& t->len == strlen(texts[i]) && !memcmp(pp.buf + t->offset, texts[i], t->len);
+		// the same identifier always gets the same id
+		for (int k = 0; k < i && t->kind == PREPROCESSING_TOKEN_IDENTIFIER; k++) {
+			const struct PreprocessingToken *u = &pp.tokens.items[k];
+			same = same && (u->kind != t->kind || (u->id == t->id) == !strcmp(texts[k], texts[i]));
+		}
+		if (!same) printf("pp token %d is not `%s`\n", i, texts[i]);
+		assert(same);
+	}
+	if (read) preprocessor_fini(&pp, NULL);
+	remove(f);
+}
+
+static void pptoken_test(void) {
+	enum {
+		H = PREPROCESSING_TOKEN_HEADER_NAME, I = PREPROCESSING_TOKEN_IDENTIFIER,
+		N = PREPROCESSING_TOKEN_PP_NUMBER, C = PREPROCESSING_TOKEN_CHARACTER_CONSTANT,
+		S = PREPROCESSING_TOKEN_STRING_LITERAL, P = PREPROCESSING_TOKEN_PUNCTUATOR,
+		A = PREPROCESSING_TOKEN_ANYTHING,
+		_ = 0, W = PP_TOKEN_SPACE, B = PP_TOKEN_BOL | PP_TOKEN_SPACE,
+	};
+	static const char src[] =
+		"#include <stdio.h>\n"
+		"# include \"a\\b.h\" /* c */\n"
+		"#define f(x) #x ## L'a' %:%: <: :>\n"
+		"x = a+++b >>= 1.e+5 .5 0x1p-3 L\"s\" 'c\\'' @ `\n"
+		"  #if\n"
+		"foo'bar\n"
+		"L'\n"
+		"a<b> \"<c>\"\n";
+	static const char *const texts[] = {
+		"#", "include", "<stdio.h>",
+		"#", "include", "\"a\\b.h\"",
+		"#", "define", "f", "(", "x", ")", "#", "x", "##", "L'a'", "%:%:", "<:", ":>",
+		"x", "=", "a", "++", "+", "b", ">>=", "1.e+5", ".5", "0x1p-3", "L\"s\"", "'c\\''", "@", "`",
+		"#", "if",
+		"foo", "'", "bar",
+		"L", "'",
+		"a", "<", "b", ">", "\"<c>\"",
+	};
+	static const uint8_t kinds[] = {
+		P, I, H,
+		P, I, H,
+		P, I, I, P, I, P, P, I, P, C, P, P, P,
+		I, P, I, P, P, I, P, N, N, N, S, C, A, A,
+		P, I,
+		I, A, I,
+		I, A,
+		I, P, I, P, S,
+	};
+	static const uint8_t flags[] = {
+		PP_TOKEN_BOL, _, W,
+		B, W, W,
+		B, _, W, _, _, _, W, _, W, W, W, W, W,
+		B, W, W, _, _, _, W, W, W, W, W, W, W, W,
+		B, _,
+		B, _, _,
+		B, _,
+		B, _, _, _, W,
+	};
+	_Static_assert(sizeof (texts) / sizeof (*texts) == sizeof (kinds), "one kind per token");
+	_Static_assert(sizeof (flags) == sizeof (kinds), "one set of flags per token");
+	check_tokens(src, texts, kinds, flags, sizeof (kinds));
+	printf("pp tokens: %zu as expected\n", sizeof (kinds));
+}
+
+// every token of the lexer must start and end where a preprocessing token does
+static void check_against_lexer(const struct Preprocessor *pp) {
+	struct Lexer lexer;
+	int err = lexer_init_buffer(&lexer, (const uint8_t *) pp->buf, pp->len);
+	assert(!err);
+	if (err) return;
+	ptrdiff_t i = 0;
+	while (lexer_next(&lexer) == LEXER_VALID) {
+		while (i < pp->tokens.len && pp->tokens.items[i].offset < lexer.token.offset) i++;
+		assert(i < pp->tokens.len && pp->tokens.items[i].offset == lexer.token.offset);
+		assert(pp->tokens.items[i].len == lexer.token.len);
+	}
+	lexer_fini(&lexer);
+}
+
+static void write_source(const char *f, const char *src) {
+	FILE *out = fopen(f, "w");
+	assert(out);
+	fputs(src, out);
+	fclose(out);
+}
+
+// `src` must expand to the tokens of `expected`, or fail to if `expected` is NULL
+static void check_expansion(const char *src, const char *expected) {
+	const char *f = "macro_test.c", *g = "macro_expected.c";
+	struct Preprocessor pp, want;
+	write_source(f, src);
+	int err = preprocessor_init(&pp, f);
+	assert(!err);
+	if (err) {
+		remove(f);
+		return;
+	}
+	err = preprocess(&pp);
+	remove(f);
+	if (!expected) {
+		assert(err);
+		preprocessor_fini(&pp, NULL);
+		return;
+	}
+	assert(!err);
+	write_source(g, expected);
+	bool read = !preprocessor_init(&want, g);
+	int wanted = read ? preprocessor_tokenize(&want): -1;
+	remove(g);
+	assert(!wanted);
+	for (ptrdiff_t i = 0; !wanted && (i < pp.output.len || i < want.tokens.len); i++) {
+		const struct PreprocessingToken *t = &pp.output.items[i], *u = &want.tokens.items[i];
+		bool same = i < pp.output.len && i < want.tokens.len && t->len == u->len
+			&& !memcmp(preprocessor_spelling(&pp, t), preprocessor_spelling(&want, u), t->len);
+		if (!same) printf("token %td of `%s` differs\n", i, expected);
+		assert(same);
+	}
+	preprocessor_fini(&pp, NULL);
+	if (read) preprocessor_fini(&want, NULL);
+}
+
+static void hideset_test(void) {
+	struct Hidesets sets;
+	int err = hidesets_init(&sets);
+	assert(!err);
+	if (err) return;
+	long a = hideset_add(&sets, 0, 5), b = hideset_add(&sets, 0, 3), ab = hideset_union(&sets, a, b);
+	assert(a > 0 && b > 0 && a != b && ab > b);
+	// equal sets are the same set whichever way they are made
+	long ba = hideset_union(&sets, b, a), ab5 = hideset_add(&sets, b, 5), ab3 = hideset_add(&sets, ab, 3);
+	assert(ba == ab && ab5 == ab && ab3 == ab);
+	(void) ba, (void) ab5, (void) ab3;
+	assert(hideset_intersection(&sets, ab, a) == a && hideset_intersection(&sets, a, b) == 0);
+	assert(hideset_contains(&sets, ab, 3) && hideset_contains(&sets, ab, 5) && !hideset_contains(&sets, ab, 4));
+	assert(!hideset_contains(&sets, 0, 0) && sets.len == 4);
+	hidesets_fini(&sets);
+}
+
+static void macro_test(void) {
+	hideset_test();
+	// the examples of C99 6.10.3.5, but for the #include
+	check_expansion(
+		"#define x 3\n"
+		"#define f(a) f(x * (a))\n"
+		"#undef x\n"
+		"#define x 2\n"
+		"#define g f\n"
+		"#define z z[0]\n"
+		"#define h g(~\n"
+		"#define m(a) a(w)\n"
+		"#define w 0,1\n"
+		"#define t(a) a\n"
+		"#define p() int\n"
+		"#define q(x) x\n"
+		"#define r(x,y) x ## y\n"
+		"#define str(x) # x\n"
+		"f(y+1) + f(f(z)) % t(t(g)(0) + t)(1);\n"
+		"g(x+(3,4)-w) | h 5) & m\n"
+		"(f)^m(m);\n"
+		"p() i[q()] = { q(1), r(2,3), r(4,), r(,5), r(,) };\n"
+		"char c[2][6] = { str(hello), str() };\n",
+		"f(2 * (y+1)) + f(2 * (f(2 * (z[0])))) % f(2 * (0)) + t(1);\n"
+		"f(2 * (2+(3,4)-0,1)) | f(2 * (~ 5)) & f(2 * (0,1))^m(0,1);\n"
+		"int i[] = { 1, 23, 4, 5, };\n"
+		"char c[2][6] = { \"hello\", \"\" };\n");
+	check_expansion(
+		"#define str(s) # s\n"
+		"#define xstr(s) str(s)\n"
+		"#define debug(s, t) printf(\"x\" # s \"= %d, x\" # t \"= %s\", \\\n"
+		" x ## s, x ## t)\n"
+		"#define glue(a, b) a ## b\n"
+		"#define xglue(a, b) glue(a, b)\n"
+		"#define HIGHLOW \"hello\"\n"
+		"#define LOW LOW \", world\"\n"
+		"debug(1, 2);\n"
+		"fputs(str(strncmp(\"abc\\0d\", \"abc\", '\\4') // this goes away\n"
+		" == 0) str(: @\\n), s);\n"
+		"glue(HIGH, LOW);\n"
+		"xglue(HIGH, LOW)\n",
+		"printf(\"x\" \"1\" \"= %d, x\" \"2\" \"= %s\", x1, x2);\n"
+		"fputs(\"strncmp(\\\"abc\\\\0d\\\", \\\"abc\\\", '\\\\4') == 0\" \": @\\n\", s);\n"
+		"\"hello\";\n"
+		"\"hello\" \", world\"\n");
+	check_expansion(
+		"#define t(x,y,z) x ## y ## z\n"
+		"int j[] = { t(1,2,3), t(,4,5), t(6,,7), t(8,9,),\n"
+		" t(10,,), t(,11,), t(,,12), t(,,) };\n",
+		"int j[] = { 123, 45, 67, 89, 10, 11, 12, };\n");
+	check_expansion(
+		"#define hash_hash # ## #\n"
+		"#define mkstr(a) # a\n"
+		"#define in_between(a) mkstr(a)\n"
+		"#define join(c, d) in_between(c hash_hash d)\n"
+		"char p[] = join(x, y);\n",
+		"char p[] = \"x ## y\";\n");
+	check_expansion(
+		"#define debug(...) fprintf(stderr, __VA_ARGS__)\n"
+		"#define showlist(...) puts(#__VA_ARGS__)\n"
+		"#define report(test, ...) ((test)?puts(#test):\\\n"
+		" printf(__VA_ARGS__))\n"
+		"debug(\"Flag\");\n"
+		"debug(\"X = %d\\n\", x);\n"
+		"showlist(The first, second, and third items.);\n"
+		"report(x>y, \"x is %d but y is %d\", x, y);\n",
+		"fprintf(stderr, \"Flag\" );\n"
+		"fprintf(stderr, \"X = %d\\n\", x );\n"
+		"puts( \"The first, second, and third items.\" );\n"
+		"((x>y)?puts(\"x>y\"): printf(\"x is %d but y is %d\", x, y));\n");
+	// 6.10.3.4: the f of the result was not part of the invocation of g
+	check_expansion("#define f(a) a*g\n#define g(a) f(a)\nf(2)(9)\n", "2*9*g\n");
+	check_expansion("#define x x\n#define y x y\nx y\n", "x x y\n");
+	check_expansion("#define f(a, b) b a\nf(1,\n2) f((1, 2), [3])\n", "2 1 [3] (1, 2)\n");
+	check_expansion("#define E\n#define F(x) [x]\n#define L (\nF E (1) F L 2) F\n", "F (1) F ( 2) F\n");
+	check_expansion("#define cat(a, b) a ## b\n#define xy 42\ncat(x, y) cat(x, z)\n", "42 xz\n");
+	check_expansion("#define h x ## y\n#define a 1\n#define a 1\nh a\n#undef a\na\n", "xy 1 a\n");
+	check_expansion("#define v(a, ...) a: __VA_ARGS__\nv(1) v(1, 2, 3)\n", "1: 1: 2, 3\n");
+	check_expansion("#define foo() bar\nfoo() foo( )\n", "bar bar\n");
+	check_expansion("#define cat(a, b) a ## b\ncat(+, -)\n", NULL);
+	check_expansion("#define f(a, b) a\nf(1)\n", NULL);
+	check_expansion("#define f(a) a\nf(1\n", NULL);
+	check_expansion("#define f(x) #y\n", NULL);
+	check_expansion("#define f(x) ## x\n", NULL);
+	check_expansion("#define f(x, x) x\n", NULL);
+	check_expansion("#define f __VA_ARGS__\n", NULL);
+	printf("macros: expanded as expected\n");
+}
+
+static void conditional_test(void) {
+	check_expansion("#define A\n#ifdef A\n1\n#ifndef A\n2\n#else\n3\n#endif\n#else\n4\n#endif\n", "1 3\n");
+	// what is left out is not evaluated, only its nesting counts
+	check_expansion("#ifdef B\n#if (\n#else\n#error no\n#endif\nx\n#else\ny\n#endif\n", "y\n");
+	check_expansion("#ifndef B\n#undef B\n#define B 1\n#endif\nB\n", "1\n");
+	check_expansion("#ifdef A\n", NULL);
+	check_expansion("#else\n", NULL);
+	check_expansion("#ifdef A\n#else\n#else\n#endif\n", NULL);
+	check_expansion("#ifdef\n#endif\n", NULL);
+	// a group that is left out may hold what would be errors anywhere else
+	check_expansion("#define f(x) x\n#ifdef A\nf(\n#include \"none.h\"\n#bad\n#endif\nok\n", "ok\n");
+	printf("conditionals: as expected\n");
+}
+
+static void check_if(const char *condition, bool in) {
+	char src[256];
+	snprintf(src, sizeof (src), "#if %s\nin\n#else\nout\n#endif\n", condition);
+	check_expansion(src, in ? "in\n": "out\n");
+}
+
+static void if_test(void) {
+	check_if("1 + 2 * 3 == 7 && (1 + 2) * 3 == 9 && 7 % 4 - 1 == 2", true);
+	check_if("-1 < 0 && !(-1 < 0u) && -1 > 0u", true);
+	// 6.10.1p4: intmax_t and uintmax_t, whatever the suffix
+	check_if("(-1 >> 63) == -1 && (0xFFFFFFFFFFFFFFFF >> 63) == 1 && 18446744073709551615 == -1", true);
+	check_if("(1 << 62) * 2 < 0 && 1L << 63 == 1ULL << 63 && 0x7FFFFFFFFFFFFFFF + 1 < 0", true);
+	check_if("(1 ? -1 : 0u) > 0 && (0 ? 0u : -1) > 0 && (1 ? -1 : 0) < 0", true);
+	check_if("'a' == 97 && '\\0' == 0 && L'\\377' > 0 && '\\n' == 10", true);
+	check_if("undefined_name == 0 && !true", true);
+	check_if("0 && 1 / 0", false);
+	check_if("1 || 1 / 0", true);
+	check_if("0 ? 1 / 0 : 1", true);
+	check_if("(1, 0)", false);
+	check_if("010 == 8 && 0x10 == 16 && 10u == 10", true);
+	check_expansion("#define A\n#if defined A && defined(A) && !defined B\nyes\n#endif\n", "yes\n");
+	check_expansion("#define V 5\n#define F(x) (x * 2)\n#if F(V) == 10 ? V - 5 == 0 : 0\nyes\n#endif\n", "yes\n");
+	check_expansion("#define X 2\n#if X == 1\none\n#elif X == 2\ntwo\n#elif 1 / 0\n#else\nelse\n#endif\n", "two\n");
+	check_expansion("#if 0\n#elif 0\n#else\nelse\n#endif\n", "else\n");
+	check_expansion("#if\n#endif\n", NULL);
+	check_expansion("#if 1 +\n#endif\n", NULL);
+	check_expansion("#if 1 / 0\n#endif\n", NULL);
+	check_expansion("#if (1\n#endif\n", NULL);
+	check_expansion("#if 1)\n#endif\n", NULL);
+	check_expansion("#if 1 ? 2\n#endif\n", NULL);
+	check_expansion("#if 1.5\n#endif\n", NULL);
+	check_expansion("#if 1u2\n#endif\n", NULL);
+	check_expansion("#if \"s\"\n#endif\n", NULL);
+	check_expansion("#if defined\n#endif\n", NULL);
+	check_expansion("#if defined(A\n#endif\n", NULL);
+	// an expression compiles once for each shape, whatever its operands are
+	const char *f = "if_test.c";
+	write_source(f, "#define V 3\n#if V >= 4\n#endif\n#if 7 >= 4\n#endif\n#if 9u >= 4\n#endif\n#if 1 >= 2\n#endif\n");
+	struct Preprocessor pp;
+	int err = preprocessor_init(&pp, f);
+	assert(!err);
+	if (!err) {
+		err = preprocess(&pp);
+		assert(!err && pp.ifs.shapes.len == 2 && pp.ifs.hits == 2);
+		preprocessor_fini(&pp, NULL);
+	}
+	remove(f);
+	printf("#if: evaluated as expected\n");
+}
+
+static void skip_test(void) {
+	// each stops at the first `@` less one, or at the end if there is none
+	static const char *const groups[] = {
+		"x\n#if a\n#else\n#endif\n  @%:else\ny\n",
+		"a # endif\n'#endif'\n\"#else\"\n##endif\n#define e #endif\n\t@# endif\n",
+		"#ifdef X\n#  ifndef Y\n#elif\n#endif\n#endif\n@#elif 1\n",
+		"#ifdefX\n#elifdef\n#elsewhere\n@#endif\n",
+		"#if 0\n#endif\n#if 1\n",
+		"%:%:endif\n%%\n % %: endif\n \t@%: endif\n",
+	};
+	for (size_t i = 0; i < sizeof (groups) / sizeof (*groups); i++) {
+		char buf[128];
+		const char *at = strchr(groups[i], '@');
+		size_t len = strlen(groups[i]);
+		memcpy(buf, groups[i], len + 1);
+		if (at) memmove(buf + (at - groups[i]), at + 1, len - (at - groups[i]));
+		const char *end = buf + strlen(buf), *stop = preprocessor_skip_group(buf, end);
+		assert(stop == (at ? buf + (at - groups[i]): end));
+		(void) stop;
+	}
+	printf("skip: %zu groups as expected\n", sizeof (groups) / sizeof (*groups));
+}
+
+// the spellings of the output of `pp`, one space apart
+static void output_text(const struct Preprocessor *pp, char *out, size_t cap) {
+	size_t len = 0;
+	for (ptrdiff_t i = 0; i < pp->output.len; i++) {
+		const struct PreprocessingToken *t = &pp->output.items[i];
+		assert(len + t->len + 1 < cap);
+		if (len + t->len + 1 >= cap) break;
+		if (i) out[len++] = ' ';
+		memcpy(out + len, preprocessor_spelling(pp, t), t->len);
+		len += t->len;
+	}
+	out[len] = '\0';
+}
+
+// the output of `f` as text, with the headers cached in `cache` unless NULL
+static int include_output(const char *f, const char *cache, char *out, size_t cap, struct Headers *after) {
+	struct Preprocessor pp;
+	out[0] = '\0';
+	int err = preprocessor_init(&pp, f);
+	assert(!err);
+	if (err) return err;
+	err = preprocessor_search(&pp, "inc_dir");
+	if (!err && cache) err = preprocessor_cache(&pp, cache);
+	assert(!err);
+	if (!err) err = preprocess(&pp);
+	if (!err) output_text(&pp, out, cap);
+	after->len = pp.headers.len;
+	after->found.len = pp.headers.found.len;
+	after->paths.len = pp.headers.paths.len;
+	after->cached = pp.headers.cached;
+	preprocessor_fini(&pp, NULL);
+	return err;
+}
+
+static void include_test(void) {
+	static const char *const files[][2] = {
+		{ "inc_guard.h", "#ifndef GUARD\n#define GUARD\nint g;\n#endif\n" },
+		{ "inc_once.h", "#pragma once\nint o;\n" },
+		{ "inc_twice.h", "#ifndef TWICE\n#define TWICE\n#endif\nint t;\n" },
+		{ "inc_loop.h", "#include \"inc_loop.h\"\n" },
+		{ "inc_dir/inner.h", "#include \"../inc_guard.h\"\n#include \"../inc_twice.h\"\nint i;\n" },
+		{ "inc_dir/plain.h", "int p;\n" },
+		{ "include_test.c",
+			"#pragma once\n"
+			"#include \"include_test.c\"\n"
+			"#include \"inc_guard.h\"\n"
+			"#include \"inc_once.h\"\n"
+			"#include \"inc_twice.h\"\n"
+			"#include \"inc_dir/inner.h\"\n"
+			"#include \"inc_dir/../inc_once.h\"\n"
+			"#define H(x) <x.h>\n"
+			"#include H(plain)\n"
+			"#include \"plain.h\"\n"
+			"#ifdef GUARD\nyes\n#endif\n" },
+	};
+	char out[256];
+	struct Headers after;
+	int err = mkdir("inc_dir", 0755);
+	assert(!err);
+	for (size_t i = 0; i < sizeof (files) / sizeof (*files); i++) write_source(files[i][0], files[i][1]);
+	err = include_output("include_test.c", NULL, out, sizeof (out), &after);
+	assert(!err && !strcmp(out, "int g ; int o ; int t ; int t ; int i ; int p ; int p ; yes"));
+	// a guarded header or one with #pragma once is loaded once, whatever path leads to it
+	assert(after.len == 6 && after.found.len == after.paths.len);
+	write_source("include_test.c", "#include \"inc_loop.h\"\n");
+	err = include_output("include_test.c", NULL, out, sizeof (out), &after);
+	assert(err);
+	write_source("include_test.c", "#include \"inc_none.h\"\n");
+	err = include_output("include_test.c", NULL, out, sizeof (out), &after);
+	assert(err);
+	write_source("include_test.c", "#include inc_once.h\n");
+	err = include_output("include_test.c", NULL, out, sizeof (out), &after);
+	assert(err);
+	(void) err;
+	for (size_t i = 0; i < sizeof (files) / sizeof (*files); i++) remove(files[i][0]);
+	rmdir("inc_dir");
+	printf("includes: as expected\n");
+}
+
+// a header in the cache is the same as read from its file, and a cache file that does not fit is replaced
+static void cache_test(void) {
+	static const char *const files[][2] = {
+		{ "cache_a.h", "#ifndef A_H\n#define A_H\n#define TWICE(x) x x\n"
+			"#if 0\n'unterminated\n#include <nothing.h>\n#else\nint a\?\?(2\?\?);\n#endif\n#endif\n" },
+		{ "cache_b.h", "#include \"cache_a.h\"\nlong spl\\\nit = TWICE(b);\n# /**/ define B 1\n" },
+		{ "cache_test.c", "#include \"cache_b.h\"\n#include \"cache_a.h\"\n#if B\nTWICE(split)\n#endif\n" },
+	};
+	char plain[256], out[256], name[64];
+	struct Headers after;
+	int err = mkdir("cache_dir", 0755);
+	assert(!err);
+	for (size_t i = 0; i < sizeof (files) / sizeof (*files); i++) write_source(files[i][0], files[i][1]);
+	err = include_output("cache_test.c", NULL, plain, sizeof (plain), &after);
+	assert(!err && !strcmp(plain, "int a [ 2 ] ; long split = b b ; split split"));
+	// cold, then warm
+	err = include_output("cache_test.c", "cache_dir", out, sizeof (out), &after);
+	assert(!err && !strcmp(out, plain) && after.cached == 0);
+	err = include_output("cache_test.c", "cache_dir", out, sizeof (out), &after);
+	assert(!err && !strcmp(out, plain) && after.cached == 2);
+	// a cache file is named after the contents of its header
+	snprintf(name, sizeof (name), "cache_dir/%016" PRIx64 ".ppc", cache_hash(files[0][1], strlen(files[0][1])));
+	write_source(name, "not a cache file");
+	err = include_output("cache_test.c", "cache_dir", out, sizeof (out), &after);
+	assert(!err && !strcmp(out, plain) && after.cached == 1);
+	err = include_output("cache_test.c", "cache_dir", out, sizeof (out), &after);
+	assert(!err && !strcmp(out, plain) && after.cached == 2);
+	// nor is it used for another header with the same hash
+	struct CacheFile header;
+	FILE *file = fopen(name, "r+b");
+	assert(file);
+	if (file && fread(&header, sizeof (header), 1, file) == 1 && !fseek(file, header.source, SEEK_SET)) fputc('/', file);
+	if (file) fclose(file);
+	err = include_output("cache_test.c", "cache_dir", out, sizeof (out), &after);
+	assert(!err && !strcmp(out, plain) && after.cached == 1);
+	remove(name);
+	snprintf(name, sizeof (name), "cache_dir/%016" PRIx64 ".ppc", cache_hash(files[1][1], strlen(files[1][1])));
+	err = remove(name);
+	assert(!err);
+	for (size_t i = 0; i < sizeof (files) / sizeof (*files); i++) remove(files[i][0]);
+	err = rmdir("cache_dir");
+	assert(!err);
+	(void) err;
+	printf("header cache: as expected\n");
+}
+
+// `f` preprocessed into the precompiled header `pch`
+static int pch_write(const char *f, const char *pch) {
+	struct Preprocessor pp;
+	int err = preprocessor_init(&pp, f);
+	assert(!err);
+	if (err) return err;
+	err = preprocess(&pp);
+	if (!err) err = preprocessor_write_pch(&pp, pch);
+	preprocessor_fini(&pp, NULL);
+	return err;
+}
+
+// the output of `f` as text, after the precompiled header `pch`
+static int pch_output(const char *f, const char *pch, char *out, size_t cap) {
+	struct Preprocessor pp;
+	out[0] = '\0';
+	int err = preprocessor_init(&pp, f);
+	assert(!err);
+	if (err) return err;
+	err = preprocessor_include_pch(&pp, pch);
+	if (!err) err = preprocess(&pp);
+	if (!err) output_text(&pp, out, cap);
+	preprocessor_fini(&pp, NULL);
+	return err;
+}
+
+// a precompiled header is as though its file were included first
+static void pch_test(void) {
+	static const char *const files[][2] = {
+		{ "pch_dep.h", "#pragma once\ntypedef long dep;\n#define DEP 2\n" },
+		{ "pch_prefix.h", "#ifndef PREFIX_H\n#define PREFIX_H\n#include \"pch_dep.h\"\n"
+			"#define SQUARE(x) ((x) * (x))\n#define STR(...) #__VA_ARGS__\n#define GONE\n#undef GONE\n"
+			"#define CAT(a, b) a ## b\nint CAT(pre, fix) = SQUARE(DEP);\n#endif\n" },
+		{ "pch_test.c", "#include \"pch_prefix.h\"\n#include \"pch_dep.h\"\n#ifdef GONE\nno\n#endif\n"
+			"int y = SQUARE(DEP) + sizeof STR(a  b, CAT(x, y));\n" },
+		{ "pch_include.c", "#include \"pch_prefix.h\"\n#include \"pch_test.c\"\n" },
+		{ "pch_other.h", "int other;\n" },
+		{ "pch_guard.h", "#ifndef GUARD_H\n#define GUARD_H\n#endif\n" },
+		{ "pch_guarded.c", "#ifdef GUARD_H\nyes\n#endif\n" },
+		{ "pch_again.c", "#include \"pch_dep.h\"\n#include \"pch_other.h\"\n#include \"pch_dep.h\"\n#include \"pch_other.h\"\n" },
+	};
+	char out[256], expected[256];
+	for (size_t i = 0; i < sizeof (files) / sizeof (*files); i++) write_source(files[i][0], files[i][1]);
+	int err = pch_write("pch_prefix.h", "pch_prefix.pch");
+	assert(!err);
+	err = include_output("pch_include.c", NULL, expected, sizeof (expected), &(struct Headers) { 0 });
+	assert(!err && !strcmp(expected, "typedef long dep ; int prefix = ( ( 2 ) * ( 2 ) ) ; "
+		"int y = ( ( 2 ) * ( 2 ) ) + sizeof \"a b, CAT(x, y)\" ;"));
+	err = pch_output("pch_test.c", "pch_prefix.pch", out, sizeof (out));
+	assert(!err && !strcmp(out, expected));
+	// a path that it read leads to its file the next time as well, and not to the one tried after it
+	err = pch_output("pch_again.c", "pch_prefix.pch", out, sizeof (out));
+	assert(!err && !strcmp(out, "typedef long dep ; int prefix = ( ( 2 ) * ( 2 ) ) ; int other ; int other ;"));
+	// one whose macros have no replacement lists at all
+	err = pch_write("pch_guard.h", "pch_guard.pch");
+	assert(!err);
+	err = pch_output("pch_guarded.c", "pch_guard.pch", out, sizeof (out));
+	assert(!err && !strcmp(out, "yes"));
+	remove("pch_guard.pch");
+	// once a file that went into it changes, it is no more
+	write_source("pch_dep.h", "#pragma once\ntypedef long dep;\n#define DEP 30\n");
+	err = pch_output("pch_test.c", "pch_prefix.pch", out, sizeof (out));
+	assert(err);
+	write_source("pch_prefix.pch", "not a precompiled header, but long enough to look like one at first. "
+		"not a precompiled header, but long enough to look like one at first. not a precompiled header.");
+	err = pch_output("pch_test.c", "pch_prefix.pch", out, sizeof (out));
+	assert(err);
+	(void) err;
+	remove("pch_prefix.pch");
+	for (size_t i = 0; i < sizeof (files) / sizeof (*files); i++) remove(files[i][0]);
+	printf("precompiled header: as expected\n");
+}
 
 int pp_test(void) {
 	printf("pp:\n");
+	scan_test();
+	internalize_test();
+	if (line_test()) return -1;
+	pptoken_test();
+	macro_test();
+	conditional_test();
+	if_test();
+	skip_test();
+	include_test();
+	cache_test();
+	pch_test();
 	const char *f = "foo.c";
 	const char *o = "foo.i";
 	struct Preprocessor pp;
@@ -21,6 +712,13 @@ int pp_test(void) {
 		return -1;
 	}
 	printf("%s", pp.buf);
+	// only what translation did not leave out was decomposed
+	if (preprocessor_tokenize(&pp)) {
+		preprocessor_fini(&pp, NULL);
+		return -1;
+	}
+	printf("%td pp tokens, %td identifiers\n", pp.tokens.len, pp.identifiers.len);
+	check_against_lexer(&pp);
 	if ((err = preprocessor_fini(&pp, o))) {
 		fprintf(stderr, "could not write preprocessor output to `%s`.\n", o);
 		return -1;
@@ -28,3 +726,260 @@ int pp_test(void) {
 	return 0;
 }
 
+
+static int bench_internalize(const char *name, const char *line) {
+	const long size = strlen(line), reps = 8 * 1024 * 1024 / size, n = size * reps;
+	char *src = malloc(n + 1), *buf = malloc(n + 1);
+	if (!src || !buf) {
+		free(src);
+		free(buf);
+		return -1;
+	}
+	for (long i = 0; i < reps; i++) memcpy(src + i * size, line, size);
+	src[n] = '\0';
+	double t0 = bench_now();
+	memcpy(buf, src, n + 1);
+	double t1 = bench_now();
+	buf = three_passes(buf, NULL);
+	double t2 = bench_now();
+	memcpy(buf, src, n + 1);
+	double t3 = bench_now();
+	buf = internalize(buf, NULL);
+	double t4 = bench_now();
+	struct EditMap map;
+	edit_map_init(&map);
+	memcpy(buf, src, n + 1);
+	double t5 = bench_now();
+	buf = internalize_mapped(buf, NULL, &map);
+	double t6 = bench_now();
+	printf("phases 1-3 on %-7s %ld bytes: memcpy %7.1f MB/s, 3 passes %7.1f MB/s, fused %7.1f MB/s, "
+			"mapped %7.1f MB/s, %td edits\n", name, n, n / (t1 - t0 + 1e-9) / 1e6, n / (t2 - t1 + 1e-9) / 1e6,
+			n / (t4 - t3 + 1e-9) / 1e6, n / (t6 - t5 + 1e-9) / 1e6, map.len);
+	edit_map_fini(&map);
+	free(src);
+	free(buf);
+	return 0;
+}
+
+// decomposing once, then going over the tokens the way directives and macros will
+static int bench_tokenize(const char *line) {
+	const char *f = "pptoken_bench.c";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	for (int i = 0; i < 100000; i++) fputs(line, out);
+	fclose(out);
+	struct Preprocessor pp;
+	int err = -1;
+	if (preprocessor_init(&pp, f)) goto end;
+	double t0 = bench_now();
+	err = preprocessor_tokenize(&pp);
+	double t1 = bench_now();
+	const int rounds = 20;
+	long directives = 0;
+	for (int r = 0; r < rounds; r++) {
+		for (ptrdiff_t i = 0; i < pp.tokens.len; i++) {
+			const struct PreprocessingToken *t = &pp.tokens.items[i];
+			directives += (t->flags & PP_TOKEN_BOL) && t->kind == PREPROCESSING_TOKEN_PUNCTUATOR && t->id == TOKEN_HASH;
+		}
+	}
+	double t2 = bench_now();
+	printf("pp tokens: %td (%ld directives), %zu bytes each, decompose %7.2f Mtok/s, rescan %8.2f Mtok/s\n",
+			pp.tokens.len, directives / rounds, sizeof (*pp.tokens.items),
+			pp.tokens.len / (t1 - t0 + 1e-9) / 1e6, rounds * pp.tokens.len / (t2 - t1 + 1e-9) / 1e6);
+	preprocessor_fini(&pp, NULL);
+end:
+	remove(f);
+	return err;
+}
+
+// a large group for another platform around a few lines that are in
+static int bench_skip(const char *line) {
+	const char *f = "skip_bench.c";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	fputs("#ifdef OTHER_PLATFORM\n", out);
+	for (int i = 0; i < 100000; i++) {
+		fputs(line, out);
+		if (i % 1000 == 0) fputs("#  if defined(OTHER_ARCH)\n#    define WIDTH 64\n#  endif\n", out);
+	}
+	fputs("#else\nint in;\n#endif\n", out);
+	fclose(out);
+	struct Preprocessor pp;
+	int err = -1;
+	if (preprocessor_init(&pp, f)) goto end;
+	double t0 = bench_now();
+	err = preprocess(&pp);
+	double t1 = bench_now();
+	if (!err) err = preprocessor_tokenize(&pp);
+	double t2 = bench_now();
+	printf("skip: %ld bytes into %td pp tokens, %8.2f MB/s, decomposing them all is %7.2f MB/s\n",
+			pp.len, pp.output.len, pp.len / (t1 - t0 + 1e-9) / 1e6, pp.len / (t2 - t1 + 1e-9) / 1e6);
+	preprocessor_fini(&pp, NULL);
+end:
+	remove(f);
+	return err;
+}
+
+// the same few conditions over and over, as headers have them
+static int bench_if(void) {
+	const char *f = "if_bench.c";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	fputs("#define __GNUC__ 12\n#define VERSION(a, b) ((a) << 16 | (b))\n#define LIBC VERSION(2, 36)\n", out);
+	for (int i = 0; i < 100000; i++) {
+		fprintf(out, "#if defined(__GNUC__) && __GNUC__ >= %d && LIBC >= VERSION(2, %d)\nx;\n#endif\n"
+				"#if !defined(NDEBUG) || (%d & 0x0F) == 3\n#endif\n", i % 16, i % 40, i);
+	}
+	fclose(out);
+	struct Preprocessor pp;
+	int err = -1;
+	if (preprocessor_init(&pp, f)) goto end;
+	double t0 = bench_now();
+	err = preprocess(&pp);
+	double t1 = bench_now();
+	printf("#if: %d expressions, %7.2f M/s, %td shapes, %td found compiled\n",
+			200000, 200000 / (t1 - t0 + 1e-9) / 1e6, pp.ifs.shapes.len, pp.ifs.hits);
+	preprocessor_fini(&pp, NULL);
+end:
+	remove(f);
+	return err;
+}
+
+// macros that nest, paste and stringize, invoked on every line
+static int bench_expand(void) {
+	const char *f = "macro_bench.c";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	fputs("#define WIDGET(w, i) ((w)->parts[i] + 0x1Fu)\n"
+		"#define MAX(a, b) ((a) > (b) ? (a): (b))\n"
+		"#define COUNT 16\n"
+		"#define CAT(a, b) a ## b\n"
+		"#define STR(...) #__VA_ARGS__\n"
+		"#define LOG(...) log_line(__FILE__, STR(__VA_ARGS__), __VA_ARGS__)\n", out);
+	for (int i = 0; i < 100000; i++) {
+		fputs("x = MAX(WIDGET(w, COUNT), CAT(lim, it)) + sizeof STR(n); LOG(x, COUNT);\n", out);
+	}
+	fclose(out);
+	struct Preprocessor pp;
+	int err = -1;
+	if (preprocessor_init(&pp, f)) goto end;
+	double t0 = bench_now();
+	err = preprocessor_tokenize(&pp);
+	double t1 = bench_now();
+	if (!err) err = preprocess(&pp);
+	double t2 = bench_now();
+	// `preprocess` decomposes as it goes, which is taken out
+	double expand = (t2 - t1) - (t1 - t0);
+	printf("expand: %td pp tokens into %td, %7.2f Mtok/s out, %td hidesets, %td bytes of spellings\n",
+			pp.tokens.len, pp.output.len, pp.output.len / (expand > 0 ? expand: 1e-9) / 1e6,
+			pp.expansion.hidesets.len, pp.spellings.len);
+	preprocessor_fini(&pp, NULL);
+end:
+	remove(f);
+	return err;
+}
+
+// a large header read through, then written to the cache, then mapped from it
+static int bench_cache(const char *line) {
+	const char *h = "cache_bench.h", *f = "cache_bench.c", *dir = "cache_bench";
+	FILE *out = fopen(h, "w");
+	if (!out) return -1;
+	fputs("#ifndef CACHE_BENCH_H\n#define CACHE_BENCH_H\n", out);
+	for (int i = 0; i < 100000; i++) fputs(line, out);
+	fputs("#endif\n", out);
+	fclose(out);
+	write_source(f, "#include \"cache_bench.h\"\n");
+	int err = mkdir(dir, 0755);
+	double t[4];
+	long len = 0;
+	char name[64] = "";
+	for (int i = 0; !err && i < 3; i++) {
+		struct Preprocessor pp;
+		if ((err = preprocessor_init(&pp, f))) break;
+		if (i && (err = preprocessor_cache(&pp, dir))) goto fini;
+		const struct PreprocessingToken at = { 0 };
+		t[i] = bench_now();
+		err = preprocessor_include(&pp, &at, h, strlen(h), true) == 1 ? 0: -1;
+		struct Header *header = &pp.headers.items[0];
+		// without the cache, the tokens are made as the header is translated
+		if (!err && !i) err = preprocessor_decompose(&pp, header->buf, header->len, 1, &header->tokens);
+		t[i + 1] = bench_now();
+		t[i] = t[i + 1] - t[i];
+		if (!err) {
+			ptrdiff_t size;
+			const char *view = (const char *) stream_view(header->stream, &size);
+			snprintf(name, sizeof (name), "%s/%016" PRIx64 ".ppc", dir, cache_hash(view, size));
+			len = size;
+		}
+		if (!err && i == 2 && pp.headers.cached != 1) err = -1;
+fini:
+		preprocessor_fini(&pp, NULL);
+	}
+	if (!err) {
+		printf("header cache: %ld bytes to pp tokens, %8.2f MB/s read, %8.2f MB/s into the cache, %8.2f MB/s from it\n",
+				len, len / (t[0] + 1e-9) / 1e6, len / (t[1] + 1e-9) / 1e6, len / (t[2] + 1e-9) / 1e6);
+	}
+	remove(name);
+	rmdir(dir);
+	remove(h);
+	remove(f);
+	return err;
+}
+
+// a prefix header of 40000 lines, preprocessed, then loaded from what that left
+static int bench_pch(void) {
+	const char *f = "pch_bench.h", *pch = "pch_bench.pch";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	for (int i = 0; i < 10000; i++) {
+		fprintf(out, "#define WIDGET_%d(w) ((w)->parts[%d] + 0x1Fu)\n", i, i % 64);
+		fprintf(out, "struct widget_%d { long total; struct widget_%d *next; };\n", i, i);
+		fprintf(out, "int frob_%d(struct widget_%d *w, long n);\n", i, i);
+		fprintf(out, "static inline long part_%d(struct widget_%d *w) { return WIDGET_%d(w); }\n", i, i, i);
+	}
+	fclose(out);
+	struct Preprocessor pp;
+	int err = -1;
+	if (preprocessor_init(&pp, f)) goto end;
+	double t0 = bench_now();
+	err = preprocess(&pp);
+	double t1 = bench_now();
+	if (!err) err = preprocessor_write_pch(&pp, pch);
+	preprocessor_fini(&pp, NULL);
+	if (err || (err = preprocessor_init(&pp, f))) goto end;
+	double t2 = bench_now();
+	err = preprocessor_include_pch(&pp, pch);
+	double t3 = bench_now();
+	if (!err) {
+		printf("pch: %td macros, %td identifiers, %td pp tokens, %8.2f ms to preprocess, %8.2f ms to load\n",
+				pp.macros.len, pp.identifiers.len, pp.output.len, (t1 - t0) * 1e3, (t3 - t2) * 1e3);
+	}
+	preprocessor_fini(&pp, NULL);
+end:
+	remove(pch);
+	remove(f);
+	return err;
+}
+
+int pp_bench(void) {
+	printf("pp:\n");
+	// a bit of everything phases 1 to 3 have to deal with
+	static const char tricky[] = "int x = a / b; /* block */ s = \"str\\\" \?\?/\n\"; // line\\\n"
+		"y \?\?= z \?\?( 1 \?\?); \\\n\n";
+	// what most code looks like, no trigraph and no splice
+	static const char plain[] = "static int frobnicate(struct Widget *widget, long count) {\n"
+		"\t// a comment about what comes next\n"
+		"\tfor (long i = 0; i < count; i++) widget->total += widget->parts[i] / 2;\n"
+		"\tprintf(\"%ld widgets\\n\", count); /* and a block comment */\n"
+		"\treturn widget->total > 0 ? 0: -1;\n}\n\n";
+	if (bench_internalize("tricky", tricky)) return -1;
+	if (bench_internalize("plain", plain)) return -1;
+	if (bench_tokenize("#define WIDGET(w, i) ((w)->parts[i] + 0x1Fu)\n"
+			"static int frob(struct Widget *w, long n) { return n > 0 ? WIDGET(w, n - 1): -1; }\n")) return -1;
+	if (bench_expand()) return -1;
+	if (bench_if()) return -1;
+	if (bench_skip("static int frob(struct Widget *w, long n) { return n > 0 ? w->parts[n - 1]: -1; }\n")) return -1;
+	if (bench_cache("static int frob(struct Widget *w, long n) { return n > 0 ? w->parts[n - 1]: -1; } \?\?=\n")) return -1;
+	if (bench_pch()) return -1;
+	return 0;
+}
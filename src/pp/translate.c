@@ -1,10 +1,470 @@
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
 
 #include "pp/translate.h"
 #include "pp/pre.h"
 #include "pp/pptoken.h"
+#include "pp/macro.h"
+#include <common/enums.h>
+#include <common/log.h>
 
-int preprocess(struct Preprocessor *pp) {
-	return pp->buf ? 0: -1;
+// C99 asks for 127 at least
+#define MAX_PARAMS (256)
+// what a header name made by macros can be
+#define MAX_HEADER_NAME (1024)
+
+enum ConditionalState {
+	CONDITIONAL_TAKING = 1 << 0, // the group being read is in
+	CONDITIONAL_TAKEN  = 1 << 1, // a group was in, the ones after are not
+	CONDITIONAL_ELSE   = 1 << 2, // past its #else
+};
+
+// a conditional whose #endif is still to come
+struct Conditional {
+	struct PreprocessingToken name; // `if`, `ifdef` or `ifndef`, for when there is no #endif
+	uint8_t state; // enum ConditionalState
+};
+
+static bool is_punctuator(const struct PreprocessingToken *token, enum TokenKind kind) {
+	return token->kind == PREPROCESSING_TOKEN_PUNCTUATOR && token->id == kind;
+}
+
+static bool is_name(const struct Preprocessor *pp, const struct PreprocessingToken *token, const char *name) {
+	return token->kind == PREPROCESSING_TOKEN_IDENTIFIER && token->len == strlen(name)
+		&& !memcmp(preprocessor_spelling(pp, token), name, token->len);
+}
+
+// the same parameters and replacement list, spelled and spaced the same way
+static bool same_definition(const struct Preprocessor *pp, const struct Macro *a, const struct Macro *b,
+		const struct PreprocessingToken *body) {
+	if (a->kind != b->kind || a->params != b->params || a->len != b->len) return false;
+	const struct PreprocessingToken *other = pp->macros.bodies.items + a->body;
+	for (uint32_t i = 0; i < a->len; i++) {
+		const struct PreprocessingToken *x = &other[i], *y = &body[i];
+		if (x->kind != y->kind || x->len != y->len) return false;
+		if (i && (x->flags & PP_TOKEN_SPACE) != (y->flags & PP_TOKEN_SPACE)) return false;
+		if (x->kind == PREPROCESSING_TOKEN_PARAMETER ? x->id != y->id
+				: !!memcmp(preprocessor_spelling(pp, x), preprocessor_spelling(pp, y), x->len)) return false;
+	}
+	return true;
+}
+
+// the replacement list into `pp->directive`, with parameters made PREPROCESSING_TOKEN_PARAMETER
+static int replacement_list(struct Preprocessor *pp, struct Macro *macro, const uint32_t *params,
+		uint32_t va_args, const struct PreprocessingToken *tokens, ptrdiff_t i, ptrdiff_t end) {
+	struct PreprocessingTokens *body = &pp->directive;
+	if (end - i > body->cap) {
+		struct PreprocessingToken *items = realloc(body->items, (end - i) * sizeof (*items));
+		if (!items) {
+			diagnose("could not allocate a replacement list of %td tokens.\n", end - i);
+			return -1;
+		}
+		body->items = items;
+		body->cap = end - i;
+	}
+	body->len = 0;
+	for (; i < end; i++) {
+		struct PreprocessingToken t = tokens[i];
+		for (uint32_t k = 0; t.kind == PREPROCESSING_TOKEN_IDENTIFIER && k < macro->params; k++) {
+			if (params[k] != t.id) continue;
+			t.kind = PREPROCESSING_TOKEN_PARAMETER;
+			t.id = k;
+		}
+		if (t.kind == PREPROCESSING_TOKEN_IDENTIFIER && t.id == va_args) {
+			preprocessor_where(pp, &tokens[i]);
+			diagnose("__VA_ARGS__ can only be in the replacement list of a variadic macro.\n");
+			return -1;
+		}
+		body->items[body->len++] = t;
+	}
+	macro->len = body->len;
+	for (ptrdiff_t k = 0; k < body->len; k++) {
+		const struct PreprocessingToken *t = &body->items[k];
+		if (is_punctuator(t, TOKEN_HASH_HASH)) {
+			macro->operators = true;
+			if (k && k + 1 < body->len) continue;
+			preprocessor_where(pp, t);
+			diagnose("## cannot be at either end of a replacement list.\n");
+			return -1;
+		}
+		if (macro->kind == CONTROL_LINE_DEFINE || !is_punctuator(t, TOKEN_HASH)) continue;
+		macro->operators = true;
+		if (k + 1 < body->len && body->items[k + 1].kind == PREPROCESSING_TOKEN_PARAMETER) continue;
+		preprocessor_where(pp, t);
+		diagnose("# is not followed by a macro parameter.\n");
+		return -1;
+	}
+	return 0;
+}
+
+static int define(struct Preprocessor *pp, const struct PreprocessingToken *tokens, ptrdiff_t i, ptrdiff_t end) {
+	const struct PreprocessingToken *hash = &tokens[i - 2];
+	if (i == end || tokens[i].kind != PREPROCESSING_TOKEN_IDENTIFIER) {
+		preprocessor_where(pp, hash);
+		diagnose("#define without a macro name.\n");
+		return -1;
+	}
+	const struct PreprocessingToken *name = &tokens[i++];
+	const struct InternString *va_args = intern_string(&pp->identifiers, (const uint8_t *) "__VA_ARGS__", 11);
+	if (!va_args) return -1;
+	struct Macro macro = { .name = name->id, .kind = CONTROL_LINE_DEFINE };
+	uint32_t params[MAX_PARAMS];
+	// function-like only if the '(' comes right after the name
+	if (i < end && is_punctuator(&tokens[i], TOKEN_LBRACKET) && !(tokens[i].flags & PP_TOKEN_SPACE)) {
+		macro.kind = CONTROL_LINE_DEFINE_ARGS;
+		for (i++;; i++) {
+			const struct PreprocessingToken *t = i < end ? &tokens[i]: NULL;
+			if (t && is_punctuator(t, TOKEN_RBRACKET) && !macro.params) break;
+			if (!t || macro.params == MAX_PARAMS) goto params;
+			if (is_punctuator(t, TOKEN_ELLIPSIS)) {
+				macro.kind = macro.params ? CONTROL_LINE_DEFINE_ARGS_AND_VARARGS: CONTROL_LINE_DEFINE_VARARGS;
+				params[macro.params++] = va_args->id;
+				i++;
+			} else if (t->kind == PREPROCESSING_TOKEN_IDENTIFIER && t->id != va_args->id) {
+				for (uint32_t k = 0; k < macro.params; k++) {
+					if (params[k] == t->id) goto params;
+				}
+				params[macro.params++] = t->id;
+				if (++i < end && is_punctuator(&tokens[i], TOKEN_COMMA)) continue;
+			} else {
+				goto params;
+			}
+			if (i < end && is_punctuator(&tokens[i], TOKEN_RBRACKET)) break;
+			goto params;
+		}
+		i++;
+	}
+	if (replacement_list(pp, &macro, params, va_args->id, tokens, i, end)) return -1;
+	const struct Macro *old = macro_find(&pp->macros, macro.name);
+	if (old && !same_definition(pp, old, &macro, pp->directive.items)) {
+		preprocessor_where(pp, name);
+		diagnose("macro `%.*s` redefined.\n", (int) name->len, preprocessor_spelling(pp, name));
+	}
+	return macro_define(&pp->macros, macro, pp->directive.items);
+params:
+	preprocessor_where(pp, name);
+	diagnose("invalid parameter list for macro `%.*s`.\n", (int) name->len, preprocessor_spelling(pp, name));
+	return -1;
+}
+
+// whether the group being read is left out
+static bool skipping(const struct Preprocessor *pp) {
+	return pp->conditionals.len && !(pp->conditionals.items[pp->conditionals.len - 1].state & CONDITIONAL_TAKING);
+}
+
+static int push_conditional(struct Preprocessor *pp, const struct PreprocessingToken *name, uint8_t state) {
+	if (pp->conditionals.len == pp->conditionals.cap) {
+		ptrdiff_t cap = pp->conditionals.cap ? pp->conditionals.cap * 2: 64;
+		struct Conditional *items = realloc(pp->conditionals.items, cap * sizeof (*items));
+		if (!items) {
+			diagnose("could not grow the conditionals past %td.\n", pp->conditionals.len);
+			return -1;
+		}
+		pp->conditionals.items = items;
+		pp->conditionals.cap = cap;
+	}
+	pp->conditionals.items[pp->conditionals.len++] = (struct Conditional) { .name = *name, .state = state };
+	return 0;
 }
 
+// whether the group after the conditional directive `name`, whose line ends at `end`, is in. -1 on error.
+static int condition(struct Preprocessor *pp, const struct PreprocessingToken *name,
+		const struct PreprocessingToken *end) {
+	bool ifdef = is_name(pp, name, "ifdef");
+	if (ifdef || is_name(pp, name, "ifndef")) {
+		if (name + 1 == end || name[1].kind != PREPROCESSING_TOKEN_IDENTIFIER) {
+			preprocessor_where(pp, name);
+			diagnose("#%s without a macro name.\n", ifdef ? "ifdef": "ifndef");
+			return -1;
+		}
+		return !macro_find(&pp->macros, name[1].id) != ifdef;
+	}
+	// 6.10.1p1: `defined X` and `defined ( X )` first, then the macros, what is left is the expression
+	struct PreprocessingTokens *line = &pp->directive;
+	if (end - name > line->cap) {
+		struct PreprocessingToken *items = realloc(line->items, (end - name) * sizeof (*items));
+		if (!items) {
+			diagnose("could not allocate an #if expression of %td tokens.\n", end - name);
+			return -1;
+		}
+		line->items = items;
+		line->cap = end - name;
+	}
+	line->len = 0;
+	for (const struct PreprocessingToken *t = name + 1; t < end; t++) {
+		line->items[line->len++] = *t;
+		if (!is_name(pp, t, "defined")) continue;
+		bool paren = t + 1 < end && is_punctuator(t + 1, TOKEN_LBRACKET);
+		const struct PreprocessingToken *macro = t + 1 + paren;
+		if (macro >= end || macro->kind != PREPROCESSING_TOKEN_IDENTIFIER
+				|| (paren && (macro + 1 == end || !is_punctuator(macro + 1, TOKEN_RBRACKET)))) {
+			preprocessor_where(pp, t);
+			diagnose("defined without a macro name.\n");
+			return -1;
+		}
+		line->items[line->len - 1].kind = PREPROCESSING_TOKEN_DEFINED;
+		line->items[line->len - 1].id = macro_find(&pp->macros, macro->id) != NULL;
+		t = macro + paren;
+	}
+	ptrdiff_t mark = pp->output.len;
+	if (line->len && macro_expand(pp, line->items, 0, line->len)) return -1;
+	int in = if_evaluate(pp, name, pp->output.items + mark, pp->output.len - mark);
+	pp->output.len = mark;
+	return in;
+}
+
+static int translate(struct Preprocessor *pp, uint16_t file, int depth);
+
+// the header named after `#include` at `tokens[hash]`, read in place of the line
+static int include(struct Preprocessor *pp, const struct PreprocessingToken *tokens, ptrdiff_t hash, ptrdiff_t end,
+		int depth) {
+	const struct PreprocessingToken *at = &tokens[hash], *t = &tokens[hash + 2];
+	char name[MAX_HEADER_NAME];
+	const char *spelling;
+	long len = 0;
+	bool quoted;
+	if (hash + 2 < end && t->kind == PREPROCESSING_TOKEN_HEADER_NAME) {
+		spelling = preprocessor_spelling(pp, t);
+		quoted = *spelling == '"';
+		len = t->len - 2;
+		memcpy(name, spelling + 1, len < MAX_HEADER_NAME ? len: 0);
+	} else {
+		// 6.10.2p4: the macros of the line first, then a string literal or what is between < and >
+		ptrdiff_t mark = pp->output.len;
+		if (hash + 2 < end && macro_expand(pp, tokens, hash + 2, end)) return -1;
+		const ptrdiff_t count = pp->output.len - mark;
+		const struct PreprocessingToken *first = pp->output.items + mark, *last = first + count - 1;
+		quoted = count == 1 && first->kind == PREPROCESSING_TOKEN_STRING_LITERAL
+			&& *preprocessor_spelling(pp, first) == '"';
+		if (quoted) {
+			len = first->len - 2;
+			memcpy(name, preprocessor_spelling(pp, first) + 1, len < MAX_HEADER_NAME ? len: 0);
+		} else if (count >= 2 && is_punctuator(first, TOKEN_LOWER) && is_punctuator(last, TOKEN_GREATER)) {
+			for (const struct PreprocessingToken *p = first + 1; p != last; p++) {
+				bool space = p != first + 1 && (p->flags & PP_TOKEN_SPACE);
+				if (len + space + p->len >= MAX_HEADER_NAME) {
+					len = MAX_HEADER_NAME;
+					break;
+				}
+				if (space) name[len++] = ' ';
+				memcpy(name + len, preprocessor_spelling(pp, p), p->len);
+				len += p->len;
+			}
+		} else {
+			pp->output.len = mark;
+			preprocessor_where(pp, at);
+			diagnose("#include expects \"file\" or <file>.\n");
+			return -1;
+		}
+		pp->output.len = mark;
+	}
+	if (len >= MAX_HEADER_NAME) {
+		preprocessor_where(pp, at);
+		diagnose("header name longer than %d bytes.\n", MAX_HEADER_NAME - 1);
+		return -1;
+	}
+	if (depth == MAX_INCLUDE_DEPTH) {
+		preprocessor_where(pp, at);
+		diagnose("#include nested more than %d deep.\n", MAX_INCLUDE_DEPTH);
+		return -1;
+	}
+	long header = preprocessor_include(pp, at, name, len, quoted);
+	if (header <= 0) return header;
+	return translate(pp, header, depth + 1);
+}
+
+// the line from `tokens[hash]` up to `tokens[end]` of `file`, whose conditionals start at `base`
+static int directive(struct Preprocessor *pp, uint16_t file, const struct PreprocessingToken *tokens,
+		ptrdiff_t hash, ptrdiff_t end, ptrdiff_t base, int depth) {
+	const struct PreprocessingToken *name = &tokens[hash + 1];
+	// the null directive
+	if (hash + 1 == end) return 0;
+	if (is_name(pp, name, "if") || is_name(pp, name, "ifdef") || is_name(pp, name, "ifndef")) {
+		// in a group that is left out, none of its groups are in
+		int in = skipping(pp) ? -2: condition(pp, name, &tokens[end]);
+		if (in == -1) return -1;
+		return push_conditional(pp, name, in == -2 ? CONDITIONAL_TAKEN: in ? CONDITIONAL_TAKING | CONDITIONAL_TAKEN: 0);
+	}
+	bool otherwise = is_name(pp, name, "else");
+	if (otherwise || is_name(pp, name, "elif") || is_name(pp, name, "endif")) {
+		if (pp->conditionals.len == base) {
+			preprocessor_where(pp, name);
+			diagnose("#%.*s without #if.\n", (int) name->len, preprocessor_spelling(pp, name));
+			return -1;
+		}
+		struct Conditional *c = &pp->conditionals.items[pp->conditionals.len - 1];
+		if (is_name(pp, name, "endif")) {
+			pp->conditionals.len--;
+			return 0;
+		}
+		if (c->state & CONDITIONAL_ELSE) {
+			preprocessor_where(pp, name);
+			diagnose("#%.*s after #else.\n", (int) name->len, preprocessor_spelling(pp, name));
+			return -1;
+		}
+		if (otherwise) c->state |= CONDITIONAL_ELSE;
+		if (c->state & CONDITIONAL_TAKEN) {
+			c->state &= ~CONDITIONAL_TAKING;
+			return 0;
+		}
+		int in = otherwise ? 1: condition(pp, name, &tokens[end]);
+		if (in < 0) return -1;
+		if (in) c->state |= CONDITIONAL_TAKING | CONDITIONAL_TAKEN;
+		return 0;
+	}
+	if (skipping(pp)) return 0;
+	if (is_name(pp, name, "define")) return define(pp, tokens, hash + 2, end);
+	if (is_name(pp, name, "include")) return include(pp, tokens, hash, end, depth);
+	if (is_name(pp, name, "undef")) {
+		if (hash + 2 < end && tokens[hash + 2].kind == PREPROCESSING_TOKEN_IDENTIFIER) {
+			macro_undef(&pp->macros, tokens[hash + 2].id);
+			return 0;
+		}
+		preprocessor_where(pp, name);
+		diagnose("#undef without a macro name.\n");
+		return -1;
+	}
+	if (is_name(pp, name, "error")) {
+		const struct PreprocessingToken *last = &tokens[end - 1];
+		preprocessor_where(pp, name);
+		diagnose("#error%.*s\n", (int) (last->offset + last->len - name->offset - name->len),
+				preprocessor_spelling(pp, name) + name->len);
+		return -1;
+	}
+	if (is_name(pp, name, "pragma")) {
+		if (hash + 2 < end && is_name(pp, &tokens[hash + 2], "once")) {
+			if (file) pp->headers.items[file - 1].once = true;
+			else pp->headers.once = true;
+		}
+		return 0;
+	}
+	if (is_name(pp, name, "line")) return 0;
+	preprocessor_where(pp, name);
+	diagnose("`#%.*s` is not supported yet, the line is left out.\n", (int) name->len, preprocessor_spelling(pp, name));
+	return 0;
+}
+
+// as `preprocessor_decompose_text`, for header `file - 1` whose tokens are all there already:
+// those from `next` on into `text`. the index of where it stopped, -1 on error.
+static ptrdiff_t take_text(struct Preprocessor *pp, uint16_t file, ptrdiff_t next,
+		struct PreprocessingTokens *text, ptrdiff_t *hash) {
+	const struct Header *h = &pp->headers.items[file - 1];
+	const struct PreprocessingTokens *all = &h->tokens;
+	ptrdiff_t stop = next;
+	*hash = -1;
+	for (; stop < all->len; stop++) {
+		const struct PreprocessingToken *t = &all->items[stop];
+		if (!(t->flags & PP_TOKEN_BOL)) continue;
+		if (*hash >= 0) break;
+		if (is_punctuator(t, TOKEN_HASH)) *hash = text->len + stop - next;
+	}
+	if (text->len + stop - next > text->cap) {
+		ptrdiff_t cap = text->cap ? text->cap: 256;
+		while (cap < text->len + stop - next) cap *= 2;
+		struct PreprocessingToken *items = realloc(text->items, cap * sizeof (*items));
+		if (!items) {
+			diagnose("could not grow the preprocessing tokens past %td.\n", text->len);
+			return -1;
+		}
+		text->items = items;
+		text->cap = cap;
+	}
+	struct PreprocessingToken *t = text->items + text->len;
+	memcpy(t, all->items + next, (stop - next) * sizeof (*t));
+	text->len += stop - next;
+	// from the cache, in terms of its own strings
+	for (; h->ids && t != text->items + text->len; t++) {
+		// only what decomposing a file makes: no spellings, parameters or `defined`
+		if (t->offset > h->len || t->len > h->len - t->offset || (t->flags & PP_TOKEN_SPELLED)
+				|| t->kind < PREPROCESSING_TOKEN_HEADER_NAME || t->kind > PREPROCESSING_TOKEN_ANYTHING
+				|| (t->kind == PREPROCESSING_TOKEN_IDENTIFIER && t->id >= h->id_len)) {
+			diagnose("`%s`: the header cache has a token that is not in it.\n", h->path);
+			return -1;
+		}
+		if (t->kind == PREPROCESSING_TOKEN_IDENTIFIER) t->id = h->ids[t->id];
+		t->file = file;
+	}
+	return stop;
+}
+
+// the index of the first token of `all` at `offset` or after it
+static ptrdiff_t token_at(const struct PreprocessingTokens *all, uint32_t offset) {
+	ptrdiff_t lo = 0, hi = all->len;
+	while (lo < hi) {
+		ptrdiff_t mid = lo + (hi - lo) / 2;
+		if (all->items[mid].offset < offset) lo = mid + 1;
+		else hi = mid;
+	}
+	return lo;
+}
+
+static int translate(struct Preprocessor *pp, uint16_t file, int depth) {
+	const struct Header *header = file ? &pp->headers.items[file - 1]: NULL;
+	const char *buf = header ? header->buf: pp->buf, *end = buf + (header ? header->len: pp->len), *p = buf;
+	// a cached header is not decomposed again, its tokens are taken as they are.
+	// an #include may move the headers, so they are looked up each time.
+	const bool whole = header && header->whole;
+	ptrdiff_t next = 0;
+	// what an #include reads goes after what this file has, and leaves it as it was
+	struct PreprocessingTokens *text = &pp->text;
+	const ptrdiff_t base = text->len, outer = pp->conditionals.len;
+	// `#ifndef X` first and its #endif last, with no #else or #elif, make X the include guard
+	uint32_t guard = 0;
+	bool first = true, closed = false;
+	while (p != end) {
+		// a group that is left out is not decomposed, only the directive that ends it is
+		if (skipping(pp)) {
+			if ((p = preprocessor_skip_group(p, end)) == end) break;
+			if (whole) next = token_at(&pp->headers.items[file - 1].tokens, p - buf);
+		}
+		ptrdiff_t hash;
+		if (whole) {
+			if ((next = take_text(pp, file, next, text, &hash)) < 0) return -1;
+			const struct PreprocessingTokens *all = &pp->headers.items[file - 1].tokens;
+			p = next < all->len ? buf + all->items[next].offset: end;
+		} else if (!(p = preprocessor_decompose_text(pp, buf, p, end, file, text, &hash))) {
+			return -1;
+		}
+		const struct PreprocessingToken *tokens = text->items;
+		if (closed && text->len > base) guard = 0;
+		// the text up to the directive, expanded with the macros as they are there
+		ptrdiff_t stop = hash < 0 ? text->len: hash;
+		if (stop > base && !skipping(pp) && macro_expand(pp, tokens, base, stop)) return -1;
+		if (hash >= 0) {
+			const ptrdiff_t n = text->len - hash;
+			if (first && hash == base && n == 3 && is_name(pp, &tokens[hash + 1], "ifndef")
+					&& tokens[hash + 2].kind == PREPROCESSING_TOKEN_IDENTIFIER) {
+				guard = tokens[hash + 2].id + 1;
+			}
+			if (pp->conditionals.len == outer + 1 && n > 1
+					&& (is_name(pp, &tokens[hash + 1], "else") || is_name(pp, &tokens[hash + 1], "elif"))) {
+				guard = 0;
+			}
+			if (directive(pp, file, tokens, hash, text->len, outer, depth)) return -1;
+			if (pp->conditionals.len == outer) closed = true;
+		}
+		first = false;
+		text->len = base;
+	}
+	if (pp->conditionals.len > outer) {
+		const struct Conditional *c = &pp->conditionals.items[pp->conditionals.len - 1];
+		preprocessor_where(pp, &c->name);
+		diagnose("#%.*s without #endif.\n", (int) c->name.len, preprocessor_spelling(pp, &c->name));
+		pp->conditionals.len = outer;
+		return -1;
+	}
+	if (file && guard) pp->headers.items[file - 1].guard = guard;
+	else if (guard) pp->headers.guard = guard;
+	return 0;
+}
+
+int preprocess(struct Preprocessor *pp) {
+	if (!pp->buf) return -1;
+	pp->output.len = pp->prefix;
+	pp->text.len = 0;
+	pp->conditionals.len = 0;
+	if (translate(pp, 0, 0)) return -1;
+	pp->expanded = true;
+	return 0;
+}
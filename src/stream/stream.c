@@ -1,3 +1,5 @@
+#define _DEFAULT_SOURCE // mmap and fileno
+
 #include "stream/stream.h"
 #include "stream/utf-8.h"
 
@@ -6,6 +8,9 @@
 #include <string.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #define MAX_STREAM_NAME (128)
 
@@ -21,8 +26,13 @@ struct Stream {
 	ptrdiff_t len;
 	ptrdiff_t size;
 	enum StreamEncoding enc;
+	bool mmap;
+	const uint8_t *view;
+	ptrdiff_t view_len; // length of the mapping, 0 if `view` was malloc'd
 };
 
+static const uint8_t *map_view(Stream stream);
+
 Stream stream_init(const char *title, int mode) {
 	char mode_str[3] = { [2] = '\0' };
 	enum StreamEncoding enc = ENC_DEFAULT;
@@ -33,6 +43,7 @@ Stream stream_init(const char *title, int mode) {
 	else if (mode & C_STREAM_BINARY) mode_str[1] = 'b';
 
 	if (mode & C_STREAM_UTF_8) enc = ENC_UTF_8;
+	if (mode & C_STREAM_MMAP) mode_str[0] = 'r';
 
 	struct Stream *stream = malloc(sizeof (*stream));
 	if (!stream) goto alloc_fail;
@@ -49,6 +60,9 @@ Stream stream_init(const char *title, int mode) {
 	stream->size = 0;
 	stream->size = stream_size(stream);
 	stream->enc = enc;
+	stream->mmap = mode & C_STREAM_MMAP;
+	stream->view = NULL;
+	stream->view_len = 0;
 
 	char *dot = strrchr(stream->name, '.');
 	stream->ext = dot && dot != stream->name ? dot: stream->name+l;
@@ -64,6 +78,8 @@ alloc_fail:
 
 void stream_fini(Stream stream) {
 	if (stream) {
+		if (stream->view_len) munmap((void *) stream->view, stream->view_len);
+		else free((void *) stream->view);
 		fclose(stream->f);
 		free(stream->name);
 		free(stream);
@@ -106,6 +122,66 @@ ptrdiff_t stream_read(Stream stream, void *buf, ptrdiff_t size) {
 	return -1;
 }
 
+const uint8_t *stream_view(Stream stream, ptrdiff_t *len) {
+	if (!stream->mmap) return NULL;
+	if (!stream->view && !map_view(stream)) return NULL;
+	if (len) *len = stream->size;
+	return stream->view;
+}
+
+// all that is left of `f` into a buffer followed by its padding, for what cannot be mapped.
+// its size cannot be known before it is read (a pipe, ...), so the buffer grows as it comes.
+static uint8_t *read_view(FILE *f, ptrdiff_t *len) {
+	ptrdiff_t n = 0, cap = 0;
+	uint8_t *buf = NULL;
+	for (size_t r = 1; r;) {
+		if (cap - n < 4096 + C_STREAM_PADDING) {
+			ptrdiff_t c = cap ? cap * 2: 16384;
+			uint8_t *tmp = realloc(buf, c);
+			if (!tmp) goto fail;
+			buf = tmp;
+			cap = c;
+		}
+		n += r = fread(buf + n, 1, cap - n - C_STREAM_PADDING, f);
+	}
+	if (ferror(f)) goto fail;
+	memset(buf + n, 0, C_STREAM_PADDING);
+	*len = n;
+	return buf;
+fail:
+	free(buf);
+	return NULL;
+}
+
+const uint8_t *map_view(Stream stream) {
+	ptrdiff_t size = stream->size, page = sysconf(_SC_PAGESIZE), total = 0;
+	uint8_t *map = NULL;
+	if (size >= 0) {
+		total = (size + C_STREAM_PADDING + page-1) / page * page;
+		// reserve zeroed pages for the file and its padding, then map the file over the start.
+		// the kernel zero-fills the end of the last page of the file.
+		map = mmap(NULL, total, PROT_READ, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED) return NULL;
+		if (size && mmap(map, size, PROT_READ, MAP_PRIVATE|MAP_FIXED, fileno(stream->f), 0) == MAP_FAILED) {
+			munmap(map, total);
+			map = NULL;
+			total = 0;
+			rewind(stream->f);
+		}
+	}
+	// not something we can map or even measure (a pipe, ...), read it instead
+	if (!map && !(map = read_view(stream->f, &size))) return NULL;
+	if (!is_valid_buffer_utf_8(map, size)) {
+		if (total) munmap(map, total);
+		else free(map);
+		return NULL;
+	}
+	stream->view = map;
+	stream->view_len = total;
+	stream->size = size;
+	return map;
+}
+
 ptrdiff_t stream_write(Stream stream, const void *buf, ptrdiff_t size) {
 	if (stream == uwunull) return size;
 	return fwrite(buf, 1, size, stream->f);
@@ -1,10 +1,106 @@
+#define _DEFAULT_SOURCE // mkfifo, fork
+
 #include "stream/stream.h"
+#include "stream/tests.h"
+#include "stream/utf-8.h"
+#include <bench.h>
+#include <tests.h>
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static const struct {
+	const char *name;
+	utf_8_validator fun;
+	const char *cpu;
+} validators[] = {
+	{ "scalar", &is_valid_buffer_utf_8_scalar, NULL },
+#if defined(__x86_64__)
+	{ "sse2"  , &is_valid_buffer_utf_8_sse2  , NULL },
+	{ "avx2"  , &is_valid_buffer_utf_8_avx2  , "avx2" },
+	{ "avx512", &is_valid_buffer_utf_8_avx512, "avx512bw" },
+#endif
+};
+#define NUM_VALIDATORS ((int) (sizeof (validators) / sizeof (*validators)))
+
+static uint32_t rng = 12345;
+
+// mostly valid text with the occasional error in it
+static long random_utf_8(uint8_t *buf, long cap) {
+	static const uint8_t odd[] = { 0x00, 0x7F, 0x80, 0xBF, 0xC0, 0xC1, 0xDF, 0xE0, 0xED, 0xEF, 0xF0, 0xF4, 0xF7, 0xF8, 0xFF };
+	long len = 0;
+	while (len + 4 <= cap && test_random(&rng) % 64) {
+		uint32_t r = test_random(&rng);
+		switch (r % 128) {
+		case 0:
+			buf[len++] = odd[(r >> 8) % sizeof (odd)];
+			break;
+		case 1 ... 40:
+			len += encode_utf_8(buf + len, &(uint32_t) { 0x80 + (r >> 8) % 0x10FF80 }, 1);
+			break;
+		default:
+			buf[len++] = 0x20 + (r >> 8) % 0x5F;
+			break;
+		}
+	}
+	return len;
+}
+
+static void utf_8_test(void) {
+	uint8_t buf[512];
+	long tested = 0, valid = 0;
+	for (int i = 0; i < 20000; i++) {
+		long len = random_utf_8(buf, sizeof (buf));
+		// also try it cut short and misaligned
+		long start = test_random(&rng) % 4, end = len - test_random(&rng) % 4;
+		if (end < start) end = start;
+		bool expect = is_valid_buffer_utf_8_scalar(buf + start, end - start);
+		for (int v = 1; v < NUM_VALIDATORS; v++) {
+			if (!test_cpu_supports(validators[v].cpu)) continue;
+			assert(validators[v].fun(buf + start, end - start) == expect);
+		}
+		tested++;
+		valid += expect;
+	}
+	printf("utf-8: %ld buffers, %ld valid\n", tested, valid);
+}
+
+// a pipe cannot be mapped nor measured, its view is read as it comes
+static int pipe_test(void) {
+	const char *f = "stream_fifo";
+	static char text[100000];
+	for (size_t i = 0; i < sizeof (text); i++) text[i] = 'a' + i % 26;
+	if (mkfifo(f, 0600)) return -1;
+	pid_t child = fork();
+	if (child < 0) {
+		remove(f);
+		return -1;
+	}
+	if (!child) {
+		FILE *w = fopen(f, "w");
+		_exit(!w || fwrite(text, 1, sizeof (text), w) != sizeof (text) || fclose(w));
+	}
+	int err = -1, status;
+	Stream stream = stream_init(f, C_STREAM_MMAP|C_STREAM_TEXT);
+	ptrdiff_t len;
+	const uint8_t *view = stream ? stream_view(stream, &len): NULL;
+	if (view && len == sizeof (text) && !memcmp(view, text, len) && !view[len]) err = 0;
+	stream_fini(stream);
+	if (waitpid(child, &status, 0) != child || !WIFEXITED(status) || WEXITSTATUS(status)) err = -1;
+	remove(f);
+	printf("pipe: %s\n", err ? "not read as written": "read as written");
+	return err;
+}
 
 int stream_test(void) {
 	printf("stream:\n");
+	utf_8_test();
+	if (pipe_test()) return -1;
 	Stream stream = stream_init("foo.c", C_STREAM_READ | C_STREAM_TEXT);
 	if (!stream) {
 		fprintf(stderr, "couldn't initialize stream from `%s`.\n", "foo.c");
@@ -26,3 +122,31 @@ int stream_test(void) {
 	return 0;
 }
 
+int stream_bench(void) {
+	printf("stream:\n");
+	const long size = 16 * 1024 * 1024;
+	uint8_t *buf = malloc(size);
+	if (!buf) return -1;
+	// source code: ASCII, with a multibyte character every few lines
+	long len = 0;
+	while (len + 4 <= size) {
+		uint32_t r = test_random(&rng);
+		if (r % 256 == 0) len += encode_utf_8(buf + len, &(uint32_t) { 0xA0 + (r >> 8) % 0x3000 }, 1);
+		else buf[len++] = r % 64 ? 0x20 + (r >> 8) % 0x5F: '\n';
+	}
+	for (int v = 0; v < NUM_VALIDATORS; v++) {
+		if (!test_cpu_supports(validators[v].cpu)) continue;
+		const int rounds = 10;
+		double t0 = bench_now();
+		for (int r = 0; r < rounds; r++) {
+			if (!validators[v].fun(buf, len)) {
+				free(buf);
+				return -1;
+			}
+		}
+		double t1 = bench_now();
+		printf("utf-8 %-8s %8.2f GB/s\n", validators[v].name, rounds * len / (t1 - t0 + 1e-9) / 1e9);
+	}
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "stream/utf-8.h"
+#include <common/dispatch.h>
+
+// the validators below accept exactly what `is_valid_buffer_utf_8_scalar` accepts:
+// C0-DF, E0-EF and F0-F7 lead 1, 2 and 3 continuation bytes (80-BF),
+// F8-FF never appear, and every byte is ASCII, a lead or an expected continuation.
+// a byte must then be a continuation iff one of the 3 bytes before it is a lead reaching it,
+// which can be checked on a whole block at once.
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// every validator works on blocks of `W` bytes at `p`, for which p[-3..W-1] must be readable.
+// the first block and the tail are copied to a zero-filled buffer to get there.
+// the tail is always checked, even when empty, so that a sequence cut short
+// by the end of the buffer meets zeros instead of continuations.
+#define VALIDATOR(name, W, block_ok, attr) \
+attr bool name(const uint8_t *strm, long len) { \
+	uint8_t tmp[3 + (W)]; \
+	long i = 0; \
+	if (len >= (W)) { \
+		memset(tmp, 0, 3); \
+		memcpy(tmp + 3, strm, (W)); \
+		if (!block_ok(tmp + 3)) return false; \
+		for (i = (W); i + (W) <= len; i += (W)) { \
+			if (!block_ok(strm + i)) return false; \
+		} \
+	} \
+	long k = i < 3 ? i: 3; \
+	memset(tmp, 0, sizeof (tmp)); \
+	memcpy(tmp + 3 - k, strm + i - k, k + len - i); \
+	return block_ok(tmp + 3); \
+}
+
+// SSE2 has no byte shuffle, so the classes are found with unsigned comparisons
+#define GE_SSE2(x, c) _mm_cmpeq_epi8(_mm_max_epu8((x), _mm_set1_epi8((char) (c))), (x))
+
+static inline bool block_ok_sse2(const uint8_t *p) {
+	__m128i cur = _mm_loadu_si128((const __m128i *) p);
+	__m128i p3  = _mm_loadu_si128((const __m128i *) (p - 3));
+	// p[-3..15] all ASCII
+	if (!_mm_movemask_epi8(_mm_or_si128(cur, p3))) return true;
+	__m128i p1  = _mm_loadu_si128((const __m128i *) (p - 1));
+	__m128i p2  = _mm_loadu_si128((const __m128i *) (p - 2));
+	__m128i req = _mm_or_si128(GE_SSE2(p1, 0xC0), _mm_or_si128(GE_SSE2(p2, 0xE0), GE_SSE2(p3, 0xF0)));
+	__m128i cont = _mm_cmpeq_epi8(_mm_and_si128(cur, _mm_set1_epi8((char) 0xC0)), _mm_set1_epi8((char) 0x80));
+	__m128i err = _mm_or_si128(_mm_xor_si128(req, cont), GE_SSE2(cur, 0xF8));
+	return !_mm_movemask_epi8(err);
+}
+
+#undef GE_SSE2
+
+VALIDATOR(is_valid_buffer_utf_8_sse2, 16, block_ok_sse2, )
+
+// classes of a byte, looked up from its high nibble.
+// F8-FF are told apart from F0-F7 with a second lookup on the low nibble.
+#define CONT (1<<0) // 80-BF
+#define L2   (1<<1) // C0-FF, the next byte is a continuation
+#define L3   (1<<2) // E0-FF, the one after too
+#define L4   (1<<3) // F0-FF, and the one after that
+#define BIG  (1<<4) // F8-FF with the low nibble table
+#define HI_TABLE \
+	0, 0, 0, 0, 0, 0, 0, 0, CONT, CONT, CONT, CONT, L2, L2, L2|L3, L2|L3|L4|BIG
+#define LO_TABLE \
+	0, 0, 0, 0, 0, 0, 0, 0, BIG, BIG, BIG, BIG, BIG, BIG, BIG, BIG
+
+__attribute__((target("avx2")))
+static inline bool block_ok_avx2(const uint8_t *p) {
+	__m256i cur = _mm256_loadu_si256((const __m256i *) p);
+	__m256i p3  = _mm256_loadu_si256((const __m256i *) (p - 3));
+	if (!_mm256_movemask_epi8(_mm256_or_si256(cur, p3))) return true;
+	__m256i p1  = _mm256_loadu_si256((const __m256i *) (p - 1));
+	__m256i p2  = _mm256_loadu_si256((const __m256i *) (p - 2));
+	const __m256i hi = _mm256_setr_epi8(HI_TABLE, HI_TABLE);
+	const __m256i lo = _mm256_setr_epi8(LO_TABLE, LO_TABLE);
+	const __m256i nib = _mm256_set1_epi8(0x0F);
+#define CLASS(x) _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16((x), 4), nib))
+	__m256i c0 = CLASS(cur), c1 = CLASS(p1), c2 = CLASS(p2), c3 = CLASS(p3);
+#undef CLASS
+	__m256i req = _mm256_or_si256(_mm256_and_si256(c1, _mm256_set1_epi8(L2)),
+			_mm256_or_si256(_mm256_and_si256(c2, _mm256_set1_epi8(L3)),
+				_mm256_and_si256(c3, _mm256_set1_epi8(L4))));
+	// any of the bits becomes CONT, to be compared with the class of the byte itself
+	req = _mm256_min_epu8(req, _mm256_set1_epi8(CONT));
+	__m256i err = _mm256_xor_si256(req, _mm256_and_si256(c0, _mm256_set1_epi8(CONT)));
+	__m256i big = _mm256_and_si256(_mm256_and_si256(c0, _mm256_shuffle_epi8(lo, _mm256_and_si256(cur, nib))),
+			_mm256_set1_epi8(BIG));
+	err = _mm256_or_si256(err, big);
+	return _mm256_testz_si256(err, err);
+}
+
+VALIDATOR(is_valid_buffer_utf_8_avx2, 32, block_ok_avx2, __attribute__((target("avx2"))))
+
+__attribute__((target("avx512f,avx512bw")))
+static inline bool block_ok_avx512(const uint8_t *p) {
+	__m512i cur = _mm512_loadu_si512((const void *) p);
+	__m512i p3  = _mm512_loadu_si512((const void *) (p - 3));
+	if (!_mm512_movepi8_mask(_mm512_or_si512(cur, p3))) return true;
+	__m512i p1  = _mm512_loadu_si512((const void *) (p - 1));
+	__m512i p2  = _mm512_loadu_si512((const void *) (p - 2));
+	// the masked broadcast, as the plain one starts from an undefined vector GCC warns about
+	const __m512i hi = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_setr_epi8(HI_TABLE));
+	const __m512i lo = _mm512_maskz_broadcast_i32x4(0xFFFF, _mm_setr_epi8(LO_TABLE));
+	const __m512i nib = _mm512_set1_epi8(0x0F);
+#define CLASS(x) _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi16((x), 4), nib))
+	__m512i c0 = CLASS(cur), c1 = CLASS(p1), c2 = CLASS(p2), c3 = CLASS(p3);
+#undef CLASS
+	__m512i req = _mm512_or_si512(_mm512_and_si512(c1, _mm512_set1_epi8(L2)),
+			_mm512_or_si512(_mm512_and_si512(c2, _mm512_set1_epi8(L3)),
+				_mm512_and_si512(c3, _mm512_set1_epi8(L4))));
+	req = _mm512_min_epu8(req, _mm512_set1_epi8(CONT));
+	__m512i err = _mm512_xor_si512(req, _mm512_and_si512(c0, _mm512_set1_epi8(CONT)));
+	__m512i big = _mm512_and_si512(_mm512_and_si512(c0, _mm512_shuffle_epi8(lo, _mm512_and_si512(cur, nib))),
+			_mm512_set1_epi8(BIG));
+	err = _mm512_or_si512(err, big);
+	return !_mm512_test_epi8_mask(err, err);
+}
+
+VALIDATOR(is_valid_buffer_utf_8_avx512, 64, block_ok_avx512, __attribute__((target("avx512f,avx512bw"))))
+
+#undef HI_TABLE
+#undef LO_TABLE
+#undef BIG
+#undef L4
+#undef L3
+#undef L2
+#undef CONT
+#undef VALIDATOR
+
+utf_8_validator resolve_utf_8_validator(void) {
+	if (CPU_SUPPORTS("avx512bw")) return &is_valid_buffer_utf_8_avx512;
+	if (CPU_SUPPORTS("avx2")) return &is_valid_buffer_utf_8_avx2;
+	return &is_valid_buffer_utf_8_sse2;
+}
+
+#else
+
+utf_8_validator resolve_utf_8_validator(void) {
+	return &is_valid_buffer_utf_8_scalar;
+}
+
+#endif
@@ -2,6 +2,7 @@
 #include <stdint.h>
 
 #include "stream/utf-8.h"
+#include <common/dispatch.h>
 
 static int cp_tp_utf_8(uint8_t *strm, uint32_t cp, uint8_t **endptr);
 
@@ -42,6 +43,11 @@ bool is_valid_character_utf_8(const uint8_t *strm, long len, uint8_t **endptr) {
 }
 
 bool is_valid_buffer_utf_8(const uint8_t *strm, long len) {
+	static utf_8_validator validator = NULL;
+	return DISPATCH(validator, resolve_utf_8_validator)(strm, len);
+}
+
+bool is_valid_buffer_utf_8_scalar(const uint8_t *strm, long len) {
 	for (const uint8_t *s = strm, *end = strm + len; s != end;) {
 		uint8_t *out;
 		if (!is_valid_character_utf_8(s, end - s, &out)) return false;
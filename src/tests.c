@@ -1,10 +1,70 @@
+#include <tests.h>
 #include <stream/tests.h>
 #include <pp/tests.h>
 #include <uwu/tests.h>
 #include <common/tests.h>
 #include <ast/tests.h>
+#include <intern/tests.h>
+#include <driver.h>
+#include <common/dispatch.h>
 
 #include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+bool test_cpu_supports(const char *cpu) {
+#if defined(__x86_64__)
+	if (cpu && !strcmp(cpu, "avx2")) return CPU_SUPPORTS("avx2");
+	if (cpu && !strcmp(cpu, "avx512bw")) return CPU_SUPPORTS("avx512bw");
+#endif
+	return !cpu;
+}
+
+uint32_t test_random(uint32_t *state) {
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+	return *state;
+}
+
+// the driver over a unit with a real system header, and one more to have two threads at work.
+// this preprocessor predefines nothing, so the unit says what the headers look for.
+static int driver_test(void) {
+	struct stat st;
+	if (stat("/usr/include/stdio.h", &st)) {
+		printf("driver: no system headers to test with\n");
+		return 0;
+	}
+	static const char *const files[][2] = {
+		{ "driver_test.c", "#define __STDC__ 1\n#define __STDC_VERSION__ 199901L\n"
+			"#define __x86_64__ 1\n#define __linux__ 1\n#define __GNUC__ 4\n#include <stdio.h>\n"
+			"struct s { int x; } s;\nint f(int, ...);\nint main(void) { return f(s.x, stdout); }\n" },
+		{ "driver_other.c", "int g(int a, ...) { return a; }\n" },
+	};
+	char *argv[] = {
+		"main", "-j2",
+#if defined(__GNUC__) && defined(__x86_64__)
+		"-I", "/usr/lib/gcc/x86_64-linux-gnu/" STR(__GNUC__) "/include",
+#endif
+		"-I", "/usr/include/x86_64-linux-gnu", "-I", "/usr/include",
+		"driver_test.c", "driver_other.c",
+	};
+	for (size_t i = 0; i < sizeof (files) / sizeof (*files); i++) {
+		FILE *f = fopen(files[i][0], "w");
+		if (!f) return -1;
+		fputs(files[i][1], f);
+		fclose(f);
+	}
+	int status = run_driver(sizeof (argv) / sizeof (*argv), argv);
+	remove("driver_test.c");
+	remove("driver_test.i");
+	remove("driver_other.c");
+	remove("driver_other.i");
+	return status;
+}
 
 void run_tests(int argc, char **argv) {
 	(void) argc, (void) argv;
@@ -12,6 +72,8 @@ void run_tests(int argc, char **argv) {
 		&stream_test,
 		&pp_test,
 		&lex_test,
+		&driver_test,
+		&intern_test,
 		&common_test,
 		&ast_test,
 	}, (**end) (void) = tests + sizeof (tests) / sizeof (*tests);
@@ -0,0 +1,523 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <float.h>
+#include <math.h>
+
+#include "uwu/float.h"
+#include <common/charclass.h>
+#include <common/log.h>
+#include <uwu/pow5.h>
+#include <uwu/scan.h>
+
+// decimal constants go through up to three paths, from the fastest to the slowest:
+// - Clinger's, when the digits and the power of 10 are both exact in the type,
+//   so that a single correctly rounded multiplication or division gives the value.
+// - Eisel-Lemire's, which multiplies the leading 64 bits of the digits by a
+//   128-bit approximation of the power of 5 and can tell when that is not enough.
+// - an exact big integer division, for the rest.
+// hexadecimal constants are exact in binary, so they only need rounding.
+
+__extension__ typedef unsigned __int128 u128;
+
+// beyond this, the exponent only ever gives 0 or infinity
+#define EXP_LIMIT (100000000L)
+
+// any number of digits, up to 19 significant decimal ones or 32 hexadecimal ones in `w`
+static const uint8_t *read_digits(const uint8_t *cur, int base, u128 *w, long *exp, bool *truncated) {
+	enum CharClass class = base == 16 ? CHAR_HEX: CHAR_DIGIT;
+	int max = base == 16 ? 32: 19, step = base == 16 ? 4: 1;
+	int n = 0; // significant digits in `w`
+	*w = 0;
+	*exp = 0;
+	*truncated = false;
+	for (; char_is(*cur, class); cur++) {
+		int v = char_hex_value(*cur);
+		if (n < max) {
+			*w = *w * base + v;
+			n += *w != 0;
+		} else {
+			*exp += step;
+			*truncated |= v != 0;
+		}
+	}
+	if (*cur == '.') {
+		cur++;
+		for (; char_is(*cur, class); cur++) {
+			int v = char_hex_value(*cur);
+			if (n < max) {
+				*w = *w * base + v;
+				n += *w != 0;
+				*exp -= step;
+			} else {
+				*truncated |= v != 0;
+			}
+		}
+	}
+	return cur;
+}
+
+// 8 digits at a time, wrapping around past 19 digits
+static const uint8_t *read_decimal_run(const uint8_t *cur, uint64_t *w) {
+	static const uint32_t pow10[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+	for (int n = 8; n == 8; cur += n) {
+		uint64_t x = swar_load(cur);
+		n = swar_digit_count(x, 10);
+		if (n == 0) break;
+		*w = *w * pow10[n] + swar_digit_value(x, 10, n);
+	}
+	return cur;
+}
+
+const uint8_t *read_floating(const uint8_t *f, int base, struct FloatDigits *digits) {
+	const uint8_t *cur = f, *frac = f;
+	u128 w = 0;
+	long exp = 0;
+	bool truncated = false;
+	if (base == 10) {
+		// almost always at most 19 digits, which can be read without checking for overflow
+		uint64_t w10 = 0;
+		cur = read_decimal_run(cur, &w10);
+		frac = cur;
+		if (*cur == '.') {
+			cur = read_decimal_run(cur + 1, &w10);
+			exp = -(cur - frac - 1);
+		}
+		w = w10;
+		if (cur - f - (frac != cur) > 19) {
+			const uint8_t *lead = f;
+			while (lead < cur && (*lead == '0' || *lead == '.')) lead++;
+			if (cur - lead - (lead <= frac && frac != cur) > 19) read_digits(f, 10, &w, &exp, &truncated);
+		}
+	} else {
+		cur = read_digits(f, 16, &w, &exp, &truncated);
+	}
+	// a '.' alone is not a constant
+	if (cur - f == (*f == '.')) return f;
+	digits->digits = f;
+	digits->digits_end = cur;
+
+	long e = 0;
+	if (char_lower(*cur) == (base == 16 ? 'p': 'e')) {
+		const uint8_t *p = cur + 1;
+		bool negative = *p == '-';
+		if (*p == '+' || *p == '-') p++;
+		if (!char_is(*p, CHAR_DIGIT)) return f;
+		for (; char_is(*p, CHAR_DIGIT); p++) {
+			if (e < EXP_LIMIT) e = e * 10 + (*p - '0');
+		}
+		if (negative) e = -e;
+		cur = p;
+	}
+	digits->base = base;
+	digits->w = base == 16 ? (uint64_t) (w >> 64): (uint64_t) w;
+	digits->w_lo = base == 16 ? (uint64_t) w: 0;
+	digits->exp = exp + e;
+	digits->exp10 = e;
+	digits->truncated = truncated;
+	return cur;
+}
+
+// a binary floating type, with the exponents of <float.h> minus one:
+// normal values are in [2^emin, 2^(emax+1)) with `mant_dig` significant bits.
+struct Format {
+	int mant_dig, emin, emax;
+	// for Eisel-Lemire, 0 and 0 if it does not apply to the type.
+	// outside of [smallest, largest], w * 10^q is 0 or infinity for any w.
+	int smallest_pow10, largest_pow10;
+	// the only exponents for which w * 10^q can be exactly halfway between two values
+	int min_round_even, max_round_even;
+};
+
+static const struct Format float_format = {
+	FLT_MANT_DIG, FLT_MIN_EXP - 1, FLT_MAX_EXP - 1, -65, 38, -17, 10,
+};
+static const struct Format double_format = {
+	DBL_MANT_DIG, DBL_MIN_EXP - 1, DBL_MAX_EXP - 1, -342, 308, -4, 23,
+};
+// the table of powers of 5 is not precise enough for more than 53 bits
+static const struct Format long_double_format = {
+	LDBL_MANT_DIG, LDBL_MIN_EXP - 1, LDBL_MAX_EXP - 1, 0, 0, 0, 0,
+};
+
+_Static_assert(FLT_MANT_DIG == 24 && DBL_MANT_DIG == 53, "float and double must be binary32 and binary64");
+_Static_assert(LDBL_MANT_DIG <= 126, "long double values are built from 128 bits");
+
+static int bits128(u128 x) {
+	uint64_t hi = x >> 64, lo = (uint64_t) x;
+	if (hi) return 128 - __builtin_clzll(hi);
+	if (lo) return 64 - __builtin_clzll(lo);
+	return 0;
+}
+
+// (top + r) * 2^e2 for some r in [0, 1), nonzero iff `sticky`, rounded to nearest even in `f`.
+// `top` must have at least mant_dig + 2 bits when `sticky` is set.
+static long double round_binary(u128 top, long e2, bool sticky, const struct Format *f, bool *overflow) {
+	if (top == 0) return 0.0l;
+	long e = e2 + bits128(top) - 1;
+	// the weight of the last bit kept, which is fixed below the normal range
+	long ulp = (e < f->emin ? f->emin: e) - (f->mant_dig - 1);
+	long shift = ulp - e2;
+	u128 m;
+	if (shift <= 0) {
+		m = top << -shift;
+	} else if (shift > 128) {
+		return 0.0l; // less than half of the smallest subnormal
+	} else {
+		m = shift == 128 ? 0: top >> shift;
+		u128 half = (u128) 1 << (shift - 1);
+		bool above = (top & (half - 1)) || sticky;
+		if ((top & half) && (above || (m & 1))) m++;
+	}
+	if (m >> f->mant_dig) {
+		// rounded up to the next power of 2
+		m >>= 1;
+		ulp++;
+	}
+	if (m == 0) return 0.0l;
+	if (ulp + bits128(m) - 1 > f->emax) {
+		*overflow = true;
+		return HUGE_VALL;
+	}
+	return ldexpl((long double) m, ulp);
+}
+
+#if FLT_EVAL_METHOD == 0
+static const double exact_pow10[] = {
+	1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+#endif
+
+#if LDBL_MANT_DIG >= 64
+#define LDBL_EXACT_POW10 (27)
+static const long double exact_pow10l[] = {
+	1e0l,  1e1l,  1e2l,  1e3l,  1e4l,  1e5l,  1e6l,  1e7l,  1e8l,  1e9l,
+	1e10l, 1e11l, 1e12l, 1e13l, 1e14l, 1e15l, 1e16l, 1e17l, 1e18l, 1e19l,
+	1e20l, 1e21l, 1e22l, 1e23l, 1e24l, 1e25l, 1e26l, 1e27l,
+};
+#endif
+
+// Clinger: a single operation on exact operands is correctly rounded.
+// this needs operations to be done in the type itself, hence FLT_EVAL_METHOD.
+static bool clinger(uint64_t w, long q, enum ConstantAffix suffix, long double *value) {
+	if (suffix == CONSTANT_AFFIX_L) {
+#if LDBL_MANT_DIG >= 64
+		if (q < -LDBL_EXACT_POW10 || q > LDBL_EXACT_POW10) return false;
+		long double v = w;
+		*value = q < 0 ? v / exact_pow10l[-q]: v * exact_pow10l[q];
+		return true;
+#endif
+	}
+#if FLT_EVAL_METHOD == 0
+	if (suffix == CONSTANT_AFFIX_F) {
+		if (q < -10 || q > 10 || w > UINT64_C(1) << FLT_MANT_DIG) return false;
+		float v = w, p = exact_pow10[q < 0 ? -q: q];
+		*value = q < 0 ? v / p: v * p;
+		return true;
+	}
+	if (suffix != CONSTANT_AFFIX_L) {
+		if (q < -22 || q > 22 || w > UINT64_C(1) << DBL_MANT_DIG) return false;
+		double v = w;
+		*value = q < 0 ? v / exact_pow10[-q]: v * exact_pow10[q];
+		return true;
+	}
+#endif
+	(void) w;
+	(void) q;
+	(void) value;
+	return false;
+}
+
+// the float or double with that representation
+static long double from_bits(uint64_t bits, const struct Format *f) {
+	if (f == &float_format) {
+		uint32_t b = bits;
+		float v;
+		memcpy(&v, &b, sizeof (v));
+		return v;
+	}
+	double v;
+	memcpy(&v, &bits, sizeof (v));
+	return v;
+}
+
+// Eisel-Lemire, as in "Number Parsing at a Gigabyte per Second" and fast_float:
+// w * 10^q = w * 5^q * 2^q, and the leading bits of w * 5^q come from a 128-bit product.
+// returns false in the rare case where those are not enough to round correctly.
+static bool eisel_lemire(uint64_t w, long q, const struct Format *f, long double *value, bool *overflow) {
+	if (w == 0 || q < f->smallest_pow10) {
+		*value = 0.0l;
+		return true;
+	}
+	if (q > f->largest_pow10) {
+		*overflow = true;
+		*value = HUGE_VALL;
+		return true;
+	}
+	const int explicit = f->mant_dig - 1, bias = f->emax;
+	int lz = __builtin_clzll(w);
+	w <<= lz;
+	const uint64_t *pow5 = pow5_128 + 2 * (q - POW5_SMALLEST);
+	u128 first = (u128) w * pow5[0];
+	uint64_t hi = first >> 64, lo = (uint64_t) first;
+	uint64_t precision_mask = UINT64_MAX >> (explicit + 3);
+	if ((hi & precision_mask) == precision_mask) {
+		// the bits that matter may still get a carry from the lower half of the power
+		uint64_t second = ((u128) w * pow5[1]) >> 64;
+		lo += second;
+		if (second > lo) hi++;
+	}
+	// 5^q is exact in the table for q in [-27, 55], otherwise we cannot tell
+	if (lo == UINT64_MAX && (q < -27 || q > 55)) return false;
+
+	int upperbit = hi >> 63;
+	int shift = upperbit + 64 - explicit - 3;
+	uint64_t mantissa = hi >> shift;
+	// floor(log2(10^q)) + 63, the biased exponent of the product
+	long power2 = (((152170 + 65536) * (int32_t) q) >> 16) + 63 + upperbit - lz + bias;
+	if (power2 <= 0) {
+		// subnormal, where the values cannot be halfway
+		if (-power2 + 1 >= 64) {
+			*value = 0.0l;
+			return true;
+		}
+		mantissa >>= -power2 + 1;
+		mantissa += mantissa & 1;
+		mantissa >>= 1;
+		// may have rounded up to the smallest normal, which has the same encoding
+		*value = from_bits(mantissa, f);
+		return true;
+	}
+	if (lo <= 1 && q >= f->min_round_even && q <= f->max_round_even && (mantissa & 3) == 1) {
+		// exactly halfway, round to even
+		if (mantissa << shift == hi) mantissa &= ~UINT64_C(1);
+	}
+	mantissa += mantissa & 1;
+	mantissa >>= 1;
+	if (mantissa >= UINT64_C(2) << explicit) {
+		mantissa = UINT64_C(1) << explicit;
+		power2++;
+	}
+	if (power2 >= 2 * bias + 1) {
+		*overflow = true;
+		*value = HUGE_VALL;
+		return true;
+	}
+	// the leading 1 is implicit
+	mantissa &= ~(UINT64_C(1) << explicit);
+	*value = from_bits((uint64_t) power2 << explicit | mantissa, f);
+	return true;
+}
+
+// little-endian, with no zero limb at the top
+struct Big {
+	ptrdiff_t len, cap;
+	uint32_t *limbs;
+};
+
+static bool big_reserve(struct Big *b, ptrdiff_t len) {
+	if (len <= b->cap) return true;
+	ptrdiff_t cap = b->cap ? b->cap * 2: 16;
+	while (cap < len) cap *= 2;
+	uint32_t *limbs = realloc(b->limbs, cap * sizeof (*limbs));
+	if (!limbs) return false;
+	b->limbs = limbs;
+	b->cap = cap;
+	return true;
+}
+
+static bool big_mul_add(struct Big *b, uint32_t mul, uint32_t add) {
+	uint64_t carry = add;
+	for (ptrdiff_t i = 0; i < b->len; i++) {
+		carry += (uint64_t) b->limbs[i] * mul;
+		b->limbs[i] = (uint32_t) carry;
+		carry >>= 32;
+	}
+	if (carry) {
+		if (!big_reserve(b, b->len + 1)) return false;
+		b->limbs[b->len++] = (uint32_t) carry;
+	}
+	return true;
+}
+
+static long big_bits(const struct Big *b) {
+	if (b->len == 0) return 0;
+	return b->len * 32 - __builtin_clz(b->limbs[b->len - 1]);
+}
+
+static bool big_shl(struct Big *b, long bits) {
+	if (b->len == 0) return true;
+	ptrdiff_t limbs = bits / 32, old = b->len;
+	int rest = bits % 32;
+	if (!big_reserve(b, b->len + limbs + 1)) return false;
+	b->limbs[old + limbs] = 0;
+	for (ptrdiff_t i = old - 1; i >= 0; i--) {
+		uint64_t x = (uint64_t) b->limbs[i] << rest;
+		b->limbs[i + limbs + 1] |= (uint32_t) (x >> 32);
+		b->limbs[i + limbs] = (uint32_t) x;
+	}
+	memset(b->limbs, 0, limbs * sizeof (*b->limbs));
+	b->len = old + limbs + 1;
+	while (b->len && b->limbs[b->len - 1] == 0) b->len--;
+	return true;
+}
+
+static void big_shr1(struct Big *b) {
+	for (ptrdiff_t i = 0; i < b->len; i++) {
+		b->limbs[i] >>= 1;
+		if (i + 1 < b->len) b->limbs[i] |= b->limbs[i + 1] << 31;
+	}
+	if (b->len && b->limbs[b->len - 1] == 0) b->len--;
+}
+
+static int big_cmp(const struct Big *a, const struct Big *b) {
+	if (a->len != b->len) return a->len < b->len ? -1: 1;
+	for (ptrdiff_t i = a->len - 1; i >= 0; i--) {
+		if (a->limbs[i] != b->limbs[i]) return a->limbs[i] < b->limbs[i] ? -1: 1;
+	}
+	return 0;
+}
+
+// a -= b, for a >= b
+static void big_sub(struct Big *a, const struct Big *b) {
+	int64_t borrow = 0;
+	for (ptrdiff_t i = 0; i < a->len; i++) {
+		int64_t x = (int64_t) a->limbs[i] - (i < b->len ? b->limbs[i]: 0) - borrow;
+		borrow = x < 0;
+		a->limbs[i] = (uint32_t) x;
+	}
+	while (a->len && a->limbs[a->len - 1] == 0) a->len--;
+}
+
+// 128 bits of `b` from bit `shift` up, and whether any bit under them is set
+static u128 big_extract(const struct Big *b, long shift, bool *sticky) {
+	u128 x = 0;
+	for (long i = big_bits(b) - 1; i >= shift; i--) {
+		x = x << 1 | ((b->limbs[i / 32] >> (i % 32)) & 1);
+	}
+	*sticky = false;
+	for (long i = 0; i < shift / 32; i++) *sticky |= b->limbs[i] != 0;
+	if (shift % 32) *sticky |= (b->limbs[shift / 32] & ((UINT32_C(1) << (shift % 32)) - 1)) != 0;
+	return x;
+}
+
+static bool big_pow5(struct Big *b, long k) {
+	// 5^13 is the largest power that fits in a limb
+	for (; k >= 13; k -= 13) {
+		if (!big_mul_add(b, 1220703125, 0)) return false;
+	}
+	uint32_t p = 1;
+	while (k--) p *= 5;
+	return big_mul_add(b, p, 0);
+}
+
+// the exact value of all the digits, which can always be rounded correctly
+static long double big_decimal(const struct FloatDigits *d, const struct Format *f, bool *overflow, bool *ok) {
+	static const uint32_t pow10[10] = {
+		1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000,
+	};
+	struct Big num = { 0 }, den = { 0 };
+	long double value = 0.0l;
+	*ok = false;
+
+	// value = num * 10^q, without the leading and trailing zeros
+	long q = d->exp10, nd = 0, zeros = 0;
+	uint32_t chunk = 0;
+	int chunk_len = 0;
+	bool fraction = false;
+	for (const uint8_t *c = d->digits; c < d->digits_end; c++) {
+		if (*c == '.') {
+			fraction = true;
+			continue;
+		}
+		int v = *c - '0';
+		q -= fraction;
+		if (v == 0) {
+			zeros += nd != 0;
+			continue;
+		}
+		for (zeros++; zeros; zeros--) {
+			chunk = chunk * 10 + (zeros == 1 ? v: 0);
+			nd++;
+			if (++chunk_len == 9) {
+				if (!big_mul_add(&num, pow10[9], chunk)) goto end;
+				chunk = 0;
+				chunk_len = 0;
+			}
+		}
+	}
+	if (!big_mul_add(&num, pow10[chunk_len], chunk)) goto end;
+	q += zeros;
+	*ok = true;
+	if (nd == 0) goto end;
+
+	// value is in [10^(nd+q-1), 10^(nd+q)), and log10(2) < 0.30103
+	if ((long long) (nd + q - 1) * 100000 > (long long) (f->emax + 1) * 30103) {
+		*overflow = true;
+		value = HUGE_VALL;
+		goto end;
+	}
+	if ((long long) (nd + q) * 100000 < (long long) (f->emin - f->mant_dig) * 30103) goto end;
+
+	*ok = false;
+	bool sticky;
+	u128 top;
+	long e2;
+	if (q >= 0) {
+		// num * 5^q * 2^q
+		if (!big_pow5(&num, q)) goto end;
+		long shift = big_bits(&num) > 128 ? big_bits(&num) - 128: 0;
+		top = big_extract(&num, shift, &sticky);
+		e2 = shift + q;
+	} else {
+		// num / 5^-q * 2^q, with 128 bits of quotient
+		if (!big_mul_add(&den, 1, 1) || !big_pow5(&den, -q)) goto end;
+		long s = big_bits(&den) - big_bits(&num) + 127;
+		if (!(s >= 0 ? big_shl(&num, s): big_shl(&den, -s))) goto end;
+		if (!big_shl(&den, 127)) goto end;
+		top = 0;
+		for (int i = 127; i >= 0; i--) {
+			if (big_cmp(&num, &den) >= 0) {
+				big_sub(&num, &den);
+				top |= (u128) 1 << i;
+			}
+			big_shr1(&den);
+		}
+		sticky = num.len != 0;
+		e2 = q - s;
+	}
+	*ok = true;
+	value = round_binary(top, e2, sticky, f, overflow);
+end:
+	free(num.limbs);
+	free(den.limbs);
+	return value;
+}
+
+long double floating_value(const struct FloatDigits *digits, enum ConstantAffix suffix, bool *overflow) {
+	const struct Format *f = suffix == CONSTANT_AFFIX_F ? &float_format:
+		suffix == CONSTANT_AFFIX_L ? &long_double_format: &double_format;
+	*overflow = false;
+	if (digits->base == 16) {
+		u128 w = (u128) digits->w << 64 | digits->w_lo;
+		return round_binary(w, digits->exp, digits->truncated, f, overflow);
+	}
+
+	long double value;
+	if (!digits->truncated && clinger(digits->w, digits->exp, suffix, &value)) return value;
+	if (f->smallest_pow10 != f->largest_pow10 && eisel_lemire(digits->w, digits->exp, f, &value, overflow)) {
+		// with truncated digits, the value is between those of w and w + 1
+		long double next;
+		if (!digits->truncated) return value;
+		if (eisel_lemire(digits->w + 1, digits->exp, f, &next, overflow) && next == value) return value;
+	}
+	*overflow = false;
+	bool ok;
+	value = big_decimal(digits, f, overflow, &ok);
+	if (!ok) diagnose("could not allocate memory for a floating constant.\n");
+	return value;
+}
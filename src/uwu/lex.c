@@ -3,10 +3,8 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
-#include <ctype.h>
 #include <stddef.h>
 #include <assert.h>
-#include <math.h>
 #include <inttypes.h>
 
 #include "uwu/lex.h"
@@ -14,8 +12,13 @@
 #include <intern/intern.h>
 #include "common/data.h"
 #include <stream/utf-8.h>
+#include <uwu/keywords.h>
+#include <common/charclass.h>
+#include <common/log.h>
+#include <uwu/scan.h>
+#include <uwu/float.h>
 
-static enum TokenKind keyword_id(const uint8_t *str, ptrdiff_t len);
+#define LITERALS_CHUNK (64 * 1024)
 
 static inline bool is_token(struct Lexer *lexer, enum TokenKind kind) {
 	return lexer->token.kind == kind;
@@ -31,16 +34,14 @@ static inline bool match_token(struct Lexer *lexer, enum TokenKind kind) {
 
 static inline void expect_token(struct Lexer *lexer, enum TokenKind kind) {
 	if (!match_token(lexer, kind)) {
-		printf("expected token detail %d, got %d.\n", kind, lexer->token.kind);
+		diagnose("expected token detail %d, got %d.\n", kind, lexer->token.kind);
 		lexer->token.kind = TOKEN_NONE;
 		lexer->cur = lexer->buf + lexer->len;
 	}
 }
 
 int cp2hex(uint32_t c) {
-	uint32_t l = tolower(c);
-	if (l > '9') return l - 'a' + 0xa;
-	return l - '0';
+	return char_hex_value(c);
 }
 
 static bool is_valid_universal(uint32_t c);
@@ -62,46 +63,81 @@ uint32_t next_codepoint(const uint8_t *stream, uint8_t **endptr);
 int lexer_init(struct Lexer *lexer, const char *name) {
 	int ret = -1;
 	if (!lexer) goto early;
-	Stream stream = stream_init(name, C_STREAM_READ|C_STREAM_TEXT|C_STREAM_UTF_8);
+	Stream stream = stream_init(name, C_STREAM_MMAP|C_STREAM_TEXT|C_STREAM_UTF_8);
 	if (!stream) goto early;
-	long size = stream_size(stream);
-	lexer->buf = malloc(size+1);
+	ptrdiff_t size;
+	// the view is NUL-terminated by its padding, nothing is copied
+	lexer->buf = stream_view(stream, &size);
 	if (!lexer->buf) goto end;
+	if (size > UINT32_MAX) {
+		diagnose("file too big for 32-bit token offsets.\n");
+		goto end;
+	}
 
+	lexer->stream = stream;
+	lexer->name = stream_name(stream, NULL);
 	lexer->cur = lexer->buf;
-	lexer->token.kind = TOKEN_NONE;
-	if ((ret = intern_init(&lexer->identifiers))) goto end;
 	lexer->len = size;
-	ret = -1;
-
-	if (stream_read(stream, lexer->buf, size) != size) goto end;
-	lexer->buf[size] = '\0';
-	ret = 0;
+	lexer->base = 0;
+	lexer->token.kind = TOKEN_NONE;
+	if ((ret = line_index_init(&lexer->lines))) goto end;
+	if ((ret = line_index_add(&lexer->lines, lexer->buf, size, 0))) goto lines;
+	if ((ret = intern_init(&lexer->identifiers))) goto lines;
+	if ((ret = arena_init(&lexer->literals, LITERALS_CHUNK))) goto interns;
+	return 0;
+interns:
+	intern_fini(&lexer->identifiers);
+lines:
+	line_index_fini(&lexer->lines);
 end:
 	stream_fini(stream);
-	if (ret != 0) free(lexer->buf);
 early:
 	return ret;
 }
 
+int lexer_init_buffer(struct Lexer *lexer, const uint8_t *buf, long len) {
+	int ret = -1;
+	if (!lexer) return ret;
+	lexer->stream = NULL;
+	lexer->name = NULL;
+	lexer->len = lexer->base = 0;
+	lexer->token.kind = TOKEN_NONE;
+	if ((ret = line_index_init(&lexer->lines))) return ret;
+	if ((ret = lexer_feed(lexer, buf, len))) goto lines;
+	if ((ret = intern_init(&lexer->identifiers))) goto lines;
+	if ((ret = arena_init(&lexer->literals, LITERALS_CHUNK))) goto interns;
+	return 0;
+interns:
+	intern_fini(&lexer->identifiers);
+lines:
+	line_index_fini(&lexer->lines);
+	return ret;
+}
+
+int lexer_feed(struct Lexer *lexer, const uint8_t *buf, long len) {
+	if (lexer->base + lexer->len + len > UINT32_MAX) {
+		diagnose("file too big for 32-bit token offsets.\n");
+		return -1;
+	}
+	lexer->base += lexer->len;
+	lexer->buf = lexer->cur = buf;
+	lexer->len = len;
+	return line_index_add(&lexer->lines, buf, len, lexer->base);
+}
+
 void lexer_fini(struct Lexer *lexer) {
 	if (!lexer) return;
-	free(lexer->buf);
+	stream_fini(lexer->stream);
+	line_index_fini(&lexer->lines);
 	intern_fini(&lexer->identifiers);
+	arena_fini(&lexer->literals);
 	memset(lexer, 0, sizeof *lexer);
 }
 
 enum LexerStatus lexer_next(struct Lexer *lexer) {
 	if (!lexer->cur) goto empty;
-	if (lexer->token.kind == TOKEN_STRING_LITERAL) {
-		free(lexer->token.lit.sequence);
-	}
 	const uint8_t *end;
 again:
-#ifndef NDEBUG
-	lexer->token.start = lexer->cur;
-#endif
-	;
 	uint8_t *out;
 	uint32_t cp = codepoint_utf_8(lexer->cur, &out);
 	end = out;
@@ -112,9 +148,7 @@ again:
 	case '\r':
 	case '\f':
 	case '\n':
-		while (isspace(*lexer->cur)) {
-			if (*lexer->cur++ == '\n') lexer->line++;
-		}
+		lexer->cur = skip_space(lexer->cur);
 		goto again;
 	empty:
 	case '\0':
@@ -140,15 +174,15 @@ again:
 		end = lex_string(lexer);
 		break;
 	case '.': // can also be the start of a decimal floating constant
-		if (isdigit(lexer->cur[1])) {
+		if (char_is(lexer->cur[1], CHAR_DIGIT)) {
 			end = lex_floating(lexer, 10);
 		} else {
-			end = lexer->cur;
-			if (*end == '.' && lexer->cur[1] == '.') {
+			if (lexer->cur[1] == '.' && lexer->cur[2] == '.') {
 				lexer->token.kind = TOKEN_ELLIPSIS;
-				end += 2;
+				end = lexer->cur + 3;
 			} else {
 				lexer->token.kind = TOKEN_DOT;
+				end = lexer->cur + 1;
 			}
 		}
 		break;
@@ -250,23 +284,146 @@ again:
 #undef CASE3
 #undef CASE2
 #undef CASE1
-	default:
-		printf("unexpected character %lc (U+%04" PRIX32 ").\n", cp, cp);
+	default: {
+		long column, line = lexer_line(lexer, lexer->base + (lexer->cur - lexer->buf), &column);
+		diagnose("%s%s%ld:%ld: unexpected character %lc (U+%04" PRIX32 ").\n",
+				lexer->name ? lexer->name: "", lexer->name ? ":": "", line, column, cp, cp);
 		end = NULL;
 		break;
 	}
+	}
 	if (!end) {
 		lexer->token.kind = TOKEN_NONE;
 		codepoint_utf_8(lexer->cur, &out);
 		end = out;
 	}
-#ifndef NDEBUG
-	lexer->token.len = end - lexer->token.start;
-#endif
+	lexer->token.offset = lexer->base + (lexer->cur - lexer->buf);
+	lexer->token.len = end - lexer->cur;
 	lexer->cur = end;
 	return LEXER_VALID;
 }
 
+_Static_assert(TOKEN_END <= UINT8_MAX, "token kinds must fit in `TokenBuffer.kinds`");
+
+// makes room for one more element in `table`, which has `len`, `cap` and `items`
+#define RESERVE(table) \
+	((table).len < (table).cap || grow((void **) &(table).items, &(table).cap, sizeof (*(table).items)))
+
+static bool grow(void **items, ptrdiff_t *cap, size_t size) {
+	ptrdiff_t c = *cap ? *cap * 2: 256;
+	void *tmp = realloc(*items, c * size);
+	if (!tmp) return false;
+	*items = tmp;
+	*cap = c;
+	return true;
+}
+
+static bool reserve_tokens(struct TokenBuffer *tokens, ptrdiff_t c) {
+	uint8_t *kinds = realloc(tokens->kinds, c * sizeof (*kinds));
+	if (kinds) tokens->kinds = kinds;
+	uint32_t *offsets = realloc(tokens->offsets, c * sizeof (*offsets));
+	if (offsets) tokens->offsets = offsets;
+	uint32_t *payloads = realloc(tokens->payloads, c * sizeof (*payloads));
+	if (payloads) tokens->payloads = payloads;
+	if (!kinds || !offsets || !payloads) return false;
+	tokens->cap = c;
+	return true;
+}
+
+int lexer_tokenize_all(struct Lexer *lexer, struct TokenBuffer *tokens) {
+	// C has about a token every 4 bytes, the pages that end up unused are never touched
+	if (!tokens->cap && !reserve_tokens(tokens, lexer->len / 4 + 1024)) goto oom;
+	enum LexerStatus s;
+	while ((s = lexer_next(lexer)) == LEXER_VALID) {
+		if (tokens->len == tokens->cap && !reserve_tokens(tokens, tokens->cap * 2)) goto oom;
+		const struct Token *token = &lexer->token;
+		// a token that reads nothing would be read again forever
+		assert(token->len > 0);
+		if (!token->len) {
+			diagnose("no progress at offset %" PRIu32 ".\n", token->offset);
+			return -1;
+		}
+		const uint8_t kind = token->kind;
+		uint32_t payload = 0;
+		switch (kind) {
+		case TOKEN_IDENTIFIER:
+			payload = token->ident.detail->id;
+			break;
+		case TOKEN_INTEGER_CONSTANT:
+			if (!RESERVE(tokens->integers)) goto oom;
+			payload = tokens->integers.len;
+			tokens->integers.items[tokens->integers.len++] = token->integer;
+			break;
+		case TOKEN_FLOATING_CONSTANT:
+			if (!RESERVE(tokens->floatings)) goto oom;
+			payload = tokens->floatings.len;
+			tokens->floatings.items[tokens->floatings.len++] = token->floating;
+			break;
+		case TOKEN_CHARACTER_CONSTANT:
+			if (!RESERVE(tokens->characters)) goto oom;
+			payload = tokens->characters.len;
+			tokens->characters.items[tokens->characters.len++] = token->character;
+			break;
+		case TOKEN_STRING_LITERAL:
+			if (!RESERVE(tokens->literals)) goto oom;
+			payload = tokens->literals.len;
+			tokens->literals.items[tokens->literals.len++] = token->lit;
+			break;
+		default:
+			break;
+		}
+		tokens->kinds[tokens->len] = kind;
+		tokens->offsets[tokens->len] = token->offset;
+		tokens->payloads[tokens->len] = payload;
+		tokens->len++;
+	}
+	return s == LEXER_END ? 0: -1;
+oom:
+	diagnose("could not grow token buffer past %td tokens.\n", tokens->len);
+	return -1;
+}
+
+#undef RESERVE
+
+void token_buffer_fini(struct TokenBuffer *tokens) {
+	if (!tokens) return;
+	free(tokens->kinds);
+	free(tokens->offsets);
+	free(tokens->payloads);
+	free(tokens->integers.items);
+	free(tokens->floatings.items);
+	free(tokens->characters.items);
+	free(tokens->literals.items);
+	memset(tokens, 0, sizeof *tokens);
+}
+
+void token_at(const struct TokenBuffer *tokens, const struct Lexer *lexer, ptrdiff_t i, struct Token *token) {
+	const uint8_t kind = tokens->kinds[i];
+	uint32_t payload = tokens->payloads[i];
+	token->kind = kind;
+	token->offset = tokens->offsets[i];
+	token->len = 0; // the end is not kept
+	switch (kind) {
+	case TOKEN_IDENTIFIER:
+		token->ident.detail = lexer->identifiers.interns[payload];
+		break;
+	case TOKEN_INTEGER_CONSTANT:
+		token->integer = tokens->integers.items[payload];
+		break;
+	case TOKEN_FLOATING_CONSTANT:
+		token->floating = tokens->floatings.items[payload];
+		break;
+	case TOKEN_CHARACTER_CONSTANT:
+		token->character = tokens->characters.items[payload];
+		break;
+	case TOKEN_STRING_LITERAL:
+		token->lit = tokens->literals.items[payload];
+		break;
+	default:
+		break;
+	}
+}
+
 void lexer_dump(const struct Lexer *lexer) {
 	printf("in:\n");
 	printf("%s", lexer->buf);
@@ -276,13 +433,16 @@ void lexer_dump(const struct Lexer *lexer) {
 	print_interns(&lexer->identifiers);
 }
 
+long lexer_line(const struct Lexer *lexer, uint32_t offset, long *column) {
+	return line_index_find(&lexer->lines, offset, column);
+}
+
 enum TokenKind keyword_id(const uint8_t *str, ptrdiff_t len) {
-	const struct Interns *kws = get_keyword_interns();
-	const struct InternString *in = intern_find(kws, str, len);
-	if (in) {
-		return in - kws->interns + TOKEN_KEYWORD_START;
-	}
-	return TOKEN_NONE;
+	if (len < KEYWORD_MIN_LEN || len > KEYWORD_MAX_LEN) return TOKEN_NONE;
+	// perfect hash, there is at most one candidate
+	unsigned slot = (len + keyword_asso[str[0]] + keyword_asso[str[len-1]]) & KEYWORD_HASH_MASK;
+	if (keyword_slots[slot].len != len || memcmp(keyword_slots[slot].str, str, len)) return TOKEN_NONE;
+	return keyword_slots[slot].kind;
 }
 
 bool is_valid_universal(uint32_t c) {
@@ -291,17 +451,15 @@ bool is_valid_universal(uint32_t c) {
 }
 
 uint8_t xtoint(uint32_t x) {
-	if (!isxdigit(x)) __builtin_unreachable();
-	if (isdigit(x)) return x - '0';
-	if (islower(x)) return x - 'a' + 0xa;
-	return x - 'A' + 0xA;
+	if (!char_is(x, CHAR_HEX)) __builtin_unreachable();
+	return char_hex_value(x);
 }
 
 uint32_t xstoint(const uint8_t *x, int n, uint8_t **endptr) {
 	uint32_t value = 0;
 	const uint8_t *cur = x;
 	for (int i = 0; i < n; i++, cur++) {
-		if (!isxdigit(*cur)) goto err;
+		if (!char_is(*cur, CHAR_HEX)) goto err;
 		value = value * 16 | xtoint(*cur);
 	}
 	if (endptr) *endptr = (uint8_t *) cur;
@@ -356,32 +514,32 @@ uint32_t read_escape_sequence(const uint8_t *start, uint8_t **endptr) {
 		break;
 	case 'x':
 		// having 1 character is okay here
-		for (int i = 0; i < 2 && isxdigit(*end); i++, end++)
+		for (int i = 0; i < 2 && char_is(*end, CHAR_HEX); i++, end++)
 			value = value * 16 | cp2hex(*end);
 		break;
 	case 'u':
 		// skip the u/U
 		value = xstoint(start+1, 4, &out);
 		if (out == start+1) {
-			printf("universal character escape sequence needs 4 nibbles.\n");
+			diagnose("universal character escape sequence needs 4 nibbles.\n");
 		}
 		if (!is_valid_universal(value)) {
-			printf("code point %lc (U+%" PRIX32 ") is invalid.\n", value, value);
+			diagnose("code point %lc (U+%" PRIX32 ") is invalid.\n", value, value);
 		}
 		end = out;
 		break;
 	case 'U':
 		value = xstoint(start+1, 8, &out);
 		if (out == start+1) {
-			printf("universal character escape sequence needs 8 nibbles.\n");
+			diagnose("universal character escape sequence needs 8 nibbles.\n");
 		}
 		if (!is_valid_universal(value)) {
-			printf("code point %lc (U+%" PRIX32 ") is invalid.\n", value, value);
+			diagnose("code point %lc (U+%" PRIX32 ") is invalid.\n", value, value);
 		}
 		end = out;
 		break;
 	default:
-		printf("unknown escape sequence `\\%c`.\n", *end);
+		diagnose("unknown escape sequence `\\%c`.\n", *end);
 		break;
 	}
 	if (endptr) *endptr = (uint8_t *) end;
@@ -389,10 +547,9 @@ uint32_t read_escape_sequence(const uint8_t *start, uint8_t **endptr) {
 }
 
 const uint8_t *lex_word(struct Lexer *lexer) {
-	const uint8_t *start = lexer->cur, *end = start;
-	while (isalnum(*end) || *end == '_') end++;
+	const uint8_t *start = lexer->cur, *end = skip_ident(start);
 	if (*end == '\0') {
-		printf("end of file in identifier name.\n");
+		diagnose("end of file in identifier name.\n");
 		return NULL;
 	}
 	long len = end - start;
@@ -403,7 +560,7 @@ const uint8_t *lex_word(struct Lexer *lexer) {
 		lexer->token.kind = TOKEN_IDENTIFIER;
 		lexer->token.ident.detail = intern_string(&lexer->identifiers, start, len);
 		if (!lexer->token.ident.detail) {
-			fprintf(stderr, "could not intern string `%.*s`.\n", (int) len, start);
+			diagnose("could not intern string `%.*s`.\n", (int) len, start);
 			return start;
 		}
 	}
@@ -414,18 +571,17 @@ const uint8_t *lex_number(struct Lexer *lexer) {
 	int base = 10;
 	const uint8_t *cur = lexer->cur;
 	if (*cur++ == '0') {
-		if (tolower(*cur) == 'x') {
+		if (char_lower(*cur) == 'x') {
 			base = 16;
-			cur++;
-			while (isxdigit(*cur)) cur++;
+			cur = skip_digits(cur + 1, 16);
 		} else {
 			base = 8;
-			while (*cur >= '0' && *cur <= '7') cur++;
+			cur = skip_digits(cur, 8);
 		}
 	} else {
-		while (isdigit(*cur)) cur++;
+		cur = skip_digits(cur, 10);
 	}
-	if (*cur == '.' || tolower(*cur) == 'e' || tolower(*cur) == 'p') {
+	if (*cur == '.' || char_lower(*cur) == 'e' || char_lower(*cur) == 'p') {
 		return lex_floating(lexer, base);
 	}
 	return lex_integer(lexer, base);
@@ -446,18 +602,18 @@ uint32_t read_character(const uint8_t *ch, bool is_wide, uint8_t **endptr) {
 		if (out == end) goto err;
 		end = out;
 		if (!is_wide && cp >= 0x7F) {
-			printf("universal character in character literal.\n");
+			diagnose("universal character in character literal.\n");
 		}
 		value = cp;
 	}
 	if (cnt > 1) {
-		printf("multiple characters inside of one character literal.\n");
+		diagnose("multiple characters inside of one character literal.\n");
 	}
 	if (*end == '\0') {
-		printf("unexpected end of file in character literal.\n");
+		diagnose("unexpected end of file in character literal.\n");
 		goto err;
 	} else if (*end == '\n') {
-		printf("unexpected newline in character literal.\n");
+		diagnose("unexpected newline in character literal.\n");
 		goto err;
 	}
 	assert(*end == '\'');
@@ -528,9 +684,9 @@ const uint8_t *lex_string(struct Lexer *lexer) {
 	end = out;
 	lexer->token.kind = TOKEN_STRING_LITERAL;
 
-	uint8_t *string = malloc(len + 1);
+	uint8_t *string = arena_alloc(&lexer->literals, len + 1, 1);
 	if (!string) {
-		fprintf(stderr, "could not interpret string of length %td.\n", len + 1);
+		diagnose("could not interpret string of length %td.\n", len + 1);
 		return NULL;
 	}
 	encode_narrow(string, '"', start);
@@ -542,15 +698,19 @@ const uint8_t *lex_string(struct Lexer *lexer) {
 }
 
 uintmax_t read_integer(const uint8_t *i, int base, uint8_t **endptr) {
+	static const uint32_t pow10[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
 	uintmax_t val = 0;
 	const uint8_t *c = i;
-	for (; isxdigit(*c); c++) {
-		int d = cp2hex(*c);
-		if (d >= base) goto end;
-		uintmax_t next = (val * base) + d;
-		if (next < val) goto end;
-		val = next;
-	}
+	for (int n = 8; n == 8; c += n) {
+		uint64_t x = swar_load(c);
+		n = swar_digit_count(x, base);
+		if (n == 0) break;
+		uintmax_t scale = base == 10 ? pow10[n]: (uintmax_t) 1 << (n * (base == 16 ? 4: 3));
+		if (__builtin_mul_overflow(val, scale, &val)) goto end;
+		if (__builtin_add_overflow(val, swar_digit_value(x, base, n), &val)) goto end;
+	}
+	// a digit too large for the base
+	if (char_is(*c, CHAR_HEX)) goto end;
 	if (endptr) *endptr = (uint8_t *) c;
 	return val;
 end:
@@ -568,12 +728,12 @@ const uint8_t *lex_integer(struct Lexer *lexer, int base) {
 	if (out == end) return NULL;
 	end = out;
 	int usuffix = 0, lsuffix = 0, llsuffix = 0;
-	for (uint32_t suff, it = 0; suff = tolower(*end), suff == 'u' || suff == 'l'; end++, it++) {
+	for (uint32_t suff, it = 0; suff = char_lower(*end), suff == 'u' || suff == 'l'; end++, it++) {
 		if (it > 4) return NULL; // no suffix is that long, but just incase of a degenerate case
 		if (suff == 'u') {
 			usuffix++;
 		} else if (suff == 'l') {
-			if (tolower(end[1]) == 'l') {
+			if (char_lower(end[1]) == 'l') {
 				end++;
 				llsuffix++;
 			} else {
@@ -589,7 +749,7 @@ const uint8_t *lex_integer(struct Lexer *lexer, int base) {
 	else if (usuffix == 1 && lsuffix == 1 && llsuffix == 0) suffix = CONSTANT_AFFIX_UL;
 	else if (usuffix == 1 && lsuffix == 0 && llsuffix == 1) suffix = CONSTANT_AFFIX_ULL;
 	else {
-		printf("invalid integer constant suffix : '%.*s'.\n", (int)(end - out), out);
+		diagnose("invalid integer constant suffix : '%.*s'.\n", (int)(end - out), out);
 		return NULL;
 	}
 
@@ -599,96 +759,21 @@ const uint8_t *lex_integer(struct Lexer *lexer, int base) {
 	return end;
 }
 
-long double read_floating_exponent(const uint8_t *f, long double expbase, uint8_t **endptr) {
-	const uint8_t *cur = f + 1; // skip e/E/p/P
-	long double sign = +1.0l;
-	if (*cur == '+') {
-		cur++;
-	} else if (*cur == '-') {
-		cur++;
-		sign = -1.0l;
-	}
-
-	// cannot use read_integer because 10f is a valid decimal exponent but not integer
-	uintmax_t e = 0;
-	while (isdigit(*cur)) {
-		int i = cp2hex(*cur);
-		if (i >= 10) goto err;
-		uintmax_t next = e * 10 + i;
-		if (next < e) {
-			printf("exponent of floating constant overflows.\n");
-		}
-		e = next;
-		cur++;
-	}
-	if (endptr) *endptr = (uint8_t *) cur;
-	return powl(expbase, e * sign);
-err:
-	if (endptr) *endptr = (uint8_t *) f;
-	return 0.0l;
-}
-
-long double read_floating_decimal(const uint8_t *f, uint8_t **endptr) {
-	long double d = 0.0l, base = 10.0l;
-	const uint8_t *cur = f;
-	for (; isdigit(*cur); cur++)
-		d = d * base + cp2hex(*cur); // no need to worry about overflow in floating point
-	if (*cur == '.') {
-		cur++;
-		for (long double div = base; isdigit(*cur); div *= base, cur++)
-			d += cp2hex(*cur) / div;
-	}
-	if (tolower(*cur) == 'e') {
-		uint8_t *out;
-		d *= read_floating_exponent(cur, 10.0l, &out);
-		if (out == cur) goto err;
-		cur = out;
-	}
-	if (endptr) *endptr = (uint8_t *) cur;
-	return d;
-err:
-	if (endptr) *endptr = (uint8_t *) f;
-	return 0.0l;
-}
-
-long double read_floating_hexadecimal(const uint8_t *f, uint8_t **endptr) {
-	long double d = 0.0l, base = 16.0l;
-	const uint8_t *cur = f;
-	for (; isxdigit(*cur); cur++)
-		d = d * base + cp2hex(*cur);
-	if (*cur == '.') {
-		cur++;
-		for (long double div = base; isxdigit(*cur); div *= base, cur++)
-			d += cp2hex(*cur) / div;
-	}
-	if (tolower(*cur) == 'p') {
-		uint8_t *out;
-		d *= read_floating_exponent(cur, 2.0l, &out);
-		if (out == cur) goto err;
-		cur = out;
-	}
-	if (endptr) *endptr = (uint8_t *) cur;
-	return d;
-err:
-	if (endptr) *endptr = (uint8_t *) f;
-	return 0.0l;
-}
-
 const uint8_t *lex_floating(struct Lexer *lexer, int base) {
 	const uint8_t *start = lexer->cur, *end = start;
-	uint8_t *out;
-	long double val;
-	if (base == 10) {
-		val = read_floating_decimal(end, &out);
-	} else if (base == 16) {
+	struct FloatDigits digits;
+	if (base == 16) {
 		end += 2; // skip 0x
-		val = read_floating_hexadecimal(end, &out);
+	} else {
+		// a leading 0 does not make a floating constant octal
+		base = 10;
 	}
+	const uint8_t *out = read_floating(end, base, &digits);
 	if (out == end) return NULL;
 	end = out;
 
 	int lsuffix = 0, fsuffix = 0;
-	for (uint32_t suff, it = 0; suff = tolower(*end), suff == 'l' || suff == 'f'; end++, it++) {
+	for (uint32_t suff, it = 0; suff = char_lower(*end), suff == 'l' || suff == 'f'; end++, it++) {
 		if (it > 4) return NULL;
 		if (suff == 'l') lsuffix++;
 		else             fsuffix++;
@@ -698,10 +783,16 @@ const uint8_t *lex_floating(struct Lexer *lexer, int base) {
 	else if (lsuffix == 1 && fsuffix == 0) suffix = CONSTANT_AFFIX_L;
 	else if (lsuffix == 0 && fsuffix == 1) suffix = CONSTANT_AFFIX_F;
 	else {
-		printf("invalid floating constant suffix : '%.*s'.\n", (int)(end - out), out);
+		diagnose("invalid floating constant suffix : '%.*s'.\n", (int)(end - out), out);
 		return NULL;
 	}
 
+	bool overflow;
+	long double val = floating_value(&digits, suffix, &overflow);
+	if (overflow) {
+		diagnose("floating constant is out of range : '%.*s'.\n", (int)(end - start), start);
+	}
+
 	lexer->token.kind = TOKEN_FLOATING_CONSTANT;
 	lexer->token.floating.value = val;
 	lexer->token.floating.suffix = suffix;
@@ -772,9 +863,9 @@ const uint8_t *lex_wide_string(struct Lexer *lexer) {
 	end = out;
 	lexer->token.kind = TOKEN_STRING_LITERAL;
 
-	uint32_t *string = malloc((len + 1) * sizeof (*string));
+	uint32_t *string = arena_alloc(&lexer->literals, (len + 1) * sizeof (*string), ARENA_ALIGNOF(uint32_t));
 	if (!string) {
-		fprintf(stderr, "could not interpret string of length %td.\n", (len + 1) * sizeof (*string));
+		diagnose("could not interpret string of length %td.\n", (len + 1) * sizeof (*string));
 		return NULL;
 	}
 	encode_wide(string, '"', start);
@@ -0,0 +1,49 @@
+#include "uwu/lines.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "uwu/scan.h"
+
+int line_index_init(struct LineIndex *lines) {
+	if (!lines) return -1;
+	memset(lines, 0, sizeof (*lines));
+	lines->starts = malloc(64 * sizeof (*lines->starts));
+	if (!lines->starts) return -1;
+	lines->cap = 64;
+	lines->starts[lines->len++] = 0;
+	return 0;
+}
+
+void line_index_fini(struct LineIndex *lines) {
+	if (!lines) return;
+	free(lines->starts);
+	memset(lines, 0, sizeof (*lines));
+}
+
+int line_index_add(struct LineIndex *lines, const uint8_t *buf, long len, uint32_t base) {
+	// counting first costs a second pass over `buf`, which is still much cheaper
+	// than growing the array a vector at a time
+	long n = find_newlines(buf, len, base, NULL);
+	if (lines->len + n > lines->cap) {
+		ptrdiff_t cap = lines->cap * 2 > lines->len + n ? lines->cap * 2: lines->len + n;
+		uint32_t *starts = realloc(lines->starts, cap * sizeof (*starts));
+		if (!starts) return -1;
+		lines->starts = starts;
+		lines->cap = cap;
+	}
+	lines->len += find_newlines(buf, len, base, lines->starts + lines->len);
+	return 0;
+}
+
+long line_index_find(const struct LineIndex *lines, uint32_t offset, long *column) {
+	// the last line that starts at or before `offset`
+	ptrdiff_t lo = 0, hi = lines->len;
+	while (hi - lo > 1) {
+		ptrdiff_t mid = lo + (hi - lo) / 2;
+		if (lines->starts[mid] <= offset) lo = mid;
+		else hi = mid;
+	}
+	*column = offset - lines->starts[lo] + 1;
+	return lo + 1;
+}
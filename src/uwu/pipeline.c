@@ -0,0 +1,168 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <sched.h>
+
+#include "uwu/pipeline.h"
+#include <pp/pre.h>
+#include <common/log.h>
+
+// tries before going to sleep, a wake-up costs far more than a few loads
+#define SPINS (32)
+
+static bool has_chunk(struct Pipeline *pl) {
+	return __atomic_load_n(&pl->tail, __ATOMIC_ACQUIRE) != pl->head;
+}
+
+static bool has_slot(struct Pipeline *pl) {
+	return pl->tail - __atomic_load_n(&pl->head, __ATOMIC_ACQUIRE) < PIPELINE_SLOTS
+		|| __atomic_load_n(&pl->cancel, __ATOMIC_ACQUIRE);
+}
+
+static void wait_until(struct Pipeline *pl, bool (*ready)(struct Pipeline *)) {
+	for (int i = 0; i < SPINS; i++) {
+		if (ready(pl)) return;
+		sched_yield();
+	}
+	pthread_mutex_lock(&pl->lock);
+	__atomic_add_fetch(&pl->sleepers, 1, __ATOMIC_SEQ_CST);
+	// pairs with the fence in `publish`: either this sees the new index,
+	// or the other side sees a sleeper and wakes it up
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	while (!ready(pl)) pthread_cond_wait(&pl->wake, &pl->lock);
+	__atomic_sub_fetch(&pl->sleepers, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&pl->lock);
+}
+
+// moves `head` or `tail` on, which only its owner ever writes
+static void publish(struct Pipeline *pl, uint32_t *index) {
+	__atomic_store_n(index, *index + 1, __ATOMIC_RELEASE);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&pl->sleepers, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&pl->lock);
+		pthread_cond_broadcast(&pl->wake);
+		pthread_mutex_unlock(&pl->lock);
+	}
+}
+
+static bool is_drained(struct Pipeline *pl) {
+	return __atomic_load_n(&pl->head, __ATOMIC_ACQUIRE) == pl->tail
+		|| __atomic_load_n(&pl->cancel, __ATOMIC_ACQUIRE);
+}
+
+// room for `len` bytes in every slot. they all move, so once the lexer is done with them
+static bool reserve(struct Pipeline *pl, long len) {
+	long cap = len + 1 + C_STREAM_PADDING;
+	if (cap <= pl->slot_cap) return true;
+	wait_until(pl, &is_drained);
+	uint8_t *slots = realloc(pl->slots, PIPELINE_SLOTS * cap);
+	if (!slots) return false;
+	pl->slots = slots;
+	pl->slot_cap = cap;
+	return true;
+}
+
+static void *preprocess_chunks(void *arg) {
+	struct Pipeline *pl = arg;
+	long start = 0;
+	for (bool last = false; !last;) {
+		wait_until(pl, &has_slot);
+		if (__atomic_load_n(&pl->cancel, __ATOMIC_ACQUIRE)) break;
+		struct PipelineChunk *chunk = &pl->chunks[pl->tail % PIPELINE_SLOTS];
+		uint8_t *buf = NULL;
+		long take, used, len;
+		for (long window = pl->chunk_size;; window *= 2) {
+			take = pl->len - start < window ? pl->len - start: window;
+			used = 0;
+			len = -1;
+			last = start + take == pl->len;
+			if (!reserve(pl, take)) {
+				diagnose("could not allocate a chunk of %ld bytes.\n", take);
+				break;
+			}
+			buf = pl->slots + pl->tail % PIPELINE_SLOTS * pl->slot_cap;
+			memcpy(buf, pl->view + start, take);
+			buf[take] = '\0';
+			len = internalize_part((char *) buf, last, &used);
+			// otherwise a comment or a literal longer than the window, or no newline at all
+			if (len < 0 || last || used > 0) break;
+		}
+		chunk->error = len < 0;
+		if (chunk->error) {
+			len = 0;
+			last = true;
+		}
+		// the buffer may be missing if it could not be allocated
+		if (buf) memset(buf + len, 0, 1 + C_STREAM_PADDING);
+		chunk->buf = buf;
+		chunk->len = len;
+		chunk->last = last;
+		start += used;
+		publish(pl, &pl->tail);
+	}
+	return NULL;
+}
+
+int pipeline_init(struct Pipeline *pl, const char *name, long chunk_size) {
+	memset(pl, 0, sizeof (*pl));
+	pl->chunk_size = chunk_size > 0 ? chunk_size: PIPELINE_CHUNK;
+	pl->source = stream_init(name, C_STREAM_MMAP|C_STREAM_TEXT);
+	if (!pl->source) return -1;
+	ptrdiff_t size;
+	pl->view = (const char *) stream_view(pl->source, &size);
+	pl->len = size;
+	if (!pl->view) goto source;
+	if (lexer_init_buffer(&pl->lexer, NULL, 0)) goto source;
+	if (pthread_mutex_init(&pl->lock, NULL)) goto lexer;
+	if (pthread_cond_init(&pl->wake, NULL)) goto lock;
+	if (pthread_create(&pl->thread, NULL, &preprocess_chunks, pl)) goto wake;
+	pl->started = true;
+	return 0;
+wake:
+	pthread_cond_destroy(&pl->wake);
+lock:
+	pthread_mutex_destroy(&pl->lock);
+lexer:
+	lexer_fini(&pl->lexer);
+source:
+	stream_fini(pl->source);
+	return -1;
+}
+
+enum LexerStatus pipeline_next(struct Pipeline *pl) {
+	for (;;) {
+		if (pl->fed) {
+			enum LexerStatus s = lexer_next(&pl->lexer);
+			if (s != LEXER_END) return s;
+			// the slot goes back to the preprocessor, whatever it had is interned or copied
+			bool last = pl->chunks[pl->head % PIPELINE_SLOTS].last;
+			pl->fed = false;
+			publish(pl, &pl->head);
+			if (last) pl->end = LEXER_END;
+		}
+		if (pl->end) return pl->end;
+		wait_until(pl, &has_chunk);
+		struct PipelineChunk *chunk = &pl->chunks[pl->head % PIPELINE_SLOTS];
+		if (chunk->error) {
+			publish(pl, &pl->head);
+			return pl->end = LEXER_DECODE_ERROR;
+		}
+		lexer_feed(&pl->lexer, chunk->buf, chunk->len);
+		pl->fed = true;
+	}
+}
+
+void pipeline_fini(struct Pipeline *pl) {
+	if (!pl->started) return;
+	pthread_mutex_lock(&pl->lock);
+	__atomic_store_n(&pl->cancel, true, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&pl->wake);
+	pthread_mutex_unlock(&pl->lock);
+	pthread_join(pl->thread, NULL);
+	pthread_cond_destroy(&pl->wake);
+	pthread_mutex_destroy(&pl->lock);
+	free(pl->slots);
+	lexer_fini(&pl->lexer);
+	stream_fini(pl->source);
+	memset(pl, 0, sizeof (*pl));
+}
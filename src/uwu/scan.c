@@ -0,0 +1,153 @@
+#include "uwu/scan.h"
+#include <common/dispatch.h>
+
+#include <stddef.h>
+
+const uint8_t *skip_ident_run(const uint8_t *p) {
+	static ident_scanner scanner = NULL;
+	return DISPATCH(scanner, resolve_ident_scanner)(p);
+}
+
+const uint8_t *skip_space_run(const uint8_t *p) {
+	static space_scanner scanner = NULL;
+	return DISPATCH(scanner, resolve_space_scanner)(p);
+}
+
+long find_newlines(const uint8_t *p, long len, uint32_t base, uint32_t *out) {
+	static newline_scanner scanner = NULL;
+	return DISPATCH(scanner, resolve_newline_scanner)(p, len, base, out);
+}
+
+const uint8_t *skip_ident_swar(const uint8_t *p) {
+	for (;; p += 8) {
+		uint64_t out = ~swar_ident(swar_load(p)) & SWAR_HIGHS;
+		if (out) return p + __builtin_ctzll(out) / 8;
+	}
+}
+
+const uint8_t *skip_space_swar(const uint8_t *p) {
+	for (;; p += 8) {
+		uint64_t out = ~swar_space(swar_load(p)) & SWAR_HIGHS;
+		if (out) return p + __builtin_ctzll(out) / 8;
+	}
+}
+
+long find_newlines_swar(const uint8_t *p, long len, uint32_t base, uint32_t *out) {
+	long n = 0;
+	for (long i = 0; i < len; i += 8) {
+		uint64_t nl = swar_between(swar_load(p + i), '\n' - 1, '\n' + 1);
+		if (len - i < 8) nl &= (UINT64_C(1) << (8 * (len - i))) - 1;
+		if (!out) n += __builtin_popcountll(nl);
+		else for (; nl; nl &= nl - 1) out[n++] = base + i + __builtin_ctzll(nl) / 8 + 1;
+	}
+	return n;
+}
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+
+// unsigned x <= hi, for every byte
+#define LE_SSE2(x, hi) _mm_cmpeq_epi8(_mm_min_epu8((x), _mm_set1_epi8((char) (hi))), (x))
+#define LE_AVX2(x, hi) _mm256_cmpeq_epi8(_mm256_min_epu8((x), _mm256_set1_epi8((char) (hi))), (x))
+
+const uint8_t *skip_ident_sse2(const uint8_t *p) {
+	for (;; p += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) p);
+		__m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+		__m128i alpha = LE_SSE2(_mm_sub_epi8(lower, _mm_set1_epi8('a')), 'z' - 'a');
+		__m128i digit = LE_SSE2(_mm_sub_epi8(x, _mm_set1_epi8('0')), '9' - '0');
+		__m128i under = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+		unsigned in = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+		if (in != 0xFFFF) return p + __builtin_ctz(~in);
+	}
+}
+
+const uint8_t *skip_space_sse2(const uint8_t *p) {
+	for (;; p += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) p);
+		__m128i ctrl = LE_SSE2(_mm_sub_epi8(x, _mm_set1_epi8('\t')), '\r' - '\t');
+		__m128i space = _mm_cmpeq_epi8(x, _mm_set1_epi8(' '));
+		unsigned in = _mm_movemask_epi8(_mm_or_si128(ctrl, space));
+		if (in != 0xFFFF) return p + __builtin_ctz(~in);
+	}
+}
+
+long find_newlines_sse2(const uint8_t *p, long len, uint32_t base, uint32_t *out) {
+	long n = 0;
+	for (long i = 0; i < len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (p + i));
+		unsigned nl = _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')));
+		if (len - i < 16) nl &= (1u << (len - i)) - 1;
+		if (!out) n += __builtin_popcount(nl);
+		else for (; nl; nl &= nl - 1) out[n++] = base + i + __builtin_ctz(nl) + 1;
+	}
+	return n;
+}
+
+__attribute__((target("avx2")))
+const uint8_t *skip_ident_avx2(const uint8_t *p) {
+	for (;; p += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) p);
+		__m256i lower = _mm256_or_si256(x, _mm256_set1_epi8(0x20));
+		__m256i alpha = LE_AVX2(_mm256_sub_epi8(lower, _mm256_set1_epi8('a')), 'z' - 'a');
+		__m256i digit = LE_AVX2(_mm256_sub_epi8(x, _mm256_set1_epi8('0')), '9' - '0');
+		__m256i under = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'));
+		uint32_t in = _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+		if (in != UINT32_MAX) return p + __builtin_ctz(~in);
+	}
+}
+
+__attribute__((target("avx2")))
+const uint8_t *skip_space_avx2(const uint8_t *p) {
+	for (;; p += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) p);
+		__m256i ctrl = LE_AVX2(_mm256_sub_epi8(x, _mm256_set1_epi8('\t')), '\r' - '\t');
+		__m256i space = _mm256_cmpeq_epi8(x, _mm256_set1_epi8(' '));
+		uint32_t in = _mm256_movemask_epi8(_mm256_or_si256(ctrl, space));
+		if (in != UINT32_MAX) return p + __builtin_ctz(~in);
+	}
+}
+
+__attribute__((target("avx2")))
+long find_newlines_avx2(const uint8_t *p, long len, uint32_t base, uint32_t *out) {
+	long n = 0;
+	for (long i = 0; i < len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (p + i));
+		uint32_t nl = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')));
+		if (len - i < 32) nl &= (UINT32_C(1) << (len - i)) - 1;
+		if (!out) n += __builtin_popcount(nl);
+		else for (; nl; nl &= nl - 1) out[n++] = base + i + __builtin_ctz(nl) + 1;
+	}
+	return n;
+}
+
+#undef LE_AVX2
+#undef LE_SSE2
+
+ident_scanner resolve_ident_scanner(void) {
+	return CPU_SUPPORTS("avx2") ? &skip_ident_avx2: &skip_ident_sse2;
+}
+
+space_scanner resolve_space_scanner(void) {
+	return CPU_SUPPORTS("avx2") ? &skip_space_avx2: &skip_space_sse2;
+}
+
+newline_scanner resolve_newline_scanner(void) {
+	return CPU_SUPPORTS("avx2") ? &find_newlines_avx2: &find_newlines_sse2;
+}
+
+#else
+
+ident_scanner resolve_ident_scanner(void) {
+	return &skip_ident_swar;
+}
+
+space_scanner resolve_space_scanner(void) {
+	return &skip_space_swar;
+}
+
+newline_scanner resolve_newline_scanner(void) {
+	return &find_newlines_swar;
+}
+
+#endif
@@ -1,8 +1,461 @@
 #include <uwu/uwu.h>
+#include <bench.h>
+#include <tests.h>
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <inttypes.h>
+#include <ctype.h>
+#include <common/charclass.h>
+#include <uwu/scan.h>
+#include <uwu/float.h>
+#include <uwu/pipeline.h>
+#include <pp/pptoken.h>
+#include <stream/stream.h>
+#include <math.h>
+
+static void keyword_test(void) {
+	const struct Interns *kws = get_keyword_interns();
+	for (ptrdiff_t i = 0; i < kws->len; i++) {
+		const struct InternString *kw = kws->interns[i];
+		assert(keyword_id(kw->str, kw->len) == (enum TokenKind) (TOKEN_KEYWORD_START + kw->id));
+		// same length, first and last characters
+		uint8_t near[16];
+		memcpy(near, kw->str, kw->len);
+		near[kw->len / 2] = kw->len > 2 ? '$': near[kw->len / 2];
+		assert(kw->len <= 2 || keyword_id(near, kw->len) == TOKEN_NONE);
+	}
+	assert(keyword_id((const uint8_t *) "i", 1) == TOKEN_NONE);
+	assert(keyword_id((const uint8_t *) "_Imaginary_", 11) == TOKEN_NONE);
+}
+
+// the table must agree with <ctype.h> on ASCII, and know nothing of the rest
+static void charclass_test(void) {
+	for (int c = 0; c < 256; c++) {
+		bool ascii = c < 0x80;
+		assert(char_is(c, CHAR_IDENT_START) == (ascii && (isalpha(c) || c == '_')));
+		assert(char_is(c, CHAR_IDENT) == (ascii && (isalnum(c) || c == '_')));
+		assert(char_is(c, CHAR_DIGIT) == (ascii && isdigit(c)));
+		assert(char_is(c, CHAR_OCTAL) == (c >= '0' && c <= '7'));
+		assert(char_is(c, CHAR_HEX) == (ascii && isxdigit(c)));
+		assert(char_is(c, CHAR_SPACE) == (ascii && isspace(c)));
+		assert(char_is(c, CHAR_NEWLINE) == (c == '\n'));
+		assert(char_is(c, CHAR_PUNCT) == (ascii && ispunct(c) && !strchr("\"'\\@$`_", c)));
+		assert(!ascii || char_lower(c) == tolower(c));
+		if (char_is(c, CHAR_HEX)) assert(char_hex_value(c) == (int) strtol((char[]) { c, 0 }, NULL, 16));
+		(void) ascii;
+	}
+}
+
+static const struct {
+	const char *name;
+	ident_scanner ident;
+	space_scanner space;
+	newline_scanner newlines;
+	const char *cpu;
+} scanners[] = {
+	{ "swar", &skip_ident_swar, &skip_space_swar, &find_newlines_swar, NULL },
+#if defined(__x86_64__)
+	{ "sse2", &skip_ident_sse2, &skip_space_sse2, &find_newlines_sse2, NULL },
+	{ "avx2", &skip_ident_avx2, &skip_space_avx2, &find_newlines_avx2, "avx2" },
+#endif
+};
+#define NUM_SCANNERS ((int) (sizeof (scanners) / sizeof (*scanners)))
+
+static uint32_t rng = 88172645;
+
+static const uint8_t *skip_ident_scalar(const uint8_t *p) {
+	while (char_is(*p, CHAR_IDENT)) p++;
+	return p;
+}
+
+static const uint8_t *skip_space_scalar(const uint8_t *p) {
+	while (char_is(*p, CHAR_SPACE)) p++;
+	return p;
+}
+
+static long find_newlines_scalar(const uint8_t *p, long len, uint32_t base, uint32_t *out) {
+	long n = 0;
+	for (long i = 0; i < len; i++) {
+		if (p[i] != '\n') continue;
+		if (out) out[n] = base + i + 1;
+		n++;
+	}
+	return n;
+}
+
+// runs of every length, ended by every kind of byte
+static void scan_test(void) {
+	static const char *const runs[] = { "aZ_09xyzQ", " \t\n\v\f\r\n\n" };
+	static const uint8_t stops[] = { 0, '@', '[', '`', '{', '/', ':', '\x80', '\xFF', '\b', '\x0E', '!', '-' };
+	uint8_t buf[256 + C_STREAM_PADDING];
+	for (int i = 0; i < 20000; i++) {
+		const char *run = runs[i % 2];
+		int len = test_random(&rng) % 200, size = strlen(run);
+		memset(buf, 0, sizeof (buf));
+		for (int k = 0; k < len; k++) buf[k] = run[test_random(&rng) % size];
+		buf[len] = stops[test_random(&rng) % sizeof (stops)];
+		int start = len ? test_random(&rng) % len: 0;
+		const uint8_t *expect = i % 2 ? skip_space_scalar(buf + start): skip_ident_scalar(buf + start);
+		for (int v = 0; v < NUM_SCANNERS; v++) {
+			if (!test_cpu_supports(scanners[v].cpu)) continue;
+			assert(i % 2 ? scanners[v].space(buf + start) == expect: scanners[v].ident(buf + start) == expect);
+		}
+		(void) expect;
+		if (!len) continue;
+		assert(i % 2 ? skip_space(buf + start) == expect: skip_ident(buf + start) == expect);
+	}
+}
+
+// newlines anywhere in a buffer, and the lines and columns they give
+static void lines_test(void) {
+	static const char bytes[] = "\n\n\nab \r\x8A";
+	uint8_t buf[256 + C_STREAM_PADDING];
+	uint32_t expect[256], got[256];
+	for (int i = 0; i < 5000; i++) {
+		int len = test_random(&rng) % 256;
+		uint32_t base = test_random(&rng);
+		memset(buf, 0, sizeof (buf));
+		for (int k = 0; k < len; k++) buf[k] = bytes[test_random(&rng) % (sizeof (bytes) - 1)];
+		long n = find_newlines_scalar(buf, len, base, expect);
+		for (int v = 0; v < NUM_SCANNERS; v++) {
+			if (!test_cpu_supports(scanners[v].cpu)) continue;
+			long counted = scanners[v].newlines(buf, len, base, NULL);
+			long found = scanners[v].newlines(buf, len, base, got);
+			assert(counted == n && found == n && !memcmp(got, expect, n * sizeof (*got)));
+			(void) counted, (void) found;
+		}
+		// in two parts, the way `lexer_feed` adds them
+		struct LineIndex lines;
+		int cut = len ? test_random(&rng) % len: 0;
+		int err = line_index_init(&lines);
+		if (!err) err = line_index_add(&lines, buf, cut, 0) || line_index_add(&lines, buf + cut, len - cut, cut);
+		assert(!err && lines.len == n + 1);
+		(void) n;
+		long line = 1, column = 1;
+		for (int k = 0; !err && k <= len; k++) {
+			long at, found = line_index_find(&lines, k, &at);
+			assert(found == line && at == column);
+			(void) found;
+			if (buf[k] == '\n') line++, column = 1;
+			else column++;
+		}
+		line_index_fini(&lines);
+	}
+}
+
+static long double floating(const char *s, enum ConstantAffix suffix, bool *overflow) {
+	struct FloatDigits digits;
+	uint8_t buf[1024 + 8] = { 0 };
+	bool hex = s[0] == '0' && char_lower(s[1]) == 'x';
+	memcpy(buf, s, strlen(s));
+	const uint8_t *end = read_floating(buf + 2 * hex, hex ? 16: 10, &digits);
+	assert(*end == '\0');
+	(void) end;
+	return floating_value(&digits, suffix, overflow);
+}
+
+// libc rounds correctly, so the values must be the very same
+static void check_floating(const char *s) {
+	bool overflow;
+	float f = floating(s, CONSTANT_AFFIX_F, &overflow);
+	assert(f == strtof(s, NULL) && overflow == !!isinf(f));
+	double d = floating(s, CONSTANT_AFFIX_NONE, &overflow);
+	assert(d == strtod(s, NULL) && overflow == !!isinf(d));
+	long double l = floating(s, CONSTANT_AFFIX_L, &overflow);
+	assert(l == strtold(s, NULL) && overflow == !!isinf(l));
+	(void) f, (void) d, (void) l;
+}
+
+static void floating_test(void) {
+	static const char *const cases[] = {
+		"0", "0.", ".0", "0e0", "1", "1.5", ".5", "0.1", "3.14159265358979323846264338327950288",
+		"1e23", "8.988465674311579e307", "1.7976931348623157e308", "1.7976931348623159e308", "1e309",
+		"4.9406564584124654e-324", "2.4703282292062327e-324", "2.4703282292062328e-324", "1e-400",
+		"2.2250738585072011e-308", "2.2250738585072014e-308", "3.4028235e38", "3.4028236e38",
+		"1.4e-45", "7.006492321624085e-46", "1.18e4932", "1.2e4932", "3.6e-4951", "1e-5000",
+		"9007199254740993", "9007199254740993.0000000000000000000001", "1.00000000000000011102230246251565404236316680908203125",
+		"123456789012345678901234567890e-20", "0.000000000000000000000000000000000000000000001e45",
+		"1e0000000000000000000000000000001", "1e-99999999999999999999", "1e+99999999999999999999",
+		"0x1p0", "0x.8", "0x1.fffffffffffffp1023", "0x1.fffffffffffff8p1023", "0x1p-1074", "0x1p-1075",
+		"0x1.00000000000000000000000000000001p0", "0x1.000000000000080000000000000000001p0", "0xABCDEFp-10",
+	};
+	for (size_t i = 0; i < sizeof (cases) / sizeof (*cases); i++) check_floating(cases[i]);
+	// an exponent needs digits
+	static const char *const bad[] = { ".", "1e", "1e+", "1e-f", "0x.p1", "0x1p" };
+	for (size_t i = 0; i < sizeof (bad) / sizeof (*bad); i++) {
+		struct FloatDigits digits;
+		uint8_t s[16] = { 0 };
+		memcpy(s, bad[i], strlen(bad[i]));
+		bool hex = s[0] == '0' && s[1] == 'x';
+		const uint8_t *end = read_floating(s + 2 * hex, hex ? 16: 10, &digits);
+		assert(end == s + 2 * hex);
+		(void) end;
+	}
+
+	char buf[1024];
+	for (int i = 0; i < 20000; i++) {
+		uint64_t bits = (uint64_t) test_random(&rng) << 32 | test_random(&rng);
+		double d;
+		memcpy(&d, &bits, sizeof (d));
+		d = fabs(d);
+		if (isnan(d) || isinf(d)) continue;
+		switch (i % 5) {
+		case 0: // shortest-ish and longer than 19 digits
+			sprintf(buf, "%.*e", (int) (test_random(&rng) % 25), d);
+			break;
+		case 1: // exact halfway between two doubles, which only the slow path decides
+		case 2: {
+			long double mid = ((long double) d + nextafter(d, INFINITY)) / 2;
+			sprintf(buf, "%.*Le", i % 5 == 1 ? 800: (int) (test_random(&rng) % 40), mid);
+			break;
+		}
+		case 3:
+			sprintf(buf, "%a", d);
+			break;
+		case 4: { // anywhere a long double goes
+			long double l = ldexpl((long double) bits, (int) (test_random(&rng) % 32800) - 16500);
+			sprintf(buf, "%.*Le", (int) (test_random(&rng) % 30), l);
+			break;
+		}
+		}
+		check_floating(buf);
+	}
+}
+
+// what read_integer used to do, a digit at a time
+static uintmax_t read_integer_scalar(const uint8_t *i, int base, const uint8_t **endptr) {
+	uintmax_t val = 0;
+	const uint8_t *c = i;
+	for (; char_is(*c, CHAR_HEX); c++) {
+		int d = char_hex_value(*c);
+		if (d >= base) goto end;
+		uintmax_t next = val * base + d;
+		if (next / base != val) goto end;
+		val = next;
+	}
+	*endptr = c;
+	return val;
+end:
+	*endptr = i;
+	return 0;
+}
+
+static void integer_test(void) {
+	static const char *const limits[] = {
+		"18446744073709551615", "18446744073709551616", "99999999999999999999", "000000000000000000000000001",
+		"ffffffffffffffff", "FFFFFFFFFFFFFFFF0", "10000000000000000", "1777777777777777777777",
+		"2000000000000000000000", "12345678", "123456789", "0", "",
+	};
+	static const char digits[] = "0123456789abcdefABCDEF";
+	static const char stops[] = "\0uUlL;) .xg9";
+	uint8_t buf[64];
+	for (int i = 0; i < 60000; i++) {
+		int base = i % 3 == 0 ? 8: i % 3 == 1 ? 10: 16;
+		memset(buf, 0, sizeof (buf));
+		if (i < 3 * (int) (sizeof (limits) / sizeof (*limits))) {
+			memcpy(buf, limits[i / 3], strlen(limits[i / 3]));
+		} else {
+			int len = test_random(&rng) % 26, alphabet = base == 16 ? 22: base;
+			for (int k = 0; k < len; k++) buf[k] = digits[test_random(&rng) % alphabet];
+			buf[len] = stops[test_random(&rng) % (sizeof (stops) - 1)];
+		}
+		const uint8_t *expect_end;
+		uint8_t *end;
+		uintmax_t expect = read_integer_scalar(buf, base, &expect_end), got = read_integer(buf, base, &end);
+		assert(got == expect && end == expect_end);
+		(void) expect, (void) got;
+	}
+}
+
+static bool same_token(const struct Token *a, const struct Token *b) {
+	if (a->kind != b->kind) return false;
+	if (a->kind == TOKEN_IDENTIFIER) {
+		// the lexers may not be the same, so neither are their interns
+		const struct InternString *x = a->ident.detail, *y = b->ident.detail;
+		return x->len == y->len && !memcmp(x->str, y->str, x->len);
+	} else if (a->kind == TOKEN_INTEGER_CONSTANT) {
+		return a->integer.value == b->integer.value && a->integer.suffix == b->integer.suffix;
+	} else if (a->kind == TOKEN_FLOATING_CONSTANT) {
+		return a->floating.value == b->floating.value && a->floating.suffix == b->floating.suffix;
+	} else if (a->kind == TOKEN_CHARACTER_CONSTANT) {
+		return a->character.value == b->character.value && a->character.prefix == b->character.prefix;
+	} else if (a->kind == TOKEN_STRING_LITERAL) {
+		size_t size = a->lit.prefix == CONSTANT_AFFIX_L ? sizeof (uint32_t): 1;
+		return a->lit.len == b->lit.len && a->lit.prefix == b->lit.prefix
+			&& !memcmp(a->lit.sequence, b->lit.sequence, a->lit.len * size);
+	}
+	return true;
+}
+
+// the token buffer must hold exactly what `lexer_next` gives
+static int tokenize_all_test(const char *f) {
+	struct Lexer one, all;
+	struct TokenBuffer tokens = { 0 };
+	if (lexer_init(&one, f)) return -1;
+	if (lexer_init(&all, f)) {
+		lexer_fini(&one);
+		return -1;
+	}
+	int err = lexer_tokenize_all(&all, &tokens);
+	ptrdiff_t i = 0;
+	for (; lexer_next(&one) == LEXER_VALID; i++) {
+		struct Token token;
+		if (i == tokens.len) {
+			err = -1;
+			break;
+		}
+		token_at(&tokens, &all, i, &token);
+		// identifiers are interned by each lexer, in the same order
+		if (token.kind == TOKEN_IDENTIFIER) {
+			assert(token.ident.detail->id == one.token.ident.detail->id);
+			token.ident.detail = one.token.ident.detail;
+		}
+		if (!same_token(&token, &one.token)) err = -1;
+		assert(one.token.offset == tokens.offsets[i] && one.token.len > 0);
+	}
+	if (i != tokens.len) err = -1;
+	printf("%td tokens: %td integers, %td floatings, %td characters, %td literals\n", tokens.len,
+			tokens.integers.len, tokens.floatings.len, tokens.characters.len, tokens.literals.len);
+	token_buffer_fini(&tokens);
+	lexer_fini(&one);
+	lexer_fini(&all);
+	return err;
+}
+
+// the payloads of narrow and wide literals, read once every token is
+static int literal_test(void) {
+	static const uint8_t src[64 + C_STREAM_PADDING] =
+		"s = \"a\\tb\"; w = L\"wid\xC3\xA9\\n\"; e = \"\" L\"\";\n";
+	static const uint32_t wide[] = { 'w', 'i', 'd', 0xE9, '\n', 0 };
+	static const struct StringLiteral expect[] = {
+		{ "a\tb", CONSTANT_AFFIX_NONE, 3 }, { (void *) wide, CONSTANT_AFFIX_L, 5 },
+		{ "", CONSTANT_AFFIX_NONE, 0 }, { (void *) (wide + 5), CONSTANT_AFFIX_L, 0 },
+	};
+	const int n = sizeof (expect) / sizeof (*expect);
+	struct Lexer lexer;
+	struct TokenBuffer tokens = { 0 };
+	if (lexer_init_buffer(&lexer, src, strlen((const char *) src))) return -1;
+	int err = lexer_tokenize_all(&lexer, &tokens);
+	if (!err && tokens.literals.len != n) err = -1;
+	for (int i = 0; !err && i < n; i++) {
+		const struct StringLiteral *lit = &tokens.literals.items[i];
+		// with their terminator, in characters of the width the prefix gives
+		size_t size = expect[i].prefix == CONSTANT_AFFIX_L ? sizeof (uint32_t): 1;
+		if (lit->prefix != expect[i].prefix || lit->len != expect[i].len
+				|| memcmp(lit->sequence, expect[i].sequence, (lit->len + 1) * size)) {
+			printf("literal %d is not the one written.\n", i);
+			err = -1;
+		}
+	}
+	token_buffer_fini(&tokens);
+	lexer_fini(&lexer);
+	return err;
+}
+
+// dots, one at a time or three together, each move the lexer on
+static int dot_test(void) {
+	static const uint8_t src[64 + C_STREAM_PADDING] = "a.b; f(int, ...); x..y\n";
+	static const uint8_t expect[] = {
+		TOKEN_IDENTIFIER, TOKEN_DOT, TOKEN_IDENTIFIER, TOKEN_SEMICOLON,
+		TOKEN_IDENTIFIER, TOKEN_LBRACKET, TOKEN_INT, TOKEN_COMMA, TOKEN_ELLIPSIS, TOKEN_RBRACKET, TOKEN_SEMICOLON,
+		TOKEN_IDENTIFIER, TOKEN_DOT, TOKEN_DOT, TOKEN_IDENTIFIER,
+	};
+	const int n = sizeof (expect) / sizeof (*expect);
+	struct Lexer lexer;
+	struct TokenBuffer tokens = { 0 };
+	if (lexer_init_buffer(&lexer, src, strlen((const char *) src))) return -1;
+	int err = lexer_tokenize_all(&lexer, &tokens);
+	if (!err && (tokens.len != n || memcmp(tokens.kinds, expect, n))) {
+		printf("dots are not lexed as written.\n");
+		err = -1;
+	}
+	token_buffer_fini(&tokens);
+	lexer_fini(&lexer);
+	return err;
+}
+
+// phases 1 to 3 into `o`, the way `pp_test` does it
+static int preprocess_to(const char *f, const char *o) {
+	struct Preprocessor pp;
+	if (preprocessor_init(&pp, f)) return -1;
+	return preprocessor_fini(&pp, o);
+}
+
+// the pipeline must give the same tokens on the same lines as the lexer on the whole output
+static int pipeline_matches(const char *f, const char *o, long chunk_size) {
+	struct Lexer lexer;
+	struct Pipeline pl;
+	if (lexer_init(&lexer, o)) return -1;
+	if (pipeline_init(&pl, f, chunk_size)) {
+		lexer_fini(&lexer);
+		return -1;
+	}
+	enum LexerStatus s, t;
+	do {
+		s = lexer_next(&lexer);
+		t = pipeline_next(&pl);
+		assert(s == t && lexer.token.offset == pl.lexer.token.offset);
+		assert(s != LEXER_VALID || same_token(&lexer.token, &pl.lexer.token));
+		(void) t;
+	} while (s != LEXER_END && s != LEXER_DECODE_ERROR);
+	// every part of the output went into the pipeline's line index
+	assert(pl.lexer.lines.len == lexer.lines.len);
+	for (ptrdiff_t i = 0; i < lexer.lines.len; i++) {
+		long a, b, line = lexer_line(&lexer, lexer.lines.starts[i], &a);
+		long piped = lexer_line(&pl.lexer, lexer.lines.starts[i], &b);
+		assert(line == i + 1 && a == 1 && piped == i + 1 && b == 1);
+		(void) line, (void) piped;
+	}
+	pipeline_fini(&pl);
+	lexer_fini(&lexer);
+	return 0;
+}
+
+static int pipeline_test(void) {
+	static const char *const pieces[] = {
+		"int a = 1;\n", "x = y \\\n+ z;\n", "/* a comment\nover lines */", "// line \\\n still\n",
+		"s = \"str\\\"ing\";\n", "\n\n\n", "\t  ", "c = '\\'';\n", "w = L\"wide\";\n",
+		"f = 1.5e3 * 0x1F;\n", "/**/", "\\\n", "a\?\?(0\?\?)=b;\n", "\"/* not a comment */\";\n",
+	};
+	const char *f = "pipeline_test.c", *o = "pipeline_test.i";
+	int err = -1;
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	for (int i = 0; i < 3000; i++) fputs(pieces[test_random(&rng) % (sizeof (pieces) / sizeof (*pieces))], out);
+	fputs("end;\n", out);
+	fclose(out);
+	static const long sizes[] = { 1, 7, 64, 4096, 0 };
+	if (preprocess_to(f, o)) goto end;
+	for (size_t i = 0; i < sizeof (sizes) / sizeof (*sizes); i++) {
+		if (pipeline_matches(f, o, sizes[i])) goto end;
+	}
+	// phases 1 to 3 of foo.c, all the pipeline runs, rather than the foo.i pp_test wrote
+	if (preprocess_to("foo.c", o) || pipeline_matches("foo.c", o, 16)) goto end;
+	// stopping early must not leave the preprocessor stuck on a full ring
+	struct Pipeline pl;
+	if (pipeline_init(&pl, f, 1)) goto end;
+	enum LexerStatus first = pipeline_next(&pl);
+	pipeline_fini(&pl);
+	assert(first == LEXER_VALID);
+	(void) first;
+	err = 0;
+end:
+	remove(f);
+	remove(o);
+	return err;
+}
 
 int lex_test(void) {
 	printf("lex:\n");
+	keyword_test();
+	charclass_test();
+	scan_test();
+	lines_test();
+	floating_test();
+	integer_test();
 	struct Lexer lexer;
 	int err = -1;
 	const char *f = "foo.i";
@@ -19,7 +472,271 @@ int lex_test(void) {
 	lexer_dump(&lexer);
 	lexer_fini(&lexer);
 	if (s == LEXER_DECODE_ERROR) return s;
+	if ((err = tokenize_all_test(f))) goto end;
+	if ((err = literal_test())) goto end;
+	if ((err = dot_test())) goto end;
+	err = pipeline_test();
 end:
 	return err;
 }
 
+static enum TokenKind keyword_id_interns(const uint8_t *str, ptrdiff_t len) {
+	// what keyword_id used to do
+	const struct InternString *in = intern_find(get_keyword_interns(), str, len);
+	return in ? (enum TokenKind) (TOKEN_KEYWORD_START + in->id): TOKEN_NONE;
+}
+
+static void keyword_bench(const char *what, const uint8_t **words, const ptrdiff_t *lens, long n) {
+	const int rounds = 50;
+	long hits = 0;
+	double t0 = bench_now();
+	for (int r = 0; r < rounds; r++)
+		for (long i = 0; i < n; i++) hits += keyword_id(words[i], lens[i]) != TOKEN_NONE;
+	double t1 = bench_now();
+	for (int r = 0; r < rounds; r++)
+		for (long i = 0; i < n; i++) hits -= keyword_id_interns(words[i], lens[i]) != TOKEN_NONE;
+	double t2 = bench_now();
+	assert(hits == 0);
+	printf("%-18s perfect hash %8.2f Mword/s, interns %8.2f Mword/s\n", what,
+			rounds * n / (t1 - t0 + 1e-9) / 1e6, rounds * n / (t2 - t1 + 1e-9) / 1e6);
+}
+
+// goes over `buf` run by run, the way the lexer would
+static long scan_runs(const uint8_t *buf, ident_scanner ident, space_scanner space) {
+	long runs = 0;
+	for (const uint8_t *p = buf; *p; runs++) {
+		if (char_is(*p, CHAR_IDENT)) p = ident(p);
+		else if (char_is(*p, CHAR_SPACE)) p = space(p);
+		else p++;
+	}
+	return runs;
+}
+
+static const uint8_t *skip_space_inline(const uint8_t *p) {
+	return skip_space(p);
+}
+
+static const uint8_t *skip_ident_inline(const uint8_t *p) {
+	return skip_ident(p);
+}
+
+// indentation and long names, where scanning a byte at a time hurts most.
+// the lengths are random, so that the end of a run cannot be predicted.
+static int scan_bench(void) {
+	const long n = 16 * 1024 * 1024;
+	uint8_t *buf = calloc(n + C_STREAM_PADDING, 1);
+	if (!buf) return -1;
+	for (long len = 0; len < n - 256;) {
+		for (int k = test_random(&rng) % 6 * 4; k; k--) buf[len++] = ' ';
+		for (int words = 1 + test_random(&rng) % 4; words; words--) {
+			for (int k = 1 + test_random(&rng) % 24; k; k--) buf[len++] = 'a' + test_random(&rng) % 26;
+			len += sprintf((char *) buf + len, "%s", words > 1 ? " = ": ";\n");
+		}
+	}
+	double t0 = bench_now();
+	long expect = scan_runs(buf, &skip_ident_scalar, &skip_space_scalar);
+	double t1 = bench_now();
+	printf("runs  %-8s %8.2f MB/s\n", "bytewise", n / (t1 - t0 + 1e-9) / 1e6);
+	for (int v = -1; v < NUM_SCANNERS; v++) {
+		if (v >= 0 && !test_cpu_supports(scanners[v].cpu)) continue;
+		ident_scanner ident = v < 0 ? &skip_ident_inline: scanners[v].ident;
+		space_scanner space = v < 0 ? &skip_space_inline: scanners[v].space;
+		t0 = bench_now();
+		long runs = scan_runs(buf, ident, space);
+		t1 = bench_now();
+		assert(runs == expect);
+		(void) runs;
+		printf("runs  %-8s %8.2f MB/s\n", v < 0 ? "inline": scanners[v].name, n / (t1 - t0 + 1e-9) / 1e6);
+	}
+	// what building the line index costs, the bytewise loop only counts
+	t0 = bench_now();
+	expect = find_newlines_scalar(buf, n, 0, NULL);
+	t1 = bench_now();
+	printf("lines %-8s %8.2f MB/s\n", "bytewise", n / (t1 - t0 + 1e-9) / 1e6);
+	uint32_t *starts = malloc((expect + 1) * sizeof (*starts));
+	for (int v = 0; starts && v < NUM_SCANNERS; v++) {
+		if (!test_cpu_supports(scanners[v].cpu)) continue;
+		t0 = bench_now();
+		long lines = scanners[v].newlines(buf, n, 0, starts);
+		t1 = bench_now();
+		assert(lines == expect);
+		(void) lines;
+		printf("lines %-8s %8.2f MB/s\n", scanners[v].name, n / (t1 - t0 + 1e-9) / 1e6);
+	}
+	free(starts);
+	free(buf);
+	return 0;
+}
+
+// what read_floating_decimal used to do, which is neither fast nor exact
+static long double floating_powl(const char *s) {
+	long double d = 0.0l, div = 10.0l;
+	for (; char_is(*s, CHAR_DIGIT); s++) d = d * 10 + (*s - '0');
+	if (*s == '.') {
+		for (s++; char_is(*s, CHAR_DIGIT); div *= 10, s++) d += (*s - '0') / div;
+	}
+	if (char_lower(*s) == 'e') d *= powl(10.0l, strtol(s + 1, NULL, 10));
+	return d;
+}
+
+// a table of coefficients, as generated sources have them
+static int floating_bench(void) {
+	const long n = 1000000;
+	char *table = malloc(n * 32);
+	if (!table) return -1;
+	for (long i = 0; i < n; i++) {
+		double d = (double) test_random(&rng) / UINT32_MAX * (i % 3 ? 1: 1e6);
+		sprintf(table + i * 32, i % 2 ? "%.17g": "%.9e", d);
+	}
+	long double sum[3] = { 0 };
+	double t0 = bench_now();
+	for (long i = 0; i < n; i++) sum[0] += floating_powl(table + i * 32);
+	double t1 = bench_now();
+	for (long i = 0; i < n; i++) sum[1] += strtod(table + i * 32, NULL);
+	double t2 = bench_now();
+	for (long i = 0; i < n; i++) {
+		struct FloatDigits digits;
+		bool overflow;
+		read_floating((const uint8_t *) table + i * 32, 10, &digits);
+		sum[2] += floating_value(&digits, CONSTANT_AFFIX_NONE, &overflow);
+	}
+	double t3 = bench_now();
+	assert(sum[1] == sum[2]);
+	printf("floating powl %8.2f Mfloat/s, strtod %8.2f Mfloat/s, eisel-lemire %8.2f Mfloat/s\n",
+			n / (t1 - t0 + 1e-9) / 1e6, n / (t2 - t1 + 1e-9) / 1e6, n / (t3 - t2 + 1e-9) / 1e6);
+	free(table);
+	return 0;
+}
+
+// a table of integers, as generated sources have them
+static int integer_bench(void) {
+	const long n = 1000000;
+	uint8_t *table = calloc(n, 32);
+	if (!table) return -1;
+	for (long i = 0; i < n; i++) {
+		uint64_t x = (uint64_t) test_random(&rng) << 32 | test_random(&rng);
+		sprintf((char *) table + i * 32, i % 2 ? "%" PRIu64: "%016" PRIx64, x >> test_random(&rng) % 40);
+	}
+	uintmax_t sum[2] = { 0 };
+	double t0 = bench_now();
+	for (long i = 0; i < n; i++) {
+		const uint8_t *end;
+		sum[0] += read_integer_scalar(table + i * 32, i % 2 ? 10: 16, &end);
+	}
+	double t1 = bench_now();
+	for (long i = 0; i < n; i++) sum[1] += read_integer(table + i * 32, i % 2 ? 10: 16, NULL);
+	double t2 = bench_now();
+	assert(sum[0] == sum[1]);
+	printf("integer bytewise %8.2f Mint/s, swar %8.2f Mint/s\n", n / (t1 - t0 + 1e-9) / 1e6, n / (t2 - t1 + 1e-9) / 1e6);
+	free(table);
+	return 0;
+}
+
+// lexes the same file one token at a time, then all at once
+static int tokenize_bench(void) {
+	const char *f = "lex_bench.i";
+	static const char line[] = "static unsigned long frob(long *w, long n) { "
+		"for (int i = 0; i < n; i++) w[i] += 0x1F * 3.5e2 - 'a'; return \"done\"; }\n";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	for (int i = 0; i < 50000; i++) fputs(line, out);
+	fclose(out);
+	struct Lexer lexer;
+	struct TokenBuffer tokens = { 0 };
+	long n = 0;
+	if (lexer_init(&lexer, f)) return -1;
+	double t0 = bench_now();
+	while (lexer_next(&lexer) == LEXER_VALID) n++;
+	double t1 = bench_now();
+	lexer_fini(&lexer);
+	if (lexer_init(&lexer, f)) return -1;
+	double t2 = bench_now();
+	int err = lexer_tokenize_all(&lexer, &tokens);
+	double t3 = bench_now();
+	assert(err || tokens.len == n);
+	// going over the tokens again costs next to nothing once they are buffered
+	const int rounds = 20;
+	long idents = 0;
+	for (int r = 0; r < rounds; r++) {
+		for (ptrdiff_t i = 0; i < tokens.len; i++) idents += tokens.kinds[i] == TOKEN_IDENTIFIER;
+	}
+	double t4 = bench_now();
+	printf("%ld tokens (%ld identifiers), %zu bytes each\n", n, idents / rounds,
+			sizeof (*tokens.kinds) + sizeof (*tokens.offsets) + sizeof (*tokens.payloads));
+	printf("lexer_next %8.2f Mtok/s, lexer_tokenize_all %8.2f Mtok/s, rescan %8.2f Mtok/s\n",
+			n / (t1 - t0 + 1e-9) / 1e6, n / (t3 - t2 + 1e-9) / 1e6, rounds * n / (t4 - t3 + 1e-9) / 1e6);
+	token_buffer_fini(&tokens);
+	lexer_fini(&lexer);
+	remove(f);
+	return err;
+}
+
+// what lexing a source file used to take: phases 1 to 3 into a file, then the lexer on that file
+static int pipeline_bench(void) {
+	const char *f = "pipeline_bench.c", *o = "pipeline_bench.i";
+	static const char line[] = "static unsigned long frob(long *w, long n) { /* step */ "
+		"for (int i = 0; i < n; i++) w[i] += 0x1F * 3.5e2 - 'a'; \\\n return \"done\"; }\n";
+	FILE *out = fopen(f, "w");
+	if (!out) return -1;
+	for (int i = 0; i < 50000; i++) fputs(line, out);
+	fclose(out);
+	int err = -1;
+	long n = 0, m = 0;
+	struct Lexer lexer;
+	double t0 = bench_now();
+	if (preprocess_to(f, o) || lexer_init(&lexer, o)) goto end;
+	while (lexer_next(&lexer) == LEXER_VALID) n++;
+	lexer_fini(&lexer);
+	double t1 = bench_now();
+	struct Pipeline pl;
+	if (pipeline_init(&pl, f, 0)) goto end;
+	while (pipeline_next(&pl) == LEXER_VALID) m++;
+	pipeline_fini(&pl);
+	double t2 = bench_now();
+	assert(n == m);
+	printf("through a file %8.2f Mtok/s, pipelined %8.2f Mtok/s\n",
+			n / (t1 - t0 + 1e-9) / 1e6, m / (t2 - t1 + 1e-9) / 1e6);
+	err = 0;
+end:
+	remove(f);
+	remove(o);
+	return err;
+}
+
+int lex_bench(void) {
+	printf("lex:\n");
+	if (tokenize_bench()) return -1;
+	if (pipeline_bench()) return -1;
+	if (scan_bench()) return -1;
+	if (floating_bench()) return -1;
+	if (integer_bench()) return -1;
+	const long n = 100000;
+	const uint8_t **words = malloc(n * sizeof (*words));
+	ptrdiff_t *lens = malloc(n * sizeof (*lens));
+	char *idents = malloc(n * 16);
+	if (!words || !lens || !idents) goto end;
+	const struct Interns *kws = get_keyword_interns();
+	// keyword-heavy: 3 keywords for 1 identifier, roughly what declarations look like
+	for (long i = 0; i < n; i++) {
+		char *id = idents + i * 16;
+		if (i % 4) {
+			words[i] = kws->interns[i % kws->len]->str;
+			lens[i] = kws->interns[i % kws->len]->len;
+		} else {
+			words[i] = (uint8_t *) id;
+			lens[i] = sprintf(id, "v%lx", i);
+		}
+	}
+	keyword_bench("keyword-heavy:", words, lens, n);
+	for (long i = 0; i < n; i++) {
+		char *id = idents + i * 16;
+		words[i] = (uint8_t *) id;
+		lens[i] = sprintf(id, "%s_%lx", i % 2 ? "tmp": "counter", i);
+	}
+	keyword_bench("identifier-heavy:", words, lens, n);
+end:
+	free(words);
+	free(lens);
+	free(idents);
+	return 0;
+}
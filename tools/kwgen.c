@@ -0,0 +1,130 @@
+// generates a perfect hash for the keywords of C99, keyed on
+// the length and the first and last characters of a word:
+//
+//     slot = (len + asso[first] + asso[last]) & mask
+//
+// the output is a header meant to be included by src/uwu/lex.c.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+
+static const struct {
+	const char *str;
+	const char *kind;
+} kws[] = {
+	{ "auto"      , "TOKEN_AUTO"      },
+	{ "break"     , "TOKEN_BREAK"     },
+	{ "case"      , "TOKEN_CASE"      },
+	{ "char"      , "TOKEN_CHAR"      },
+	{ "const"     , "TOKEN_CONST"     },
+	{ "continue"  , "TOKEN_CONTINUE"  },
+	{ "default"   , "TOKEN_DEFAULT"   },
+	{ "do"        , "TOKEN_DO"        },
+	{ "double"    , "TOKEN_DOUBLE"    },
+	{ "else"      , "TOKEN_ELSE"      },
+	{ "enum"      , "TOKEN_ENUM"      },
+	{ "extern"    , "TOKEN_EXTERN"    },
+	{ "float"     , "TOKEN_FLOAT"     },
+	{ "for"       , "TOKEN_FOR"       },
+	{ "goto"      , "TOKEN_GOTO"      },
+	{ "if"        , "TOKEN_IF"        },
+	{ "inline"    , "TOKEN_INLINE"    },
+	{ "int"       , "TOKEN_INT"       },
+	{ "long"      , "TOKEN_LONG"      },
+	{ "register"  , "TOKEN_REGISTER"  },
+	{ "restrict"  , "TOKEN_RESTRICT"  },
+	{ "return"    , "TOKEN_RETURN"    },
+	{ "short"     , "TOKEN_SHORT"     },
+	{ "signed"    , "TOKEN_SIGNED"    },
+	{ "sizeof"    , "TOKEN_SIZEOF"    },
+	{ "static"    , "TOKEN_STATIC"    },
+	{ "struct"    , "TOKEN_STRUCT"    },
+	{ "switch"    , "TOKEN_SWITCH"    },
+	{ "typedef"   , "TOKEN_TYPEDEF"   },
+	{ "union"     , "TOKEN_UNION"     },
+	{ "unsigned"  , "TOKEN_UNSIGNED"  },
+	{ "void"      , "TOKEN_VOID"      },
+	{ "volatile"  , "TOKEN_VOLATILE"  },
+	{ "while"     , "TOKEN_WHILE"     },
+	{ "_Bool"     , "TOKEN_BOOL"      },
+	{ "_Complex"  , "TOKEN_COMPLEX"   },
+	{ "_Imaginary", "TOKEN_IMAGINARY" },
+};
+
+#define NUM_KWS ((int) (sizeof (kws) / sizeof (*kws)))
+#define MAX_TRIES (1 << 22)
+
+static uint32_t rng = 0x2545F491;
+
+static uint32_t next_random(void) {
+	// xorshift32, seeded so that the output is reproducible
+	rng ^= rng << 13;
+	rng ^= rng >> 17;
+	rng ^= rng << 5;
+	return rng;
+}
+
+static int slot_of(const uint8_t *asso, int k, int mask) {
+	int len = strlen(kws[k].str);
+	return (len + asso[(uint8_t) kws[k].str[0]] + asso[(uint8_t) kws[k].str[len-1]]) & mask;
+}
+
+static bool try_assign(uint8_t *asso, int mask) {
+	bool used[256] = { false };
+	for (int k = 0; k < NUM_KWS; k++) {
+		int len = strlen(kws[k].str);
+		asso[(uint8_t) kws[k].str[0]] = next_random() & mask;
+		asso[(uint8_t) kws[k].str[len-1]] = next_random() & mask;
+	}
+	for (int k = 0; k < NUM_KWS; k++) {
+		int s = slot_of(asso, k, mask);
+		if (used[s]) return false;
+		used[s] = true;
+	}
+	return true;
+}
+
+int main(void) {
+	uint8_t asso[256] = { 0 };
+	int size, min_len = 255, max_len = 0;
+	for (size = 64; size <= 256; size *= 2) {
+		int tries = 0;
+		while (tries < MAX_TRIES && !try_assign(asso, size-1)) tries++;
+		if (tries < MAX_TRIES) break;
+	}
+	if (size > 256) {
+		fprintf(stderr, "no perfect hash found.\n");
+		return 1;
+	}
+	for (int k = 0; k < NUM_KWS; k++) {
+		int len = strlen(kws[k].str);
+		if (len < min_len) min_len = len;
+		if (len > max_len) max_len = len;
+	}
+
+	printf("// generated by tools/kwgen.c, do not edit\n");
+	printf("#ifndef C_UWU_KEYWORDS_H\n#define C_UWU_KEYWORDS_H\n\n");
+	printf("#define KEYWORD_MIN_LEN (%d)\n", min_len);
+	printf("#define KEYWORD_MAX_LEN (%d)\n", max_len);
+	printf("#define KEYWORD_HASH_MASK (%d)\n\n", size-1);
+	printf("static const uint8_t keyword_asso[256] = {");
+	for (int c = 0; c < 256; c++) {
+		printf("%s%3d,", c % 16 ? " ": "\n\t", asso[c]);
+	}
+	printf("\n};\n\n");
+
+	int slots[256];
+	for (int s = 0; s < size; s++) slots[s] = -1;
+	for (int k = 0; k < NUM_KWS; k++) slots[slot_of(asso, k, size-1)] = k;
+	printf("static const struct {\n\tuint8_t len;\n\tchar str[KEYWORD_MAX_LEN];\n"
+	       "\tenum TokenKind kind;\n} keyword_slots[KEYWORD_HASH_MASK+1] = {\n");
+	for (int s = 0; s < size; s++) {
+		if (slots[s] == -1) continue;
+		int k = slots[s];
+		printf("\t[%3d] = { %2d, \"%s\", %s },\n", s, (int) strlen(kws[k].str), kws[k].str, kws[k].kind);
+	}
+	printf("};\n\n#endif /* C_UWU_KEYWORDS_H */\n");
+	return 0;
+}
@@ -0,0 +1,95 @@
+// generates the 128-bit approximations of the powers of 5 used by the
+// Eisel-Lemire algorithm in src/uwu/float.c, for q from POW5_SMALLEST to POW5_LARGEST:
+//
+//     q >= 0: 5^q, truncated to its 128 most significant bits
+//     q <  0: 2^b / 5^-q rounded up, with b such that it has 128 bits
+//
+// the output is a header meant to be included by src/uwu/float.c.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SMALLEST (-342)
+#define LARGEST  (308)
+// 2^b for q = SMALLEST needs a bit less than 1750 bits
+#define LIMBS    (64)
+
+// little-endian, fixed size is plenty here
+struct Big {
+	uint32_t l[LIMBS];
+};
+
+static void big_pow2(struct Big *x, int b) {
+	memset(x, 0, sizeof (*x));
+	x->l[b / 32] = UINT32_C(1) << (b % 32);
+}
+
+static void big_mul(struct Big *x, uint32_t m) {
+	uint64_t carry = 0;
+	for (int i = 0; i < LIMBS; i++) {
+		carry += (uint64_t) x->l[i] * m;
+		x->l[i] = (uint32_t) carry;
+		carry >>= 32;
+	}
+}
+
+// floor division, and floor(floor(x / a) / b) == floor(x / ab)
+static void big_div(struct Big *x, uint32_t d) {
+	uint64_t rem = 0;
+	for (int i = LIMBS - 1; i >= 0; i--) {
+		rem = rem << 32 | x->l[i];
+		x->l[i] = (uint32_t) (rem / d);
+		rem %= d;
+	}
+}
+
+static void big_inc(struct Big *x) {
+	for (int i = 0; i < LIMBS && ++x->l[i] == 0; i++);
+}
+
+static int big_bits(const struct Big *x) {
+	for (int i = LIMBS - 1; i >= 0; i--) {
+		if (x->l[i]) return i * 32 + 32 - __builtin_clz(x->l[i]);
+	}
+	return 0;
+}
+
+static int big_bit(const struct Big *x, int i) {
+	return i >= 0 && (x->l[i / 32] >> (i % 32)) & 1;
+}
+
+// the 128 bits starting at the most significant one, padded with zeros
+static void print_top(const struct Big *x) {
+	int top = big_bits(x) - 1;
+	uint64_t hi = 0, lo = 0;
+	for (int i = 0; i < 64; i++) hi = hi << 1 | big_bit(x, top - i);
+	for (int i = 64; i < 128; i++) lo = lo << 1 | big_bit(x, top - i);
+	printf("\t0x%016llx, 0x%016llx,\n", (unsigned long long) hi, (unsigned long long) lo);
+}
+
+int main(void) {
+	printf("// generated by tools/pow5gen.c, do not edit\n");
+	printf("#ifndef C_UWU_POW5_H\n#define C_UWU_POW5_H\n\n");
+	printf("#define POW5_SMALLEST (%d)\n", SMALLEST);
+	printf("#define POW5_LARGEST (%d)\n\n", LARGEST);
+	printf("static const uint64_t pow5_128[2 * (POW5_LARGEST - POW5_SMALLEST + 1)] = {\n");
+	struct Big x;
+	for (int q = SMALLEST; q < 0; q++) {
+		big_pow2(&x, 0);
+		for (int i = 0; i < -q; i++) big_mul(&x, 5);
+		// 5^-q is never a power of 2, so 2^z > 5^-q
+		int z = big_bits(&x);
+		big_pow2(&x, q >= -27 ? z + 127: 2 * z + 128);
+		for (int i = 0; i < -q; i++) big_div(&x, 5);
+		big_inc(&x);
+		print_top(&x);
+	}
+	for (int q = 0; q <= LARGEST; q++) {
+		big_pow2(&x, 0);
+		for (int i = 0; i < q; i++) big_mul(&x, 5);
+		print_top(&x);
+	}
+	printf("};\n\n#endif /* C_UWU_POW5_H */\n");
+	return 0;
+}